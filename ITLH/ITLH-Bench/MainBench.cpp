@@ -0,0 +1,827 @@
+#include "Crc32c.h"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+using bench_clock = std::chrono::steady_clock;
+
+constexpr char ACK_MESSAGE[] = "ACK:image_received";
+constexpr char ACK_WARNING[] = "ACK:image_warnings";
+constexpr char ACK_DUPLICATE[] = "ACK:image_duplicate";
+constexpr char ACK_CHECKSUM[] = "ACK:image_checksum";
+constexpr char HELLO_MESSAGE[] = "HELLO:";
+
+constexpr uint32_t DATA_FILE_SEND_HEADER_SIZE = 12; // sizeof(uint32_t) + sizeof(double)
+constexpr uint32_t DATA_FILE_SEND_HEADER_SIZE_V2 = 28; // frame type, flags, reserved (4), file id (4), last modified (8), file size (8), name length (4)
+constexpr uint8_t FRAME_TYPE_FILE = 1;
+constexpr uint8_t FRAME_FLAG_CHECKSUM = 0x01; // the CRC32C of the content (4 bytes) is before the name length
+constexpr uint32_t CHECKSUM_PROTOCOL_VERSION = 6; // asked instead of the version 2 to send checksums
+constexpr double BENCH_FILE_LAST_MODIFIED = 1'700'000'000'000.0; // ms since Unix epoch, same date for all the files sent
+constexpr char COLLISION_FILE_NAME[] = "bench_collision.bin";
+constexpr std::size_t FILE_SALT_SIZE = 16; // first bytes of each file : run id, connection index and file id
+
+/**
+ * @struct BenchOptions
+ * @brief Settings of a benchmark run, given on the command line.
+ */
+struct BenchOptions
+{
+    std::string host = "127.0.0.1";
+    std::string port = "5000";
+    unsigned int connection_count = 4;
+    unsigned int file_count = 100; // per connection
+    uint64_t min_file_size = 1'048'576;
+    uint64_t max_file_size = 1'048'576;
+    double collision_ratio = 0.0; // part of the files sent with the same name
+    uint32_t protocol_version = 2;
+    unsigned int window = 8; // files in flight per connection, protocol version 2 only
+    bool checksum = false; // send the CRC32C of each file, checked by the server
+    unsigned int thread_count = 1;
+    uint32_t seed = 1;
+    std::string label;
+    std::string results_path;
+    std::string metrics_port; // metrics port of the server, empty : allocations not measured
+};
+
+/**
+ * @struct ConnectionResult
+ * @brief Measures of one connection, merged once all the connections are done.
+ */
+struct ConnectionResult
+{
+    uint64_t file_count = 0;
+    uint64_t byte_count = 0; // file content only
+    uint64_t warning_count = 0;
+    uint64_t duplicate_count = 0;
+    uint64_t checksum_failure_count = 0;
+    std::vector<double> latencies_ms; // send to ACK, one per file
+    bench_clock::time_point first_send;
+    bench_clock::time_point last_ack;
+};
+
+/**
+ * @class BenchConnection
+ * @brief A client connection pushing synthetic files to the server, like the HTML client does.
+ *
+ * The connection performs the WebSocket handshake, negotiates the protocol version with "HELLO:<version>" when
+ * the version 2 is asked, then sends its files one message per file. With protocol version 1 it waits for the
+ * ACK of each file before sending the next one, with version 2 it keeps up to `window` files in flight, and
+ * matches each ACK with its file by the file id. With checksums, the version 6 is asked and the CRC32C of each
+ * file is computed before its send and written in its header, like the HTML client does.
+ *
+ * The content of the files is taken from a buffer shared by all the connections, only the header, the
+ * name and the first bytes of a file are built for each message. The first bytes are unique to the file and
+ * to the run, so the server never removes a file as a duplicate of a file of a previous run. For each file, the time from the start of its send to
+ * its ACK is measured.
+ *
+ * Errors are reported using exceptions, thrown from the handlers out of the io_context.
+ */
+class BenchConnection : public std::enable_shared_from_this<BenchConnection>
+{
+public:
+    /**
+     * @param ioc The io_context running the connections, each connection gets its own strand.
+     * @param options The benchmark settings.
+     * @param connection_index Index of the connection, used for unique file names and random sizes.
+     * @param content The content shared by all the files, at least as big as the biggest file.
+     * @param run_id Random value of the run, written at the start of each file.
+     * @param result Measures of the connection, filled until the connection is done.
+     */
+    BenchConnection(net::io_context& ioc, const BenchOptions& options, unsigned int connection_index, const std::vector<uint8_t>& content, uint64_t run_id, ConnectionResult& result)
+        : m_resolver(net::make_strand(ioc))
+        , m_ws(m_resolver.get_executor())
+        , m_options(options)
+        , m_connection_index(connection_index)
+        , m_content(content)
+        , m_run_id(run_id)
+        , m_result(result)
+        , m_random(options.seed + connection_index)
+        , m_protocol_version(options.checksum && options.protocol_version >= 2 ? CHECKSUM_PROTOCOL_VERSION : options.protocol_version)
+    {
+        m_result.latencies_ms.reserve(options.file_count);
+    }
+
+    /**
+     * @brief Starts the connection : resolve, connect, WebSocket handshake, then the sends.
+     */
+    void run()
+    {
+        m_resolver.async_resolve(m_options.host, m_options.port,
+            [self = shared_from_this()](beast::error_code ec, tcp::resolver::results_type results) {
+                check(ec, "resolve");
+                beast::get_lowest_layer(self->m_ws).async_connect(results,
+                    [self](beast::error_code ec, const tcp::endpoint&) {
+                        check(ec, "connect");
+                        self->m_ws.binary(true);
+                        self->m_ws.async_handshake(self->m_options.host + ":" + self->m_options.port, "/",
+                            [self](beast::error_code ec) {
+                                check(ec, "handshake");
+                                self->on_handshake();
+                            });
+                    });
+            });
+    }
+
+private:
+    struct SentFile
+    {
+        bench_clock::time_point send_time;
+        uint64_t size = 0;
+    };
+
+    tcp::resolver m_resolver;
+    websocket::stream<beast::tcp_stream> m_ws;
+    const BenchOptions& m_options;
+    const unsigned int m_connection_index;
+    const std::vector<uint8_t>& m_content;
+    const uint64_t m_run_id;
+    ConnectionResult& m_result;
+    std::mt19937_64 m_random;
+    uint32_t m_protocol_version;
+    bool m_protocol_ready = false; // true once the server answered HELLO, or at once with protocol version 1
+
+    beast::flat_buffer m_read_buffer;
+    std::vector<uint8_t> m_header; // header and name of the message being written
+    std::array<uint8_t, FILE_SALT_SIZE> m_salt = {}; // first bytes of the file being written
+    bool m_writing = false;
+    unsigned int m_next_file = 0;
+    std::map<uint32_t, SentFile> m_sent_files; // files waiting their ACK, by file id
+
+    /**
+     * @brief Throws if an asynchronous operation failed.
+     */
+    static void check(beast::error_code ec, const char* operation)
+    {
+        if (ec)
+        {
+            throw std::runtime_error(std::string("Bench connection ") + operation + " fail : " + ec.message());
+        }
+    }
+
+    /**
+     * @brief Starts reading the server messages, negotiates the protocol version if needed, then starts the sends.
+     */
+    void on_handshake()
+    {
+        do_read();
+
+        if (m_protocol_version >= 2)
+        {
+            m_header.assign(HELLO_MESSAGE, HELLO_MESSAGE + sizeof(HELLO_MESSAGE) - 1);
+            const std::string version = std::to_string(m_protocol_version);
+            m_header.insert(m_header.end(), version.begin(), version.end());
+
+            m_writing = true;
+            m_ws.text(true);
+            m_ws.async_write(net::buffer(m_header), [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                check(ec, "HELLO write");
+                self->m_ws.binary(true);
+                self->m_writing = false;
+                self->send_next_file();
+            });
+            return;
+        }
+
+        m_protocol_ready = true;
+        send_next_file();
+    }
+
+    /**
+     * @brief Returns the name of the next file, shared with other files for a part of them.
+     */
+    std::string make_file_name(unsigned int file_index)
+    {
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+        if (distribution(m_random) < m_options.collision_ratio)
+        {
+            return COLLISION_FILE_NAME;
+        }
+
+        return "bench_c" + std::to_string(m_connection_index) + "_" + std::to_string(file_index) + ".bin";
+    }
+
+    /**
+     * @brief Sends the next file if the protocol is negotiated, no write is in progress and the window has room.
+     */
+    void send_next_file()
+    {
+        const std::size_t window = m_protocol_version >= 2 ? m_options.window : 1;
+        if (!m_protocol_ready || m_writing || m_next_file == m_options.file_count || m_sent_files.size() >= window)
+        {
+            return;
+        }
+
+        const uint32_t file_id = m_next_file++;
+        const std::string file_name = make_file_name(file_id);
+        const uint64_t file_size = std::uniform_int_distribution<uint64_t>(m_options.min_file_size, m_options.max_file_size)(m_random);
+        const uint32_t name_length = static_cast<uint32_t>(file_name.size());
+        const double last_modified = BENCH_FILE_LAST_MODIFIED;
+
+        std::memcpy(m_salt.data(), &m_run_id, 8);
+        std::memcpy(m_salt.data() + 8, &m_connection_index, 4);
+        std::memcpy(m_salt.data() + 12, &file_id, 4);
+        const std::size_t salt_size = static_cast<std::size_t>(std::min<uint64_t>(file_size, FILE_SALT_SIZE));
+
+        if (m_protocol_version >= 2)
+        {
+            const bool has_checksum = m_options.checksum && m_protocol_version >= CHECKSUM_PROTOCOL_VERSION;
+            m_header.assign(DATA_FILE_SEND_HEADER_SIZE_V2, 0);
+            m_header[0] = FRAME_TYPE_FILE;
+            std::memcpy(m_header.data() + 4, &file_id, 4);
+            std::memcpy(m_header.data() + 8, &last_modified, 8);
+            std::memcpy(m_header.data() + 16, &file_size, 8);
+            if (has_checksum)
+            {
+                Crc32c checksum;
+                checksum.feed(m_salt.data(), salt_size);
+                checksum.feed(m_content.data() + salt_size, static_cast<std::size_t>(file_size) - salt_size);
+                const uint32_t checksum_value = checksum.digest();
+
+                m_header[1] = FRAME_FLAG_CHECKSUM;
+                m_header.insert(m_header.begin() + 24, 4, 0);
+                std::memcpy(m_header.data() + 24, &checksum_value, 4);
+            }
+            std::memcpy(m_header.data() + m_header.size() - 4, &name_length, 4);
+        }
+        else
+        {
+            m_header.assign(DATA_FILE_SEND_HEADER_SIZE, 0);
+            std::memcpy(m_header.data(), &name_length, 4);
+            std::memcpy(m_header.data() + 4, &last_modified, 8);
+        }
+        m_header.insert(m_header.end(), file_name.begin(), file_name.end());
+
+        const bench_clock::time_point now = bench_clock::now();
+        if (m_result.file_count == 0 && m_sent_files.empty())
+        {
+            m_result.first_send = now;
+        }
+        m_sent_files[file_id] = { now, file_size };
+
+        const std::array<net::const_buffer, 3> message = {
+            net::buffer(m_header),
+            net::buffer(m_salt.data(), salt_size),
+            net::buffer(m_content.data() + salt_size, static_cast<std::size_t>(file_size) - salt_size)
+        };
+
+        m_writing = true;
+        m_ws.async_write(message, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            check(ec, "file write");
+            self->m_writing = false;
+            self->send_next_file();
+        });
+    }
+
+    /**
+     * @brief Reads the next message of the server.
+     */
+    void do_read()
+    {
+        m_ws.async_read(m_read_buffer, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec == websocket::error::closed)
+            {
+                return;
+            }
+            check(ec, "read");
+
+            const std::string message = beast::buffers_to_string(self->m_read_buffer.data());
+            self->m_read_buffer.consume(self->m_read_buffer.size());
+
+            if (self->process_message(message))
+            {
+                self->do_read();
+            }
+        });
+    }
+
+    /**
+     * @brief Handles a message of the server : the HELLO answer or the ACK of a file.
+     *
+     * @param message The text message received.
+     *
+     * @return false once all the files are acknowledged and the connection is closing.
+     */
+    bool process_message(const std::string& message)
+    {
+        if (message.rfind(HELLO_MESSAGE, 0) == 0)
+        {
+            m_protocol_version = static_cast<uint32_t>(std::stoul(message.substr(sizeof(HELLO_MESSAGE) - 1)));
+            m_protocol_ready = true;
+            send_next_file();
+            return true;
+        }
+
+        const bool is_warning = message.rfind(ACK_WARNING, 0) == 0;
+        const bool is_duplicate = message.rfind(ACK_DUPLICATE, 0) == 0;
+        const bool is_checksum_failure = message.rfind(ACK_CHECKSUM, 0) == 0;
+        if (!is_warning && !is_duplicate && !is_checksum_failure && message.rfind(ACK_MESSAGE, 0) != 0)
+        {
+            throw std::runtime_error("Unexpected server message : " + message);
+        }
+
+        std::map<uint32_t, SentFile>::iterator sent_file = m_sent_files.begin();
+        if (m_protocol_version >= 2)
+        {
+            const std::size_t id_position = message.rfind(':') + 1; // "ACK:image_received:" and the id
+            sent_file = m_sent_files.find(static_cast<uint32_t>(std::stoul(message.substr(id_position))));
+        }
+        if (sent_file == m_sent_files.end())
+        {
+            throw std::runtime_error("ACK of an unknown file : " + message);
+        }
+
+        const bench_clock::time_point now = bench_clock::now();
+        m_result.latencies_ms.push_back(std::chrono::duration<double, std::milli>(now - sent_file->second.send_time).count());
+        m_result.byte_count += sent_file->second.size;
+        m_result.file_count++;
+        m_result.warning_count += is_warning ? 1 : 0;
+        m_result.duplicate_count += is_duplicate ? 1 : 0;
+        m_result.checksum_failure_count += is_checksum_failure ? 1 : 0;
+        m_result.last_ack = now;
+        m_sent_files.erase(sent_file);
+
+        if (m_result.file_count == m_options.file_count)
+        {
+            m_ws.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+            return false;
+        }
+
+        send_next_file();
+        return true;
+    }
+};
+
+/**
+ * @function parse_size
+ * @brief Reads a size in bytes, with an optional K, M or G suffix (1024 based).
+ *
+ * @throws std::invalid_argument If the value is not a size.
+ */
+static uint64_t parse_size(const std::string& value)
+{
+    std::size_t end = 0;
+    const uint64_t number = std::stoull(value, &end);
+    const std::string suffix = value.substr(end);
+
+    if (suffix.empty())
+    {
+        return number;
+    }
+    if (suffix == "K" || suffix == "k")
+    {
+        return number << 10;
+    }
+    if (suffix == "M" || suffix == "m")
+    {
+        return number << 20;
+    }
+    if (suffix == "G" || suffix == "g")
+    {
+        return number << 30;
+    }
+
+    throw std::invalid_argument("Invalid size : " + value);
+}
+
+/**
+ * @function parse_command_line
+ * @brief Reads the benchmark settings given on the command line.
+ *
+ * Supported options :
+ * - `--host <address>` and `--port <port>` : the server (default : 127.0.0.1 5000).
+ * - `--connections <count>` : number of concurrent connections (default : 4).
+ * - `--files <count>` : number of files sent by each connection (default : 100).
+ * - `--size <size>` : size of every file, or `--min-size <size>` and `--max-size <size>` for random sizes
+ *   between both, with an optional K, M or G suffix (default : 1M).
+ * - `--collisions <ratio>` : part of the files sent with the same name, between 0 and 1 (default : 0).
+ * - `--protocol <version>` : protocol version used, 1 or 2 (default : 2).
+ * - `--window <count>` : files in flight per connection with protocol version 2 (default : 8).
+ * - `--checksum <0|1>` : 1 sends the CRC32C of each file with protocol version 2, the server checks it (default : 0).
+ * - `--threads <count>` : number of threads running the connections (default : 1).
+ * - `--seed <value>` : seed of the random sizes and collisions (default : 1).
+ * - `--results <path>` : file where the results of the run are appended, one line per run.
+ * - `--label <text>` : name of the run in the results file, like the build tested.
+ * - `--metrics-port <port>` : metrics port of the server, its allocations during the run are shown per file.
+ *
+ * @throws std::invalid_argument If an option is unknown or has an invalid value.
+ */
+static BenchOptions parse_command_line(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            throw std::invalid_argument("Missing value of command line option : " + arg);
+        }
+        const std::string value = argv[++i];
+
+        if (arg == "--host")
+        {
+            options.host = value;
+        }
+        else if (arg == "--port")
+        {
+            options.port = value;
+        }
+        else if (arg == "--connections")
+        {
+            options.connection_count = static_cast<unsigned int>(std::stoul(value));
+        }
+        else if (arg == "--files")
+        {
+            options.file_count = static_cast<unsigned int>(std::stoul(value));
+        }
+        else if (arg == "--size")
+        {
+            options.min_file_size = options.max_file_size = parse_size(value);
+        }
+        else if (arg == "--min-size")
+        {
+            options.min_file_size = parse_size(value);
+        }
+        else if (arg == "--max-size")
+        {
+            options.max_file_size = parse_size(value);
+        }
+        else if (arg == "--collisions")
+        {
+            options.collision_ratio = std::stod(value);
+        }
+        else if (arg == "--protocol")
+        {
+            options.protocol_version = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (arg == "--window")
+        {
+            options.window = static_cast<unsigned int>(std::stoul(value));
+        }
+        else if (arg == "--checksum")
+        {
+            options.checksum = value == "1";
+        }
+        else if (arg == "--threads")
+        {
+            options.thread_count = static_cast<unsigned int>(std::stoul(value));
+        }
+        else if (arg == "--seed")
+        {
+            options.seed = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (arg == "--results")
+        {
+            options.results_path = value;
+        }
+        else if (arg == "--label")
+        {
+            options.label = value;
+        }
+        else if (arg == "--metrics-port")
+        {
+            options.metrics_port = value;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown command line option : " + arg);
+        }
+    }
+
+    if (options.connection_count < 1 || options.file_count < 1 || options.window < 1 || options.thread_count < 1)
+    {
+        throw std::invalid_argument("--connections, --files, --window and --threads need at least 1");
+    }
+    if (options.min_file_size > options.max_file_size)
+    {
+        throw std::invalid_argument("--min-size is bigger than --max-size");
+    }
+    if (options.collision_ratio < 0.0 || options.collision_ratio > 1.0)
+    {
+        throw std::invalid_argument("--collisions must be between 0 and 1");
+    }
+    if (options.protocol_version < 1 || options.protocol_version > 2)
+    {
+        throw std::invalid_argument("--protocol must be 1 or 2");
+    }
+
+    return options;
+}
+
+/**
+ * @function percentile
+ * @brief Returns the value below which a part of the sorted values are (nearest rank).
+ */
+static double percentile(const std::vector<double>& sorted_values, double part)
+{
+    if (sorted_values.empty())
+    {
+        return 0.0;
+    }
+
+    const std::size_t rank = static_cast<std::size_t>(std::ceil(part * sorted_values.size()));
+    return sorted_values[std::clamp<std::size_t>(rank, 1, sorted_values.size()) - 1];
+}
+
+/**
+ * @struct BenchSummary
+ * @brief Merged measures of all the connections.
+ */
+struct BenchSummary
+{
+    uint64_t file_count = 0;
+    uint64_t byte_count = 0;
+    uint64_t warning_count = 0;
+    uint64_t duplicate_count = 0;
+    uint64_t checksum_failure_count = 0;
+    double duration_s = 0.0;
+    double mb_per_s = 0.0;
+    double files_per_s = 0.0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+/**
+ * @function summarize
+ * @brief Merges the measures of the connections. The duration goes from the first send to the last ACK.
+ */
+static BenchSummary summarize(const std::vector<ConnectionResult>& results)
+{
+    BenchSummary summary;
+    std::vector<double> latencies_ms;
+    bench_clock::time_point first_send = bench_clock::time_point::max();
+    bench_clock::time_point last_ack = bench_clock::time_point::min();
+
+    for (const ConnectionResult& result : results)
+    {
+        summary.file_count += result.file_count;
+        summary.byte_count += result.byte_count;
+        summary.warning_count += result.warning_count;
+        summary.duplicate_count += result.duplicate_count;
+        summary.checksum_failure_count += result.checksum_failure_count;
+        latencies_ms.insert(latencies_ms.end(), result.latencies_ms.begin(), result.latencies_ms.end());
+        first_send = std::min(first_send, result.first_send);
+        last_ack = std::max(last_ack, result.last_ack);
+    }
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    summary.duration_s = std::chrono::duration<double>(last_ack - first_send).count();
+    if (summary.duration_s > 0.0)
+    {
+        summary.mb_per_s = summary.byte_count / 1'000'000.0 / summary.duration_s;
+        summary.files_per_s = summary.file_count / summary.duration_s;
+    }
+    summary.p50_ms = percentile(latencies_ms, 0.50);
+    summary.p99_ms = percentile(latencies_ms, 0.99);
+    summary.max_ms = latencies_ms.empty() ? 0.0 : latencies_ms.back();
+
+    return summary;
+}
+
+/**
+ * @function read_server_allocations
+ * @brief Reads the number of allocations done by the server since its start, from its metrics.
+ *
+ * @return The count, empty if the server doesn't count its allocations (built without `ITLH_COUNT_ALLOCATIONS`).
+ *
+ * @throws std::runtime_error If the metrics can't be read.
+ */
+static std::optional<uint64_t> read_server_allocations(const BenchOptions& options)
+{
+    constexpr char ALLOCATIONS_METRIC[] = "\nitlh_allocations_total ";
+
+    net::io_context ioc;
+    beast::tcp_stream stream(ioc);
+    stream.connect(tcp::resolver(ioc).resolve(options.host, options.metrics_port));
+
+    http::request<http::empty_body> request(http::verb::get, "/metrics", 11);
+    request.set(http::field::host, options.host);
+    http::write(stream, request);
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> response;
+    http::read(stream, buffer, response);
+
+    if (response.result() != http::status::ok)
+    {
+        throw std::runtime_error("No metrics from the server on port " + options.metrics_port);
+    }
+    const std::string& body = response.body();
+    const std::size_t position = body.find(ALLOCATIONS_METRIC);
+    if (position == std::string::npos)
+    {
+        return std::nullopt;
+    }
+    return std::stoull(body.substr(position + sizeof(ALLOCATIONS_METRIC) - 1));
+}
+
+/**
+ * @function make_config_key
+ * @brief Describes the settings that change the results, runs with the same key can be compared.
+ */
+static std::string make_config_key(const BenchOptions& options)
+{
+    std::ostringstream key;
+    key << options.connection_count << "\t" << options.file_count << "\t" << options.min_file_size << "\t" << options.max_file_size
+        << "\t" << options.collision_ratio << "\t" << options.protocol_version << "\t" << (options.protocol_version >= 2 ? options.window : 1)
+        << "\t" << (options.checksum && options.protocol_version >= 2 ? 1 : 0);
+    return key.str();
+}
+
+/**
+ * @function append_results
+ * @brief Appends the results of the run to the results file, and compares them with the last run of the same settings.
+ *
+ * The results file is a tab separated table with a header line, one line per run : date, label, settings,
+ * then MB/s, files/s, p50 and p99 latency in milliseconds. The comparison with the previous run having the
+ * same settings shows at once a regression between two builds.
+ *
+ * @throws std::ios_base::failure If the results file can't be written.
+ */
+static void append_results(const BenchOptions& options, const BenchSummary& summary)
+{
+    constexpr std::size_t CONFIG_COLUMN_COUNT = 8;
+    const std::string config_key = make_config_key(options);
+
+    // Last run with the same settings
+    std::vector<std::string> previous_run;
+    bool has_header = false;
+    {
+        std::ifstream results_file(options.results_path);
+        std::string line;
+        while (std::getline(results_file, line))
+        {
+            has_header = true;
+
+            std::vector<std::string> columns;
+            std::istringstream line_stream(line);
+            std::string column;
+            while (std::getline(line_stream, column, '\t'))
+            {
+                columns.push_back(column);
+            }
+            if (columns.size() != 2 + CONFIG_COLUMN_COUNT + 4)
+            {
+                continue;
+            }
+
+            std::string key = columns[2];
+            for (std::size_t i = 3; i < 2 + CONFIG_COLUMN_COUNT; i++)
+            {
+                key += "\t" + columns[i];
+            }
+            if (key == config_key)
+            {
+                previous_run = columns;
+            }
+        }
+    }
+
+    std::ofstream results_file(options.results_path, std::ios::app);
+    if (!results_file)
+    {
+        throw std::ios_base::failure("Failed to open results file : " + options.results_path);
+    }
+    if (!has_header)
+    {
+        results_file << "date\tlabel\tconnections\tfiles\tmin_size\tmax_size\tcollisions\tprotocol\twindow\tchecksum\tmb_per_s\tfiles_per_s\tp50_ms\tp99_ms\n";
+    }
+
+    const std::time_t now = std::time(nullptr);
+    std::tm local_time = *std::localtime(&now);
+    results_file << std::put_time(&local_time, "%Y-%m-%d %H:%M:%S") << "\t" << (options.label.empty() ? "-" : options.label) << "\t" << config_key
+        << std::fixed << std::setprecision(2) << "\t" << summary.mb_per_s << "\t" << summary.files_per_s
+        << "\t" << summary.p50_ms << "\t" << summary.p99_ms << "\n";
+    std::cout << "Results appended to " << options.results_path << std::endl;
+
+    if (previous_run.empty())
+    {
+        return;
+    }
+
+    auto print_change = [](const char* name, double previous, double current) {
+        const double change = previous > 0.0 ? (current - previous) / previous * 100.0 : 0.0;
+        std::cout << "  " << name << " : " << previous << " -> " << current << " (" << std::showpos << change << std::noshowpos << " %)" << std::endl;
+    };
+    std::cout << "Compared to the run of " << previous_run[0] << " (" << previous_run[1] << ") with the same settings :" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    print_change("MB/s", std::stod(previous_run[10]), summary.mb_per_s);
+    print_change("files/s", std::stod(previous_run[11]), summary.files_per_s);
+    print_change("p50 ms", std::stod(previous_run[12]), summary.p50_ms);
+    print_change("p99 ms", std::stod(previous_run[13]), summary.p99_ms);
+}
+
+/**
+ * @function main
+ * @brief Entry point of the benchmark : runs the connections until all their files are acknowledged, then prints the results.
+ *
+ * The server must be started before, the files sent are saved in its destination folder.
+ */
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const BenchOptions options = parse_command_line(argc, argv);
+
+        std::vector<uint8_t> content(static_cast<std::size_t>(options.max_file_size));
+        std::mt19937 random(options.seed);
+        std::generate(content.begin(), content.end(), [&random]() { return static_cast<uint8_t>(random()); });
+
+        std::cout << "Bench of ws://" << options.host << ":" << options.port << " : " << options.connection_count << " connections, "
+            << options.file_count << " files per connection of " << options.min_file_size << " to " << options.max_file_size << " octets, "
+            << options.collision_ratio * 100.0 << " % same name, protocol " << options.protocol_version
+            << (options.protocol_version >= 2 ? ", window " + std::to_string(options.window) : "")
+            << (options.checksum && options.protocol_version >= 2 ? std::string(", CRC32C checksum (") + Crc32c::implementation_name() + ")" : "") << std::endl;
+
+        const uint64_t run_id = (static_cast<uint64_t>(std::random_device()()) << 32) ^ static_cast<uint64_t>(std::time(nullptr));
+
+        const std::optional<uint64_t> allocations_before = options.metrics_port.empty() ? std::nullopt : read_server_allocations(options);
+
+        net::io_context ioc;
+        std::vector<ConnectionResult> results(options.connection_count);
+        for (unsigned int i = 0; i < options.connection_count; i++)
+        {
+            std::make_shared<BenchConnection>(ioc, options, i, content, run_id, results[i])->run();
+        }
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < options.thread_count; i++)
+        {
+            threads.emplace_back([&ioc]() { ioc.run(); });
+        }
+        ioc.run();
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        const BenchSummary summary = summarize(results);
+        std::cout << std::fixed << std::setprecision(2)
+            << "Sent " << summary.file_count << " files, " << summary.byte_count / 1'000'000.0 << " MB in " << summary.duration_s << " s" << std::endl
+            << "Throughput : " << summary.mb_per_s << " MB/s, " << summary.files_per_s << " files/s" << std::endl
+            << "Send to ACK latency : p50 " << summary.p50_ms << " ms, p99 " << summary.p99_ms << " ms, max " << summary.max_ms << " ms" << std::endl;
+        if (summary.warning_count > 0)
+        {
+            std::cout << summary.warning_count << " files acknowledged with a warning" << std::endl;
+        }
+        if (summary.duplicate_count > 0)
+        {
+            std::cout << summary.duplicate_count << " files acknowledged as duplicate" << std::endl;
+        }
+        if (summary.checksum_failure_count > 0)
+        {
+            std::cout << summary.checksum_failure_count << " files rejected by the server, their data don't match their checksum" << std::endl;
+        }
+        if (!options.metrics_port.empty())
+        {
+            // The count includes the handshakes of the connections and the metrics requests
+            const std::optional<uint64_t> allocations_after = read_server_allocations(options);
+            if (allocations_before && allocations_after)
+            {
+                const uint64_t allocations = *allocations_after - *allocations_before;
+                std::cout << "Server allocations : " << allocations << ", " << static_cast<double>(allocations) / std::max<uint64_t>(summary.file_count, 1) << " per file" << std::endl;
+            }
+            else
+            {
+                std::cout << "Server allocations : unavailable, the server is built without ITLH_COUNT_ALLOCATIONS" << std::endl;
+            }
+        }
+
+        if (!options.results_path.empty())
+        {
+            append_results(options, summary);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Something went wrong. Exception : " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+#include "AllocationCounter.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @class AllocationCounter
+ * @brief Counts the memory allocations of the server, served with the metrics.
+ *
+ * Built with `ITLH_COUNT_ALLOCATIONS` only (CMake option, off by default) : the global `operator new` and
+ * `operator delete` are then replaced by `malloc()` and `free()` with a count of the allocations, so the benchmark
+ * can check that receiving a file doesn't allocate. Each thread adds to its own slot of the count, the network
+ * threads and the engine threads don't share a cache line for each allocation. The aligned forms are not replaced,
+ * they keep their own allocation functions. Without it, the allocators of the platform are kept and the count is
+ * unavailable.
+ */
+
+#ifdef ITLH_COUNT_ALLOCATIONS
+
+static constexpr std::size_t COUNTER_SLOT_COUNT = 16;
+
+/**
+ * @struct CounterSlot
+ * @brief Allocations counted by the threads using a slot, alone in its cache line.
+ */
+struct alignas(64) CounterSlot
+{
+    std::atomic<uint64_t> count = 0;
+};
+
+static std::array<CounterSlot, COUNTER_SLOT_COUNT> counter_slots;
+static std::atomic<std::size_t> next_counter_slot = 0;
+
+/**
+ * @brief Counts an allocation in the slot of the calling thread, given to the thread on its first allocation.
+ */
+static void count_allocation()
+{
+    thread_local std::size_t slot = COUNTER_SLOT_COUNT;
+    if (slot == COUNTER_SLOT_COUNT)
+    {
+        slot = next_counter_slot.fetch_add(1, std::memory_order_relaxed) % COUNTER_SLOT_COUNT;
+    }
+    counter_slots[slot].count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Allocates memory and counts the allocation, a size of 0 gets a unique pointer like the default `operator new`.
+ *
+ * @return The memory, null if it can't be allocated.
+ */
+static void* allocate(std::size_t size) noexcept
+{
+    count_allocation();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+/**
+ * @brief Allocates memory, calls the new handler until the allocation succeeds like the default `operator new`.
+ *
+ * @throws std::bad_alloc If the memory can't be allocated and no new handler is installed.
+ */
+static void* allocate_or_throw(std::size_t size)
+{
+    for (;;)
+    {
+        if (void* memory = allocate(size))
+        {
+            return memory;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+/**
+ * @brief Allocates memory like `allocate_or_throw()`, for the nothrow forms of `operator new`.
+ *
+ * @return The memory, null if no new handler is installed or if the new handler throws `std::bad_alloc`.
+ */
+static void* allocate_or_null(std::size_t size) noexcept
+{
+    try
+    {
+        return allocate_or_throw(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+#endif
+
+/**
+ * @brief Tells if the allocations are counted, the server was built with `ITLH_COUNT_ALLOCATIONS`.
+ */
+bool AllocationCounter::is_enabled()
+{
+#ifdef ITLH_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Returns the number of allocations done since the start of the server, 0 if they are not counted.
+ */
+uint64_t AllocationCounter::count()
+{
+    uint64_t count = 0;
+#ifdef ITLH_COUNT_ALLOCATIONS
+    for (const CounterSlot& counter_slot : counter_slots)
+    {
+        count += counter_slot.count.load(std::memory_order_relaxed);
+    }
+#endif
+    return count;
+}
+
+#ifdef ITLH_COUNT_ALLOCATIONS
+
+void* operator new(std::size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_or_null(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_or_null(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+#endif
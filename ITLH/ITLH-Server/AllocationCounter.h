@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+class AllocationCounter
+{
+public:
+	static bool is_enabled();
+	static uint64_t count();
+};
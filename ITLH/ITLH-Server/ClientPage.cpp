@@ -0,0 +1,383 @@
+#include "ClientPage.h"
+#include "ContentHasher.h"
+
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <memory>
+
+#ifdef ITLH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ITLH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+constexpr char SERVER_ADDRESS_MARKER[] = "injectedServerIp = ''"; // line of the page replaced with the address of the server
+constexpr char NOT_FOUND_TEXT[] = "Not found, the client page is served on /\n";
+constexpr auto CLIENT_PAGE_REQUEST_TIMEOUT = std::chrono::seconds(30);
+
+/**
+ * @class ClientPageConnection
+ * @brief Answers the HTTP requests of a browser loading the client page, as long as it keeps the connection alive.
+ */
+class ClientPageConnection : public std::enable_shared_from_this<ClientPageConnection>
+{
+public:
+    ClientPageConnection(tcp::socket socket, beast::flat_buffer buffer, ClientPage::Request request, const ClientPage& page)
+        : m_stream(std::move(socket))
+        , m_buffer(std::move(buffer))
+        , m_request(std::move(request))
+        , m_page(page)
+    {
+    }
+
+    void run()
+    {
+        respond();
+    }
+
+private:
+    beast::tcp_stream m_stream;
+    beast::flat_buffer m_buffer;
+    ClientPage::Request m_request;
+    ClientPage::Response m_response;
+    const ClientPage& m_page;
+
+    void respond()
+    {
+        m_response = {};
+        m_page.respond(m_request, m_response);
+
+        m_stream.expires_after(CLIENT_PAGE_REQUEST_TIMEOUT);
+        http::async_write(m_stream, m_response, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec)
+            {
+                return;
+            }
+
+            if (!self->m_response.keep_alive())
+            {
+                self->m_stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+                return;
+            }
+            self->read();
+            });
+    }
+
+    void read()
+    {
+        m_request = {};
+        m_stream.expires_after(CLIENT_PAGE_REQUEST_TIMEOUT);
+        http::async_read(m_stream, m_buffer, m_request, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (!ec)
+            {
+                self->respond();
+            }
+            });
+    }
+};
+
+/**
+ * @brief Returns a header value or a target of a request as a standard string view.
+ */
+static std::string_view to_string_view(beast::string_view text)
+{
+    return std::string_view(text.data(), text.size());
+}
+
+#ifdef ITLH_ZLIB
+/**
+ * @brief Compresses the page in the gzip format, with the best compression.
+ *
+ * @return The compressed page, empty on error.
+ */
+static std::string compress_gzip(const std::string& data)
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) // 15 + 16 : gzip header
+    {
+        return std::string();
+    }
+
+    std::string compressed(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_out = static_cast<uInt>(compressed.size());
+
+    const int result = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return result == Z_STREAM_END ? compressed : std::string();
+}
+#endif
+
+#ifdef ITLH_BROTLI
+/**
+ * @brief Compresses the page in the brotli format, with the best compression.
+ *
+ * @return The compressed page, empty on error.
+ */
+static std::string compress_brotli(const std::string& data)
+{
+    std::string compressed(BrotliEncoderMaxCompressedSize(data.size()), '\0');
+    std::size_t compressed_size = compressed.size();
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+        reinterpret_cast<const uint8_t*>(data.data()), &compressed_size, reinterpret_cast<uint8_t*>(compressed.data())))
+    {
+        return std::string();
+    }
+
+    compressed.resize(compressed_size);
+    return compressed;
+}
+#endif
+
+/**
+ * @class ClientPage
+ * @brief Serves the HTML client page on the WebSocket port, to the browsers that ask it with a plain HTTP GET.
+ *
+ * The page is read once at startup, the address of the server is written in it, so the browser only has to connect,
+ * then it is compressed with every encoding the server is built with (brotli, gzip). All the variants stay in memory :
+ * a request is answered with a single write of the headers and of the variant accepted by the browser, without a copy.
+ * Each variant has its own ETag, made of the hash of the page, and the page has to be checked again on each load
+ * (`Cache-Control: no-cache`), so a browser loading the page again gets a `304 Not Modified` without the page.
+ *
+ * The session reads the first request of a connection : a WebSocket upgrade is accepted by the session, any other
+ * request is given to `serve()`, which answers it and the next requests of the connection.
+ */
+
+/**
+ * @brief Reads the page and builds its variants.
+ *
+ * @param page_path The HTML client page, empty to serve no page : all the requests get a 404.
+ * @param server_address The address written in the page for the connection to the server, empty to leave the page as is.
+ *
+ * @exception std::ios_base::failure Thrown if the page can't be read.
+ */
+ClientPage::ClientPage(const std::string& page_path, const std::string& server_address)
+{
+    if (page_path.empty())
+    {
+        return;
+    }
+
+    std::ifstream file(page_path, std::ios::binary);
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to open client page: " + page_path);
+    }
+    std::string page((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const std::size_t marker = page.find(SERVER_ADDRESS_MARKER);
+    if (marker != std::string::npos && !server_address.empty())
+    {
+        page.replace(marker, std::strlen(SERVER_ADDRESS_MARKER), "injectedServerIp = '" + server_address + "'");
+    }
+
+    ContentHasher hasher;
+    hasher.feed(reinterpret_cast<const uint8_t*>(page.data()), page.size());
+    char hash[16];
+    const std::to_chars_result hash_result = std::to_chars(hash, hash + sizeof(hash), hasher.digest(), 16);
+    const std::string page_hash(hash, hash_result.ptr);
+
+    add_variant("", page, page_hash);
+#ifdef ITLH_BROTLI
+    add_variant("br", compress_brotli(page), page_hash);
+#endif
+#ifdef ITLH_ZLIB
+    add_variant("gzip", compress_gzip(page), page_hash);
+#endif
+}
+
+/**
+ * @brief Adds a variant of the page, a compressed variant is only kept if it's smaller than the page.
+ */
+void ClientPage::add_variant(const std::string& encoding, std::string body, const std::string& hash)
+{
+    if (!encoding.empty() && (body.empty() || body.size() >= m_variants.front().body.size()))
+    {
+        return;
+    }
+
+    Variant variant;
+    variant.encoding = encoding;
+    variant.body = std::move(body);
+    variant.etag = "\"" + hash + (encoding.empty() ? std::string() : "-" + encoding) + "\"";
+    m_variants.push_back(std::move(variant));
+}
+
+/**
+ * @brief Returns the variants of the page with their size, for the console.
+ */
+std::string ClientPage::encodings() const
+{
+    std::string text;
+    for (const Variant& variant : m_variants)
+    {
+        text += (text.empty() ? "" : ", ") + (variant.encoding.empty() ? std::string("identity") : variant.encoding)
+            + " " + std::to_string(variant.body.size()) + " bytes";
+    }
+    return text;
+}
+
+/**
+ * @brief Checks if an encoding is in the `Accept-Encoding` header of a request, without a quality of 0.
+ */
+bool ClientPage::accepts_encoding(std::string_view accept_encoding, std::string_view encoding)
+{
+    while (!accept_encoding.empty())
+    {
+        const std::size_t comma = accept_encoding.find(',');
+        std::string_view coding = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+        double quality = 1.0;
+        const std::size_t parameters = coding.find(';');
+        if (parameters != std::string_view::npos)
+        {
+            const std::size_t q = coding.find("q=", parameters);
+            if (q != std::string_view::npos)
+            {
+                std::from_chars(coding.data() + q + 2, coding.data() + coding.size(), quality);
+            }
+            coding = coding.substr(0, parameters);
+        }
+
+        coding.remove_prefix(std::min(coding.find_first_not_of(' '), coding.size()));
+        coding = coding.substr(0, coding.find_last_not_of(' ') + 1);
+        const bool is_same = coding == "*" || (coding.size() == encoding.size()
+            && std::equal(coding.begin(), coding.end(), encoding.begin(), [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }));
+        if (is_same)
+        {
+            return quality > 0.0;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Checks if an ETag is in the `If-None-Match` header of a request, weak ETags match too.
+ */
+bool ClientPage::matches_etag(std::string_view if_none_match, const std::string& etag)
+{
+    while (!if_none_match.empty())
+    {
+        const std::size_t comma = if_none_match.find(',');
+        std::string_view tag = if_none_match.substr(0, comma);
+        if_none_match = comma == std::string_view::npos ? std::string_view() : if_none_match.substr(comma + 1);
+
+        tag.remove_prefix(std::min(tag.find_first_not_of(' '), tag.size()));
+        tag = tag.substr(0, tag.find_last_not_of(' ') + 1);
+        if (tag.substr(0, 2) == "W/")
+        {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Answers a request of a connection that is not a WebSocket upgrade, then the next requests of the connection.
+ *
+ * @param socket The socket of the connection.
+ * @param buffer The bytes read after the request.
+ * @param request The first request of the connection.
+ */
+void ClientPage::serve(tcp::socket socket, beast::flat_buffer buffer, Request request) const
+{
+    std::make_shared<ClientPageConnection>(std::move(socket), std::move(buffer), std::move(request), *this)->run();
+}
+
+/**
+ * @brief Builds the response to a request : the variant of the page accepted by the browser, a 304 if the browser
+ * already has it, or an error.
+ *
+ * The body of the response points to the variant kept by the page, the page must outlive the response.
+ *
+ * @param request The request of the browser.
+ * @param response The response to fill.
+ */
+void ClientPage::respond(const Request& request, Response& response) const
+{
+    response.version(request.version());
+    response.keep_alive(request.keep_alive());
+
+    const std::string_view target = to_string_view(request.target());
+    const std::string_view path = target.substr(0, target.find('?')); // the page keeps the address of the server in ?ip=
+
+    if (request.method() != http::verb::get && request.method() != http::verb::head)
+    {
+        response.result(http::status::method_not_allowed);
+        response.set(http::field::allow, "GET, HEAD");
+        response.prepare_payload();
+        return;
+    }
+
+    if (!has_page() || (path != "/" && path != "/index.html" && path != "/client.html"))
+    {
+        response.result(http::status::not_found);
+        response.set(http::field::content_type, "text/plain");
+        response.body() = boost::beast::span<const char>(NOT_FOUND_TEXT, sizeof(NOT_FOUND_TEXT) - 1);
+        response.prepare_payload();
+        return;
+    }
+
+    const Variant* variant = &m_variants.front();
+    const std::string_view accept_encoding = to_string_view(request[http::field::accept_encoding]);
+    for (std::size_t i = 1; i < m_variants.size(); i++)
+    {
+        if (accepts_encoding(accept_encoding, m_variants[i].encoding))
+        {
+            variant = &m_variants[i];
+            break;
+        }
+    }
+
+    response.set(http::field::etag, variant->etag);
+    response.set(http::field::vary, "Accept-Encoding");
+    response.set(http::field::cache_control, "no-cache");
+
+    if (matches_etag(to_string_view(request[http::field::if_none_match]), variant->etag))
+    {
+        response.result(http::status::not_modified);
+        return;
+    }
+
+    response.result(http::status::ok);
+    response.set(http::field::content_type, "text/html; charset=utf-8");
+    if (!variant->encoding.empty())
+    {
+        response.set(http::field::content_encoding, variant->encoding);
+    }
+
+    if (request.method() == http::verb::head)
+    {
+        response.content_length(variant->body.size());
+    }
+    else
+    {
+        response.body() = boost::beast::span<const char>(variant->body.data(), variant->body.size());
+        response.prepare_payload();
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ClientPage
+{
+public:
+	using Request = boost::beast::http::request<boost::beast::http::empty_body>;
+	using Response = boost::beast::http::response<boost::beast::http::span_body<const char>>;
+
+	ClientPage(const std::string& page_path, const std::string& server_address);
+
+	bool has_page() const { return !m_variants.empty(); }
+	std::string encodings() const;
+
+	void serve(boost::asio::ip::tcp::socket socket, boost::beast::flat_buffer buffer, Request request) const;
+	void respond(const Request& request, Response& response) const;
+
+private:
+	struct Variant
+	{
+		std::string encoding; // Content-Encoding, empty for the page as is
+		std::string body;
+		std::string etag;
+	};
+
+	static bool accepts_encoding(std::string_view accept_encoding, std::string_view encoding);
+	static bool matches_etag(std::string_view if_none_match, const std::string& etag);
+	void add_variant(const std::string& encoding, std::string body, const std::string& hash);
+
+	std::vector<Variant> m_variants; // the page as is first, then its compressed variants, preferred first
+};
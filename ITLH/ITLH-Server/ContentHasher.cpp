@@ -0,0 +1,164 @@
+#include "ContentHasher.h"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @class ContentHasher
+ * @brief Computes the XXH64 hash (seed 0) of a file while its data are received.
+ *
+ * The data are given in parts of any size with `feed()`, like the metadata date reader, so the file is hashed
+ * once, in the network threads, without being read again from the disk. XXH64 runs much faster than the network
+ * and the disk, the hash is only used to find files already received, not as a security check.
+ */
+
+static constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+static constexpr std::size_t STRIPE_SIZE = 32;
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * @brief Reads a little-endian value, the protocol and the supported systems are little-endian.
+ */
+static uint64_t read_u64(const uint8_t* data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t read_u32(const uint8_t* data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * PRIME_2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * PRIME_1;
+}
+
+static uint64_t merge_round(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= hash_round(0, accumulator);
+    return hash * PRIME_1 + PRIME_4;
+}
+
+/**
+ * @brief Processes complete 32 bytes stripes, returns the number of bytes used.
+ */
+static std::size_t process_stripes(std::array<uint64_t, 4>& accumulators, const uint8_t* data, std::size_t size)
+{
+    uint64_t accumulator_1 = accumulators[0];
+    uint64_t accumulator_2 = accumulators[1];
+    uint64_t accumulator_3 = accumulators[2];
+    uint64_t accumulator_4 = accumulators[3];
+
+    std::size_t used_size = 0;
+    for (; used_size + STRIPE_SIZE <= size; used_size += STRIPE_SIZE)
+    {
+        accumulator_1 = hash_round(accumulator_1, read_u64(data + used_size));
+        accumulator_2 = hash_round(accumulator_2, read_u64(data + used_size + 8));
+        accumulator_3 = hash_round(accumulator_3, read_u64(data + used_size + 16));
+        accumulator_4 = hash_round(accumulator_4, read_u64(data + used_size + 24));
+    }
+
+    accumulators = { accumulator_1, accumulator_2, accumulator_3, accumulator_4 };
+    return used_size;
+}
+
+ContentHasher::ContentHasher()
+    : m_accumulators{ PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1 }
+{
+}
+
+/**
+ * @brief Adds the next bytes of the file to the hash.
+ *
+ * @param data The bytes received.
+ * @param size The number of bytes.
+ */
+void ContentHasher::feed(const uint8_t* data, std::size_t size)
+{
+    m_total_size += size;
+
+    if (m_stripe_size > 0)
+    {
+        const std::size_t copy_size = std::min(STRIPE_SIZE - m_stripe_size, size);
+        std::memcpy(m_stripe.data() + m_stripe_size, data, copy_size);
+        m_stripe_size += copy_size;
+        data += copy_size;
+        size -= copy_size;
+
+        if (m_stripe_size < STRIPE_SIZE)
+        {
+            return;
+        }
+        process_stripes(m_accumulators, m_stripe.data(), STRIPE_SIZE);
+        m_stripe_size = 0;
+    }
+
+    const std::size_t used_size = process_stripes(m_accumulators, data, size);
+    m_stripe_size = size - used_size;
+    std::memcpy(m_stripe.data(), data + used_size, m_stripe_size);
+}
+
+/**
+ * @brief Returns the hash of all the bytes given so far.
+ */
+uint64_t ContentHasher::digest() const
+{
+    uint64_t hash;
+    if (m_total_size >= STRIPE_SIZE)
+    {
+        hash = rotate_left(m_accumulators[0], 1) + rotate_left(m_accumulators[1], 7) + rotate_left(m_accumulators[2], 12) + rotate_left(m_accumulators[3], 18);
+        for (const uint64_t accumulator : m_accumulators)
+        {
+            hash = merge_round(hash, accumulator);
+        }
+    }
+    else
+    {
+        hash = m_accumulators[2] + PRIME_5; // accumulator 3 is the seed
+    }
+
+    hash += m_total_size;
+
+    // Remaining bytes, less than a stripe
+    const uint8_t* data = m_stripe.data();
+    std::size_t size = m_stripe_size;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        hash ^= hash_round(0, read_u64(data));
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (size >= 4)
+    {
+        hash ^= static_cast<uint64_t>(read_u32(data)) * PRIME_1;
+        hash = rotate_left(hash, 23) * PRIME_2 + PRIME_3;
+        data += 4;
+        size -= 4;
+    }
+    for (; size > 0; data++, size--)
+    {
+        hash ^= *data * PRIME_5;
+        hash = rotate_left(hash, 11) * PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
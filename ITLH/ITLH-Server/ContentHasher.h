@@ -0,0 +1,19 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class ContentHasher
+{
+public:
+	ContentHasher();
+
+	void feed(const uint8_t* data, std::size_t size);
+	uint64_t digest() const;
+
+private:
+	std::array<uint64_t, 4> m_accumulators;
+	std::array<uint8_t, 32> m_stripe; // bytes of an incomplete stripe
+	std::size_t m_stripe_size = 0;
+	uint64_t m_total_size = 0;
+};
@@ -0,0 +1,218 @@
+#include "Crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ITLH_CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)) || defined(_M_ARM64)
+#define ITLH_CRC32C_ARMV8
+#include <arm_acle.h>
+#endif
+
+/**
+ * @class Crc32c
+ * @brief Computes the CRC32C (Castagnoli) checksum of a file while its data are received.
+ *
+ * The client sends the checksum of the content in the header of the file, the data are given in parts of any size
+ * with `feed()`, like the content hasher, so the check adds no pass over the data. The CRC32C instruction of
+ * SSE 4.2 (x86-64, checked at runtime) or of ARMv8 (when the compiler targets it) is used, it runs much faster
+ * than the network. Other processors use a table, 8 bytes at a time.
+ */
+
+static constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78; // reflected
+
+using Crc32cTables = std::array<std::array<uint32_t, 256>, 8>;
+
+/**
+ * @brief Builds the tables of the software CRC32C, the table k gives the CRC of a byte followed by k zero bytes.
+ */
+static Crc32cTables make_tables()
+{
+    Crc32cTables tables{};
+    for (uint32_t byte = 0; byte < 256; byte++)
+    {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; byte++)
+    {
+        for (std::size_t k = 1; k < tables.size(); k++)
+        {
+            tables[k][byte] = (tables[k - 1][byte] >> 8) ^ tables[0][tables[k - 1][byte] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+/**
+ * @brief Software CRC32C, slicing by 8 bytes.
+ */
+static uint32_t update_table(uint32_t crc, const uint8_t* data, std::size_t size)
+{
+    static const Crc32cTables tables = make_tables();
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+            ^ tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+    }
+    for (; size > 0; data++, size--)
+    {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef ITLH_CRC32C_SSE42
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t update_sse42(uint32_t crc, const uint8_t* data, std::size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; data++, size--)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+/**
+ * @brief Checks if the processor has the SSE 4.2 instructions.
+ */
+static bool has_sse42()
+{
+#ifdef _MSC_VER
+    int registers[4];
+    __cpuid(registers, 1);
+    return (registers[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+
+#ifdef ITLH_CRC32C_ARMV8
+static uint32_t update_armv8(uint32_t crc, const uint8_t* data, std::size_t size)
+{
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, 8);
+        crc = __crc32cd(crc, value);
+    }
+    for (; size > 0; data++, size--)
+    {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+using UpdateFunction = uint32_t(*)(uint32_t crc, const uint8_t* data, std::size_t size);
+
+/**
+ * @brief Chooses the fastest implementation the processor supports, once.
+ */
+static UpdateFunction get_update_function()
+{
+#ifdef ITLH_CRC32C_SSE42
+    static const UpdateFunction update = has_sse42() ? update_sse42 : update_table;
+    return update;
+#elif defined(ITLH_CRC32C_ARMV8)
+    return update_armv8;
+#else
+    return update_table;
+#endif
+}
+
+/**
+ * @brief Adds data to the checksum.
+ */
+void Crc32c::feed(const uint8_t* data, std::size_t size)
+{
+    m_state = get_update_function()(m_state, data, size);
+}
+
+/**
+ * @brief Returns the checksum of a whole buffer.
+ */
+uint32_t Crc32c::compute(const uint8_t* data, std::size_t size)
+{
+    Crc32c crc;
+    crc.feed(data, size);
+    return crc.digest();
+}
+
+/**
+ * @brief Returns the name of the implementation used, shown when the server starts.
+ */
+const char* Crc32c::implementation_name()
+{
+#ifdef ITLH_CRC32C_SSE42
+    return get_update_function() == update_sse42 ? "SSE 4.2" : "table";
+#elif defined(ITLH_CRC32C_ARMV8)
+    return "ARMv8";
+#else
+    return "table";
+#endif
+}
+
+/**
+ * @brief Returns the update function of an implementation, or null if the processor or the build doesn't have it.
+ */
+static UpdateFunction find_update_function(Crc32c::Implementation implementation)
+{
+    switch (implementation)
+    {
+    case Crc32c::Implementation::table:
+        return update_table;
+#ifdef ITLH_CRC32C_SSE42
+    case Crc32c::Implementation::sse42:
+        return has_sse42() ? update_sse42 : nullptr;
+#endif
+#ifdef ITLH_CRC32C_ARMV8
+    case Crc32c::Implementation::armv8:
+        return update_armv8;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * @brief Checks if an implementation can run here.
+ */
+bool Crc32c::is_supported(Implementation implementation)
+{
+    return find_update_function(implementation) != nullptr;
+}
+
+/**
+ * @brief Returns the checksum of a whole buffer with an implementation, which must be supported.
+ */
+uint32_t Crc32c::compute(Implementation implementation, const uint8_t* data, std::size_t size)
+{
+    return ~find_update_function(implementation)(0xFFFFFFFF, data, size);
+}
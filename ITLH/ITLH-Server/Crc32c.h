@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+class Crc32c
+{
+public:
+	enum class Implementation
+	{
+		table, // slicing by 8, any processor
+		sse42,
+		armv8
+	};
+
+	void feed(const uint8_t* data, std::size_t size);
+	uint32_t digest() const { return ~m_state; }
+
+	static uint32_t compute(const uint8_t* data, std::size_t size);
+	static const char* implementation_name();
+
+	// Runs one implementation whatever the processor supports best, for the tests
+	static bool is_supported(Implementation implementation);
+	static uint32_t compute(Implementation implementation, const uint8_t* data, std::size_t size);
+
+private:
+	uint32_t m_state = 0xFFFFFFFF;
+};
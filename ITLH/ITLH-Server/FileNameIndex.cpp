@@ -0,0 +1,200 @@
+#include "FileNameIndex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <ios>
+#include <stdexcept>
+
+/**
+ * @class FileNameIndex
+ * @brief Keeps in memory the file names taken in the save directory, for giving a unique name to each received file.
+ *
+ * The directory is scanned once when the index is created, then every name given by `reserve_unique_path()`
+ * is added to the index. For each asked name, the index remembers the next suffix to try (`name_1`, `name_2`, ...),
+ * so choosing a name doesn't depend on the number of files already saved with the same name.
+ *
+ * Names are compared without case on Windows, like the file system does. The path of a free name is built in a single
+ * string, without path objects, only the names already taken go through the slower search of a suffix.
+ *
+ * All the functions can be called from many threads at the same time.
+ */
+
+/**
+ * @brief Tells if a character separates the directories of a path, also used by the index of the saved files.
+ */
+bool FileNameIndex::is_separator(char c)
+{
+#ifdef _WIN32
+    return c == '\\' || c == '/';
+#else
+    return c == '/';
+#endif
+}
+
+/**
+ * @brief Builds the index by scanning the names already present in the directory.
+ *
+ * @param directory The save directory.
+ * @param max_same_name Maximum number of files with the same asked name.
+ */
+FileNameIndex::FileNameIndex(const std::string& directory, uint32_t max_same_name)
+    : m_directory(directory)
+    , m_max_same_name(max_same_name)
+{
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+    {
+        m_taken_names.insert(make_key(entry.path().filename().string()));
+    }
+}
+
+/**
+ * @brief Returns the key of a file name in the index, the name itself or its lower case version on Windows.
+ */
+std::string FileNameIndex::make_key(const std::string& file_name)
+{
+#ifdef _WIN32
+    std::string key = file_name;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return key;
+#else
+    return file_name;
+#endif
+}
+
+/**
+ * @brief Returns the path of a file of the directory.
+ */
+std::string FileNameIndex::make_path(const std::string& file_name) const
+{
+    std::string path;
+    path.reserve(m_directory.size() + 1 + file_name.size());
+    path.append(m_directory);
+    if (!path.empty() && !is_separator(path.back()))
+    {
+        path += static_cast<char>(std::filesystem::path::preferred_separator);
+    }
+    path.append(file_name);
+    return path;
+}
+
+/**
+ * @brief Takes a name if it is free in the index and on disk.
+ *
+ * The disk is checked for the chosen name only, to never overwrite a file created in the directory
+ * by another program after the scan.
+ *
+ * @param file_name The name to take, must be called with the mutex locked.
+ * @param check_disk false if the caller creates the file only if it doesn't exist, and asks another name if it exists.
+ * @param full_path Set to the path of the file when the name is taken.
+ *
+ * @return true if the name is now taken for the caller.
+ */
+bool FileNameIndex::try_take(const std::string& file_name, bool check_disk, std::string& full_path)
+{
+    if (!m_taken_names.insert(make_key(file_name)).second)
+    {
+        return false;
+    }
+
+    // File name not take, so we can use it
+    full_path = make_path(file_name);
+    return !check_disk || !std::filesystem::exists(full_path);
+}
+
+/**
+ * @brief Chooses a unique path in the save directory for a received file and marks it as taken.
+ *
+ * If the name is taken, a suffix is added before the extension (`name_1.ext`, `name_2.ext`, ...), starting
+ * from the last suffix given for this name.
+ *
+ * @param file_name The file name sent by the client.
+ * @param check_disk false if the caller creates the file only if it doesn't exist (like with `O_EXCL`), the disk
+ * is then not checked, and the caller asks a new name if the file exists. The name stays taken in the index.
+ *
+ * @return The full path of the file.
+ *
+ * @throws std::runtime_error If more than `max_same_name` files have the same name.
+ */
+std::string FileNameIndex::reserve_unique_path(const std::string& file_name, bool check_disk)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string full_path;
+    if (try_take(file_name, check_disk, full_path))
+    {
+        return full_path;
+    }
+
+    const std::filesystem::path file_path(file_name);
+    const std::string& base_name = file_path.stem().string();
+    const std::string& extension = file_path.extension().string();
+
+    uint32_t& counter = m_next_suffixes.try_emplace(make_key(file_name), 1).first->second;
+
+    // Generate new name, in the same string for each suffix tried
+    std::string new_file_name;
+    while (counter <= m_max_same_name)
+    {
+        char suffix[16];
+        const std::to_chars_result result = std::to_chars(suffix, suffix + sizeof(suffix), counter);
+        new_file_name.assign(base_name).append(1, '_').append(suffix, result.ptr).append(extension);
+        counter++;
+
+        if (try_take(new_file_name, check_disk, full_path))
+        {
+            return full_path;
+        }
+    }
+
+    throw std::runtime_error("Error generating name, more than " + std::to_string(m_max_same_name) + " files with the same name, program close");
+}
+
+/**
+ * @brief Frees the name of a file removed from the save directory.
+ *
+ * The name can be given again by `reserve_unique_path()` when asked exactly, suffixes already given are not reused.
+ *
+ * @param full_path The path given by `reserve_unique_path()`.
+ */
+void FileNameIndex::release_path(const std::string& full_path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_taken_names.erase(make_key(std::filesystem::path(full_path).filename().string()));
+}
+
+/**
+ * @brief Moves a complete file of the save directory, like a part file, to a unique path made from a file name.
+ *
+ * @param source_path The path of the file to move.
+ * @param file_name The file name sent by the client.
+ *
+ * @return The full path of the moved file.
+ *
+ * @throws std::runtime_error If more than `max_same_name` files have the same name.
+ * @exception std::ios_base::failure Thrown if the file can't be renamed, its new name is then released.
+ */
+std::string FileNameIndex::move_to_unique_path(const std::string& source_path, const std::string& file_name)
+{
+    const std::string full_path = reserve_unique_path(file_name);
+
+    std::error_code error;
+    std::filesystem::rename(source_path, full_path, error);
+    if (error)
+    {
+        release_path(full_path);
+        throw std::ios_base::failure("Failed to rename file: " + source_path + " to " + full_path + ", " + error.message());
+    }
+
+    return full_path;
+}
+
+/**
+ * @brief Returns the number of names taken in the directory.
+ */
+std::size_t FileNameIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_taken_names.size();
+}
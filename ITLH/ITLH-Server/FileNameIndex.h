@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+class FileNameIndex
+{
+public:
+	FileNameIndex(const std::string& directory, uint32_t max_same_name);
+
+	std::string reserve_unique_path(const std::string& file_name, bool check_disk = true);
+	void release_path(const std::string& full_path);
+	std::string move_to_unique_path(const std::string& source_path, const std::string& file_name);
+
+	std::size_t size() const;
+
+	static bool is_separator(char c);
+
+private:
+	static std::string make_key(const std::string& file_name);
+	std::string make_path(const std::string& file_name) const;
+	bool try_take(const std::string& file_name, bool check_disk, std::string& full_path);
+
+	const std::string m_directory;
+	const uint32_t m_max_same_name;
+
+	mutable std::mutex m_mutex;
+	std::unordered_set<std::string> m_taken_names;
+	std::unordered_map<std::string, uint32_t> m_next_suffixes; // key : stem and extension of the asked name
+};
@@ -0,0 +1,148 @@
+#include "FileWriteEngine.h"
+
+/**
+ * @class FileWriteEngine
+ * @brief Writes the received files on disk out of the network threads.
+ *
+ * A file is opened with `open()`, its data are written with `write()` at their position in the file,
+ * then it is closed with `close()`, which applies its date, or removed with `discard()` when the client
+ * leaves before its end. The file of a resumable upload is opened with `open_part()` in its part file, kept with its data,
+ * and renamed into place with a free name by `close()`. When the client leaves before its end, the part file is closed
+ * with `detach()` and kept, so a later upload writes the rest of it. A small file received at once is written with
+ * `save()`, which opens, writes, dates and closes it as a single operation when the engine can. The files saved are read back
+ * by jobs given to `run_read_job()`, so a read of the disk never stalls the network threads either. The operations of a file can be called one after the other without waiting their
+ * handlers : the engine keeps their order where it matters (writes after open, close after the last write).
+ * Handlers are called by an engine thread, they must be short and should only post work on their own executor.
+ *
+ * The number of queued operations is bounded by `max_queue_depth` : a session checks `is_full()` before
+ * reading more data from its client and, when the queue is full, it registers with `notify_when_not_full()`
+ * to be woken up once enough operations are done. Both are given the file the data are for, so an engine with
+ * a queue per disk only stops the sessions writing to a busy disk. The current and peak queue depth can be read to tune
+ * the queue size.
+ *
+ * With `flush_files`, `close()` and `save()` flush the file on disk before closing it, and the entries of its
+ * directory after, so the handler is called once the file would survive a power loss. Without it, the file is left
+ * in the cache of the system, which writes it on disk later.
+ *
+ * Implementations : `SaveWorkerPool` runs blocking writes on a thread pool, `IoUringWriteEngine` submits
+ * asynchronous operations to the Linux io_uring interface, `ShardedWriteEngine` spreads the files over several
+ * save directories, each with its own engine.
+ */
+
+/**
+ * @param max_queue_depth Number of queued operations above which `is_full()` returns true.
+ * @param flush_files true to flush each file on disk when it's closed (`Durability::file`).
+ */
+FileWriteEngine::FileWriteEngine(std::size_t max_queue_depth, bool flush_files)
+    : m_flush_files(flush_files)
+    , m_max_queue_depth(max_queue_depth)
+{
+}
+
+/**
+ * @brief Writes a whole file received at once : open, write, date and close.
+ *
+ * This default implementation chains `open()`, `write()` and `close()`, engines override it to save the file with
+ * fewer operations.
+ *
+ * @param file_name The file name sent by the client.
+ * @param data The content of the file, must stay valid until the handler is called.
+ * @param size The size of the file.
+ * @param date The date of the file, in milliseconds since Unix epoch.
+ * @param handler Called once the file is closed, with the first error of its operations.
+ *
+ * @return The file, its path is set once the handler is called.
+ */
+std::shared_ptr<FileWriteEngine::File> FileWriteEngine::save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler)
+{
+    std::shared_ptr<File> file = open(file_name, size, [](std::exception_ptr) {});
+    if (size > 0)
+    {
+        write(file, 0, data, size, [](std::exception_ptr) {});
+    }
+    close(file, date, std::move(handler));
+    return file;
+}
+
+/**
+ * @brief Checks if the number of queued operations reached the maximum queue depth.
+ *
+ * @param file The file the next data are for, null for the next file opened. Engines with a single queue ignore it.
+ */
+bool FileWriteEngine::is_full(const std::shared_ptr<File>&) const
+{
+    return is_queue_full();
+}
+
+/**
+ * @brief Registers a callback to call once the queue is no longer full.
+ *
+ * If the queue is not full anymore, the callback is called immediately. Else it is called by an engine
+ * thread when an operation is done. The callback must be short, it should only post work on its own executor.
+ *
+ * @param file The file given to `is_full()`.
+ * @param callback The function to call once there is room in the queue.
+ */
+void FileWriteEngine::notify_when_not_full(const std::shared_ptr<File>&, std::function<void()> callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_waiters_mutex);
+        if (is_queue_full())
+        {
+            m_waiters.push_back(std::move(callback));
+            return;
+        }
+    }
+
+    callback();
+}
+
+/**
+ * @brief Appends the metrics of the engine in the Prometheus text format, engines with one queue have none.
+ *
+ * @param text The text to append to.
+ */
+void FileWriteEngine::render_metrics(std::string&) const
+{
+}
+
+/**
+ * @brief Checks if the number of queued operations reached the maximum queue depth.
+ */
+bool FileWriteEngine::is_queue_full() const
+{
+    return m_queue_depth >= m_max_queue_depth;
+}
+
+/**
+ * @brief Updates the queue depth and its peak when an operation is queued.
+ */
+void FileWriteEngine::on_operation_queued()
+{
+    const std::size_t queue_depth = ++m_queue_depth;
+    std::size_t peak_queue_depth = m_peak_queue_depth.load();
+    while (queue_depth > peak_queue_depth && !m_peak_queue_depth.compare_exchange_weak(peak_queue_depth, queue_depth));
+}
+
+/**
+ * @brief Updates the queue depth after an operation and wakes up the waiters if there is room in the queue.
+ */
+void FileWriteEngine::on_operation_done()
+{
+    m_queue_depth--;
+
+    std::vector<std::function<void()>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_waiters_mutex);
+        if (is_queue_full() || m_waiters.empty())
+        {
+            return;
+        }
+        waiters.swap(m_waiters);
+    }
+
+    for (const std::function<void()>& waiter : waiters)
+    {
+        waiter();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class Durability
+{
+	none, // files are closed without flush, the system writes them on disk later
+	file, // each file is flushed on disk by the write engine before its close handler is called
+	group, // the closed files are flushed on disk together by a group commit before they are acknowledged
+};
+
+class FileWriteEngine
+{
+public:
+	using Handler = std::function<void(std::exception_ptr error)>; // called by an engine thread, error is null on success
+
+	struct File
+	{
+		virtual ~File() = default;
+
+		std::string full_path; // set by the engine when the file is opened, and when a part file is renamed on close, read once the file is closed
+		std::size_t root = 0; // storage root of the file, set by ShardedWriteEngine
+
+		// set by the engine around the choice of a free name, read once the file is closed
+		std::chrono::steady_clock::time_point name_resolution_start;
+		std::chrono::steady_clock::time_point name_resolution_end;
+	};
+
+	FileWriteEngine(std::size_t max_queue_depth, bool flush_files);
+	virtual ~FileWriteEngine() = default;
+
+	virtual const char* name() const = 0;
+
+	virtual std::shared_ptr<File> open(const std::string& file_name, uint64_t file_size, Handler handler) = 0;
+	virtual void write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler) = 0;
+	virtual void close(const std::shared_ptr<File>& file, double date, Handler handler) = 0;
+	virtual void discard(const std::shared_ptr<File>& file) = 0;
+
+	virtual std::shared_ptr<File> save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler);
+
+	virtual std::shared_ptr<File> open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler) = 0;
+	virtual void detach(const std::shared_ptr<File>& file, Handler handler) = 0;
+
+	virtual void run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler) = 0;
+
+	virtual bool is_full(const std::shared_ptr<File>& file) const;
+	virtual void notify_when_not_full(const std::shared_ptr<File>& file, std::function<void()> callback);
+
+	virtual std::size_t queue_depth() const { return m_queue_depth; }
+	virtual std::size_t peak_queue_depth() const { return m_peak_queue_depth; }
+	virtual std::size_t max_queue_depth() const { return m_max_queue_depth; }
+
+	virtual void render_metrics(std::string& text) const;
+
+protected:
+	void on_operation_queued();
+	void on_operation_done();
+
+	const bool m_flush_files; // Durability::file : each file and its directory are flushed on disk when it's closed
+
+private:
+	bool is_queue_full() const;
+
+	const std::size_t m_max_queue_depth;
+	std::atomic<std::size_t> m_queue_depth = 0;
+	std::atomic<std::size_t> m_peak_queue_depth = 0;
+
+	std::mutex m_waiters_mutex;
+	std::vector<std::function<void()>> m_waiters;
+};
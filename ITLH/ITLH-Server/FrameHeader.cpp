@@ -0,0 +1,307 @@
+#include "FrameHeader.h"
+
+#include "ProtocolError.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+/**
+ * @class FrameHeader
+ * @brief Accumulates the header of a binary message of a client, and extracts its fields with the rules of the protocol version.
+ *
+ * With protocol version 1, the header contains:
+ * - A file name length (4 bytes).
+ * - The file's last modification timestamp (8 bytes, double).
+ * - The file name (variable length).
+ *
+ * With protocol version 2, the header contains:
+ * - The frame type (1 byte, `FRAME_TYPE_FILE`), flags (1 byte, 0) and 2 reserved bytes.
+ * - The file id chosen by the client (4 bytes), sent back in the acknowledgment.
+ * - The file's last modification timestamp (8 bytes, double).
+ * - The file size (8 bytes).
+ * - A file name length (4 bytes).
+ * - The file name (variable length).
+ *
+ * From protocol version 3, a resumable file is sent with the frame type `FRAME_TYPE_FILE_PART`, and the offset
+ * of its first byte (8 bytes) between the file size and the name length. The content is the file from this offset.
+ * From protocol version 4, a range of a striped file is sent with the same header and the frame type `FRAME_TYPE_FILE_RANGE`,
+ * the file id is the transfer id shared by the ranges. The content is the range.
+ *
+ * From protocol version 5, many small files are sent in one message with the frame type `FRAME_TYPE_BATCH`, flags (0),
+ * 2 reserved bytes, the batch id (4 bytes) and the file count (4 bytes). Each file follows with the file id, last modified
+ * timestamp, file size and name length of a version 2 header, its name and its content. Once `start_batch()` is called,
+ * the next headers are read as the headers of the files of the batch, until `reset()`.
+ *
+ * From protocol version 6, the flag `FRAME_FLAG_CHECKSUM` of a file, part, range or batch frame adds the CRC32C of the
+ * content sent in the message (4 bytes) before the name length, in the header of each file for a batch.
+ *
+ * From protocol version 7, the flag `FRAME_FLAG_CONTINUED` of a file, part or range frame tells that its content goes on
+ * in the next binary message of the connection, a `FRAME_TYPE_FILE_CHUNK` frame : frame type, flags, 2 reserved bytes,
+ * the file id (4 bytes) and the CRC32C of the chunk with `FRAME_FLAG_CHECKSUM`, then the next bytes of the content.
+ * A chunk with `FRAME_FLAG_CONTINUED` is followed by an other chunk, the file ends with the first message without it.
+ *
+ * A header can be received in many parts, `read()` takes only the bytes it misses. The buffer keeps its memory between
+ * two messages, up to `MAX_KEPT_HEADER_SIZE`, so most headers are read without allocation.
+ */
+
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE = 12; // sizeof(uint32_t) + sizeof(double)
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE_V2 = 28; // frame type, flags, reserved (2), file id (4), last modified (8), file size (8), name length (4)
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE_OFFSET = 36; // version 2 header with the offset (8) before the name length, for part and range frames
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE_BATCH = 12; // frame type, flags, reserved (2), batch id (4), file count (4)
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE_BATCH_FILE = 24; // file id (4), last modified (8), file size (8), name length (4), before each file of a batch
+constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE_CHUNK = 8; // frame type, flags, reserved (2), file id (4), without name
+constexpr uint8_t FRAME_TYPE_FILE = 1; // protocol version 2 message holding one complete file
+constexpr uint8_t FRAME_TYPE_FILE_PART = 2; // protocol version 3 message holding the end of a resumable file, from an offset
+constexpr uint8_t FRAME_TYPE_FILE_RANGE = 3; // protocol version 4 message holding a range of a striped file, from an offset
+constexpr uint8_t FRAME_TYPE_BATCH = 4; // protocol version 5 message holding many files, each one with its header and name
+constexpr uint8_t FRAME_TYPE_FILE_CHUNK = 5; // protocol version 7 message holding the next bytes of the file continued by the previous message
+constexpr uint8_t FRAME_FLAG_CHECKSUM = 0x01; // protocol version 6 : the CRC32C of the content of the message (4 bytes) is before the name length, in the header of each file of a batch
+constexpr uint8_t FRAME_FLAG_CONTINUED = 0x02; // protocol version 7 : the content of the file, part, range or chunk goes on in the next binary message
+constexpr uint32_t CHECKSUM_SIZE = 4;
+constexpr uint32_t MAX_BATCH_FILE_COUNT = 10'000;
+constexpr uint32_t MAX_FILE_NAME_LENGTH = 4'096;
+constexpr std::size_t MAX_KEPT_HEADER_SIZE = 512; // memory of the header buffer kept between two messages, enough for most file names
+
+FrameHeader::FrameHeader()
+{
+    m_bytes.reserve(DATA_FILE_RECEIVE_HEADER_SIZE);
+}
+
+/**
+ * @brief Accumulates the bytes of the header and of the file name, takes only the missing bytes.
+ *
+ * @param data The bytes received, moved after the bytes taken.
+ * @param size The number of bytes received, decreased by the bytes taken.
+ *
+ * @throws ProtocolError If the file name is bigger than `MAX_FILE_NAME_LENGTH`.
+ */
+void FrameHeader::read(const uint8_t*& data, std::size_t& size)
+{
+    while (size > 0 && !is_complete())
+    {
+        // The fixed size is known once the frame type is received, the name length once the fixed part is received
+        const uint32_t fixed_size = get_fixed_size();
+        std::size_t expected_size = fixed_size;
+        if (m_bytes.size() >= fixed_size)
+        {
+            expected_size += get_name_length();
+        }
+
+        const std::size_t part_size = std::min(expected_size - m_bytes.size(), size);
+        m_bytes.insert(m_bytes.end(), data, data + part_size);
+        data += part_size;
+        size -= part_size;
+
+        if (m_bytes.size() == get_fixed_size())
+        {
+            const uint32_t name_length = get_name_length();
+            if (name_length > MAX_FILE_NAME_LENGTH)
+            {
+                throw ProtocolError("File name too long to be parse into file : " + std::to_string(name_length));
+            }
+            m_bytes.reserve(m_bytes.size() + name_length);
+        }
+    }
+}
+
+/**
+ * @brief Checks if the header and the file name are fully received.
+ */
+bool FrameHeader::is_complete() const
+{
+    const uint32_t fixed_size = get_fixed_size();
+    return m_bytes.size() >= fixed_size && m_bytes.size() == fixed_size + get_name_length();
+}
+
+/**
+ * @brief Checks if the header being received starts a batch message.
+ */
+bool FrameHeader::is_batch() const
+{
+    return !m_is_in_batch && m_protocol_version >= 5 && !m_bytes.empty() && m_bytes[0] == FRAME_TYPE_BATCH;
+}
+
+/**
+ * @brief Checks if the header being received is the header of a chunk, the next bytes of the file continued.
+ */
+bool FrameHeader::is_chunk() const
+{
+    return !m_is_in_batch && m_protocol_version >= 7 && !m_bytes.empty() && m_bytes[0] == FRAME_TYPE_FILE_CHUNK;
+}
+
+/**
+ * @brief Extracts the batch id and the file count of a complete batch header, the next headers are the headers of its files.
+ *
+ * @throws ProtocolError If the batch holds more than `MAX_BATCH_FILE_COUNT` files.
+ */
+BatchHeader FrameHeader::start_batch()
+{
+    BatchHeader header;
+    header.batch_id = get<uint32_t>(4);
+    header.file_count = get<uint32_t>(8);
+    if (header.file_count > MAX_BATCH_FILE_COUNT)
+    {
+        throw ProtocolError("Batch of too many files : " + std::to_string(header.file_count));
+    }
+
+    m_batch_has_checksums = has_checksum_flag(); // flag of the batch header, the headers of its files have no flags
+    m_is_in_batch = true;
+    m_bytes.clear();
+    return header;
+}
+
+/**
+ * @brief Extracts the metadata of a file from a complete header, of a file, part or range message or of a file of a batch.
+ *
+ * @throws ProtocolError If the frame type is unknown in the protocol version.
+ */
+FileHeader FrameHeader::file() const
+{
+    FileHeader header;
+    if (m_is_in_batch)
+    {
+        header.file_id = get<uint32_t>(0);
+        header.last_modified = get<double>(4);
+        header.size = get<uint64_t>(12);
+        if (m_batch_has_checksums)
+        {
+            header.has_checksum = true;
+            header.checksum = get<uint32_t>(20);
+        }
+    }
+    else if (m_protocol_version >= 2)
+    {
+        const uint8_t frame_type = m_bytes[0];
+        if (frame_type != FRAME_TYPE_FILE && (frame_type != FRAME_TYPE_FILE_PART || m_protocol_version < 3)
+            && (frame_type != FRAME_TYPE_FILE_RANGE || m_protocol_version < 4))
+        {
+            throw ProtocolError("Unknown frame type : " + std::to_string(frame_type));
+        }
+        header.is_part = frame_type == FRAME_TYPE_FILE_PART;
+        header.is_range = frame_type == FRAME_TYPE_FILE_RANGE;
+        header.is_continued = has_continued_flag();
+
+        header.file_id = get<uint32_t>(4);
+        header.last_modified = get<double>(8);
+        header.size = get<uint64_t>(16);
+        std::size_t offset = 24;
+        if (header.is_part || header.is_range)
+        {
+            header.offset = get<uint64_t>(offset);
+            offset += 8; // sizeof(uint64_t)
+        }
+        if (has_checksum_flag())
+        {
+            header.has_checksum = true;
+            header.checksum = get<uint32_t>(offset);
+        }
+    }
+    else
+    {
+        header.last_modified = get<double>(4); // after the name length
+    }
+
+    header.file_name = std::string_view(reinterpret_cast<const char*>(m_bytes.data()) + get_fixed_size(), get_name_length());
+    return header;
+}
+
+/**
+ * @brief Extracts the file id, the flags and the checksum of a complete chunk header.
+ */
+ChunkHeader FrameHeader::chunk() const
+{
+    ChunkHeader header;
+    header.file_id = get<uint32_t>(4);
+    header.is_continued = has_continued_flag();
+    header.has_checksum = has_checksum_flag();
+    if (header.has_checksum)
+    {
+        header.checksum = get<uint32_t>(8);
+    }
+    return header;
+}
+
+/**
+ * @brief Prepares the header for the next message, the next header is not the header of a file of a batch.
+ */
+void FrameHeader::reset()
+{
+    m_bytes.clear();
+    if (m_bytes.capacity() > MAX_KEPT_HEADER_SIZE)
+    {
+        m_bytes.shrink_to_fit(); // a long file name must not stay in memory
+    }
+    m_bytes.reserve(DATA_FILE_RECEIVE_HEADER_SIZE);
+    m_is_in_batch = false;
+    m_batch_has_checksums = false;
+}
+
+/**
+ * @brief Returns the size of the fixed part of the header, it depends on the protocol version and the frame type.
+ *
+ * Before the frame type is received, the size of the shortest header of the protocol version is given. Inside a batch,
+ * the header of each file has no frame type. The checksum of a file is counted once the flags are received.
+ */
+uint32_t FrameHeader::get_fixed_size() const
+{
+    if (m_protocol_version < 2)
+    {
+        return DATA_FILE_RECEIVE_HEADER_SIZE;
+    }
+    if (m_is_in_batch)
+    {
+        return DATA_FILE_RECEIVE_HEADER_SIZE_BATCH_FILE + (m_batch_has_checksums ? CHECKSUM_SIZE : 0);
+    }
+    if (is_chunk() || (m_bytes.empty() && m_protocol_version >= 7))
+    {
+        return DATA_FILE_RECEIVE_HEADER_SIZE_CHUNK + (has_checksum_flag() ? CHECKSUM_SIZE : 0);
+    }
+    if (is_batch() || (m_bytes.empty() && m_protocol_version >= 5))
+    {
+        return DATA_FILE_RECEIVE_HEADER_SIZE_BATCH;
+    }
+    const uint32_t fixed_size = !m_bytes.empty() && (m_bytes[0] == FRAME_TYPE_FILE_PART || m_bytes[0] == FRAME_TYPE_FILE_RANGE) ? DATA_FILE_RECEIVE_HEADER_SIZE_OFFSET : DATA_FILE_RECEIVE_HEADER_SIZE_V2;
+    return fixed_size + (has_checksum_flag() ? CHECKSUM_SIZE : 0);
+}
+
+/**
+ * @brief Extracts the file name size value (4 octets) of a header with its fixed part fully received.
+ */
+uint32_t FrameHeader::get_name_length() const
+{
+    if (is_chunk() || is_batch())
+    {
+        return 0; // the name of a chunk was sent with the start of the file, a batch header has no name
+    }
+
+    // The name length is the first value of a version 1 header, the last value of a version 2 header
+    return get<uint32_t>(m_protocol_version >= 2 ? get_fixed_size() - 4 : 0);
+}
+
+/**
+ * @brief Checks if the flags of the header being received announce a checksum, the flags follow the frame type.
+ */
+bool FrameHeader::has_checksum_flag() const
+{
+    return !m_is_in_batch && m_protocol_version >= 6 && m_bytes.size() >= 2 && (m_bytes[1] & FRAME_FLAG_CHECKSUM) != 0;
+}
+
+/**
+ * @brief Checks if the flags of the header being received tell that the content goes on in the next message.
+ */
+bool FrameHeader::has_continued_flag() const
+{
+    return !m_is_in_batch && m_protocol_version >= 7 && m_bytes.size() >= 2 && (m_bytes[1] & FRAME_FLAG_CONTINUED) != 0;
+}
+
+/**
+ * @brief Reads a little-endian value of the header, at any alignment.
+ */
+template <class T>
+T FrameHeader::get(std::size_t offset) const
+{
+    T value;
+    std::memcpy(&value, m_bytes.data() + offset, sizeof(T));
+    return value;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct FileHeader
+{
+	bool is_part = false; // resumable file, sent from an offset
+	bool is_range = false; // range of a striped file, from an offset
+	bool is_continued = false; // the content goes on in the next binary message
+	uint32_t file_id = 0; // 0 with protocol version 1
+	double last_modified = 0.0;
+	uint64_t size = 0; // 0 with protocol version 1
+	uint64_t offset = 0; // first byte of the content in the file, for a part or a range
+	bool has_checksum = false;
+	uint32_t checksum = 0;
+	std::string_view file_name; // in the bytes of the header, valid until it is cleared
+};
+
+struct ChunkHeader
+{
+	uint32_t file_id = 0;
+	bool is_continued = false;
+	bool has_checksum = false;
+	uint32_t checksum = 0;
+};
+
+struct BatchHeader
+{
+	uint32_t batch_id = 0;
+	uint32_t file_count = 0;
+};
+
+class FrameHeader
+{
+public:
+	FrameHeader();
+
+	void set_protocol_version(uint32_t protocol_version) { m_protocol_version = protocol_version; }
+
+	void read(const uint8_t*& data, std::size_t& size);
+	bool empty() const { return m_bytes.empty(); }
+	bool is_complete() const;
+	bool is_batch() const;
+	bool is_chunk() const;
+
+	BatchHeader start_batch();
+	FileHeader file() const;
+	ChunkHeader chunk() const;
+
+	void clear() { m_bytes.clear(); }
+	void reset();
+
+private:
+	uint32_t get_fixed_size() const;
+	uint32_t get_name_length() const;
+	bool has_checksum_flag() const;
+	bool has_continued_flag() const;
+
+	template <class T>
+	T get(std::size_t offset) const;
+
+	std::vector<uint8_t> m_bytes;
+	uint32_t m_protocol_version = 1;
+	bool m_is_in_batch = false; // the next headers are the headers of the files of a batch, without frame type
+	bool m_batch_has_checksums = false;
+};
@@ -0,0 +1,175 @@
+#include "GroupCommit.h"
+#include "WindowsFileDiag.h"
+
+#include <filesystem>
+#include <map>
+
+/**
+ * @class GroupCommit
+ * @brief Flushes the saved files on disk by groups, before they are acknowledged (`Durability::group`).
+ *
+ * A file closed by the write engine is still in the cache of the system, a power loss after its ACK would lose it.
+ * Flushing each file when it's closed makes the disk wait for each one, so the sessions give their closed files to the
+ * group commit instead : its thread waits a short delay, or until enough bytes are pending, then flushes all the
+ * files of the group at once and calls their handlers, which release the ACKs. On Linux the write back of all the
+ * files of the group is started before waiting for the first one, so the disk writes them together. Each directory
+ * of the group is flushed once, after its files, so the names of the new files are on disk too.
+ *
+ * A file is flushed through a new descriptor opened on its path, the write engine has closed its own.
+ */
+
+/**
+ * @brief Starts the commit thread.
+ *
+ * @param metrics The server metrics, the groups flushed and their time are counted in them.
+ * @param max_delay Time a file waits for other files before its group is flushed.
+ * @param max_bytes Bytes pending above which the group is flushed without waiting the end of the delay.
+ */
+GroupCommit::GroupCommit(ServerMetrics& metrics, std::chrono::milliseconds max_delay, uint64_t max_bytes)
+    : m_metrics(metrics)
+    , m_max_delay(max_delay)
+    , m_max_bytes(max_bytes)
+    , m_thread(&GroupCommit::run, this)
+{
+}
+
+/**
+ * @brief Flushes the pending files, then stops the commit thread.
+ */
+GroupCommit::~GroupCommit()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopping = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+/**
+ * @brief Adds a closed file to the next group flushed on disk.
+ *
+ * @param file_path The path of the file, renamed into place if it was a part file.
+ * @param size The size of the file, counted in the bytes pending.
+ * @param handler Called by the commit thread once the file and its directory are on disk, or with the flush error.
+ */
+void GroupCommit::commit(const std::string& file_path, uint64_t size, Handler handler)
+{
+    bool is_group_ready = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending_files.empty())
+        {
+            m_group_start = std::chrono::steady_clock::now();
+            is_group_ready = true; // the thread waits for a first file
+        }
+        m_pending_files.push_back(PendingFile{ file_path, std::move(handler) });
+        m_pending_bytes += size;
+        is_group_ready = is_group_ready || m_pending_bytes >= m_max_bytes;
+    }
+
+    if (is_group_ready)
+    {
+        m_condition.notify_one();
+    }
+}
+
+/**
+ * @brief Loop of the commit thread : waits for a first file, lets the group fill for the delay, and flushes it.
+ */
+void GroupCommit::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_condition.wait(lock, [this]() { return m_is_stopping || !m_pending_files.empty(); });
+        if (m_pending_files.empty())
+        {
+            return;
+        }
+
+        m_condition.wait_until(lock, m_group_start + m_max_delay, [this]() { return m_is_stopping || m_pending_bytes >= m_max_bytes; });
+
+        std::vector<PendingFile> files;
+        files.swap(m_pending_files);
+        m_pending_bytes = 0;
+
+        lock.unlock();
+        flush_group(files);
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Flushes the files of a group and their directories on disk, then calls their handlers.
+ *
+ * A file that can't be opened or flushed gets its own error, the other files of the group are still acknowledged.
+ *
+ * @param files The files of the group.
+ */
+void GroupCommit::flush_group(std::vector<PendingFile>& files)
+{
+    const std::chrono::steady_clock::time_point flush_start = std::chrono::steady_clock::now();
+
+    std::vector<std::exception_ptr> errors(files.size());
+    std::vector<WindowsFileDiag::FileHandle> handles(files.size());
+    std::map<std::string, std::vector<std::size_t>> directories; // files of the group by directory
+
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        try
+        {
+            handles[i] = WindowsFileDiag::open_file_for_flush(files[i].path);
+            WindowsFileDiag::start_flush_file(handles[i]);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        if (errors[i])
+        {
+            continue;
+        }
+
+        try
+        {
+            WindowsFileDiag::flush_file(handles[i]);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+        WindowsFileDiag::close_file(handles[i]);
+        directories[std::filesystem::path(files[i].path).parent_path().string()].push_back(i);
+    }
+
+    for (const auto& [directory_path, file_indexes] : directories)
+    {
+        try
+        {
+            WindowsFileDiag::flush_directory(directory_path);
+        }
+        catch (...)
+        {
+            for (const std::size_t i : file_indexes)
+            {
+                if (!errors[i])
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        }
+    }
+
+    ServerMetrics::add(m_metrics.group_commits, 1);
+    m_metrics.group_commit_time.observe(std::chrono::steady_clock::now() - flush_start);
+
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        files[i].handler(errors[i]);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "ServerMetrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class GroupCommit
+{
+public:
+	using Handler = std::function<void(std::exception_ptr error)>; // called by the commit thread, error is null once the file is on disk
+
+	GroupCommit(ServerMetrics& metrics, std::chrono::milliseconds max_delay, uint64_t max_bytes);
+	~GroupCommit();
+
+	void commit(const std::string& file_path, uint64_t size, Handler handler);
+
+private:
+	struct PendingFile
+	{
+		std::string path;
+		Handler handler;
+	};
+
+	void run();
+	void flush_group(std::vector<PendingFile>& files);
+
+	ServerMetrics& m_metrics;
+	const std::chrono::milliseconds m_max_delay;
+	const uint64_t m_max_bytes;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::vector<PendingFile> m_pending_files;
+	uint64_t m_pending_bytes = 0;
+	std::chrono::steady_clock::time_point m_group_start; // commit of the first pending file
+	bool m_is_stopping = false;
+	std::thread m_thread;
+};
@@ -0,0 +1,42 @@
+#include "HandlerMemory.h"
+
+#include <new>
+
+/**
+ * @class HandlerMemory
+ * @brief Memory of the asynchronous operation of a session that runs one at a time, like its WebSocket read.
+ *
+ * Asio allocates each operation with the allocator of its handler, a handler given by `bind_handler_memory()`
+ * gets the storage of the session instead of the heap. An operation of the same kind starts once the previous one
+ * is done and its memory given back, so the storage is always free for the next one : the reads and the writes of
+ * a session don't allocate. An operation bigger than the storage, or started while the storage is in use, like a
+ * control frame answered by the WebSocket stream during a read, gets heap memory.
+ *
+ * A memory is used by the strand of its session only.
+ */
+
+/**
+ * @brief Gives memory for an operation, the storage if it's free and big enough, else heap memory.
+ */
+void* HandlerMemory::allocate(std::size_t size)
+{
+    if (!m_is_in_use && size <= sizeof(m_storage))
+    {
+        m_is_in_use = true;
+        return &m_storage;
+    }
+    return ::operator new(size);
+}
+
+/**
+ * @brief Takes back the memory of an operation.
+ */
+void HandlerMemory::deallocate(void* pointer)
+{
+    if (pointer == &m_storage)
+    {
+        m_is_in_use = false;
+        return;
+    }
+    ::operator delete(pointer);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+class HandlerMemory
+{
+public:
+	HandlerMemory() = default;
+	HandlerMemory(const HandlerMemory&) = delete;
+	HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+	void* allocate(std::size_t size);
+	void deallocate(void* pointer);
+
+private:
+	static constexpr std::size_t STORAGE_SIZE = 1'024;
+
+	std::aligned_storage_t<STORAGE_SIZE> m_storage;
+	bool m_is_in_use = false;
+};
+
+template <class T>
+class HandlerAllocator
+{
+public:
+	using value_type = T;
+
+	explicit HandlerAllocator(HandlerMemory& memory) : m_memory(&memory) {}
+	template <class U>
+	HandlerAllocator(const HandlerAllocator<U>& other) noexcept : m_memory(other.m_memory) {}
+
+	T* allocate(std::size_t count) const { return static_cast<T*>(m_memory->allocate(sizeof(T) * count)); }
+	void deallocate(T* pointer, std::size_t) const { m_memory->deallocate(pointer); }
+
+	bool operator==(const HandlerAllocator& other) const noexcept { return m_memory == other.m_memory; }
+	bool operator!=(const HandlerAllocator& other) const noexcept { return m_memory != other.m_memory; }
+
+private:
+	template <class U>
+	friend class HandlerAllocator;
+
+	HandlerMemory* m_memory;
+};
+
+template <class Handler>
+class HandlerWithMemory
+{
+public:
+	using allocator_type = HandlerAllocator<Handler>;
+
+	HandlerWithMemory(HandlerMemory& memory, Handler handler) : m_memory(memory), m_handler(std::move(handler)) {}
+
+	allocator_type get_allocator() const noexcept { return allocator_type(m_memory); }
+
+	template <class... Args>
+	void operator()(Args&&... args) { m_handler(std::forward<Args>(args)...); }
+
+private:
+	HandlerMemory& m_memory;
+	Handler m_handler;
+};
+
+template <class Handler>
+HandlerWithMemory<std::decay_t<Handler>> bind_handler_memory(HandlerMemory& memory, Handler&& handler)
+{
+	return HandlerWithMemory<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+}
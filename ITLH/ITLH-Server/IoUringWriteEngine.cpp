@@ -0,0 +1,1296 @@
+#include "IoUringWriteEngine.h"
+#include "WindowsFileDiag.h"
+
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <ios>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @class IoUringWriteEngine
+ * @brief File write engine submitting the disk operations to the Linux io_uring interface.
+ *
+ * Open, allocation, write and close of the received files are submitted as asynchronous operations
+ * to a ring shared with the kernel, so no thread waits in a disk call : the network threads and the
+ * completion thread only fill the ring and read its results. Entries queued by many threads at the
+ * same time are submitted to the kernel by a single system call. A single completion thread reads
+ * the results and calls the handlers, which post them back to the sessions.
+ *
+ * A file is created with `O_EXCL` : the file name index doesn't check the disk for the chosen name,
+ * a file created in the directory by another program after the scan makes the open fail, and the
+ * next free name is tried.
+ *
+ * With `flush_files`, the flush of a file and of its directory are io_uring operations too, submitted around the
+ * close. The descriptor of each directory flushed is opened once and kept.
+ *
+ * The calls with no io_uring operation on the kernels supported : the date of a file, the rename of a part file and
+ * the first open of a directory, run on a few helper threads, so the completion thread never waits for the disk.
+ *
+ * When the completion thread fills the submission queue, the entries it can't queue are kept in an overflow list and
+ * queued before its next wait, it never waits for room. If the kernel refuses the ring (an error other than a busy or
+ * interrupted call), the engine stops : the operations queued and in flight, and all the following ones, fail with
+ * the error, which reaches the sessions through their handlers, like an error of the disk.
+ *
+ * The ring is used through the raw system calls, `try_create()` returns null when the kernel doesn't
+ * support io_uring or the needed operations (Linux 5.6 or newer), the `SaveWorkerPool` is used instead.
+ */
+
+namespace
+{
+    constexpr unsigned int MIN_RING_ENTRIES = 64;
+    constexpr unsigned int MAX_RING_ENTRIES = 4'096;
+    constexpr unsigned int COMPLETION_RING_FACTOR = 4; // completion ring bigger than the submission ring, operations stay long in flight
+    constexpr uint32_t MAX_WRITE_SIZE = 1u << 30; // 1 GO, size of a write operation is 32 bits
+    constexpr uint64_t STOP_USER_DATA = 0; // user data of the operation that stops the completion thread
+    constexpr uint64_t WAKE_USER_DATA = 1; // user data of the operation that wakes the completion thread to check if it can stop
+    constexpr unsigned int BLOCKING_THREAD_COUNT = 2;
+
+    int io_uring_setup(unsigned int entries, io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int io_uring_register(int ring_fd, unsigned int opcode, void* arg, unsigned int arg_count)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, arg_count));
+    }
+
+    unsigned int load_acquire(const unsigned int* value)
+    {
+        return std::atomic_ref<const unsigned int>(*value).load(std::memory_order_acquire);
+    }
+
+    void store_release(unsigned int* value, unsigned int new_value)
+    {
+        std::atomic_ref<unsigned int>(*value).store(new_value, std::memory_order_release);
+    }
+
+    std::exception_ptr make_error(const std::string& message, int error)
+    {
+        return std::make_exception_ptr(std::ios_base::failure(message + ", " + std::strerror(error)));
+    }
+}
+
+/**
+ * @struct IoUringWriteEngine::Operation
+ * @brief Completion of an operation given to the ring, its address is the user data of the entry.
+ *
+ * The operations are linked while queued or in flight, so they can be failed if the ring stops.
+ */
+struct IoUringWriteEngine::Operation
+{
+    Completion completion;
+    Operation* previous = nullptr;
+    Operation* next = nullptr;
+};
+
+/**
+ * @struct IoUringWriteEngine::RingFile
+ * @brief State of a file written by the ring, shared by the calling thread and the completion thread.
+ *
+ * Writes asked before the end of the open are kept and submitted once the file descriptor is known.
+ * The close waits until no operation of the file is in flight.
+ */
+struct IoUringWriteEngine::RingFile : File
+{
+    struct WaitingWrite
+    {
+        uint64_t offset;
+        const uint8_t* data;
+        size_t size;
+        Handler handler;
+    };
+
+    std::mutex mutex;
+    std::string file_name;
+    bool is_part = false; // part file of a resumable upload, renamed to a free name made from file_name on close
+    uint64_t file_size = 0;
+    int fd = -1;
+    unsigned int pending_operations = 0; // open (with allocation) and writes not done
+    std::vector<WaitingWrite> waiting_writes;
+    std::function<void()> on_idle; // close or discard, waiting the end of the pending operations
+    std::exception_ptr error; // first error of the file, given to the handlers of the following operations, set with the mutex locked
+};
+
+/**
+ * @brief Creates the engine if the kernel supports io_uring and all the operations used.
+ *
+ * @param file_name_index The index giving a unique name in the save directory to each file.
+ * @param max_queue_depth Number of operations in flight above which `is_full()` returns true.
+ * @param flush_files true to flush each file on disk when it's closed.
+ *
+ * @return The engine, or null if io_uring can't be used.
+ */
+std::unique_ptr<IoUringWriteEngine> IoUringWriteEngine::try_create(FileNameIndex& file_name_index, std::size_t max_queue_depth, bool flush_files)
+{
+    unsigned int entries = MIN_RING_ENTRIES;
+    while (entries < max_queue_depth && entries < MAX_RING_ENTRIES)
+    {
+        entries *= 2;
+    }
+
+    std::unique_ptr<IoUringWriteEngine> engine(new IoUringWriteEngine(file_name_index, max_queue_depth, flush_files));
+    if (!engine->setup(entries))
+    {
+        return nullptr;
+    }
+
+    engine->m_completion_thread = std::thread(&IoUringWriteEngine::run_completions, engine.get());
+    return engine;
+}
+
+IoUringWriteEngine::IoUringWriteEngine(FileNameIndex& file_name_index, std::size_t max_queue_depth, bool flush_files)
+    : FileWriteEngine(max_queue_depth, flush_files)
+    , m_file_name_index(file_name_index)
+    , m_blocking_threads(BLOCKING_THREAD_COUNT)
+{
+}
+
+/**
+ * @brief Waits for all the operations in flight to be done, then stops the completion thread and frees the ring.
+ */
+IoUringWriteEngine::~IoUringWriteEngine()
+{
+    if (m_completion_thread.joinable())
+    {
+        m_is_stopping = true;
+        io_uring_sqe sqe = {};
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = STOP_USER_DATA;
+        push_entry(sqe);
+        flush();
+        m_completion_thread.join();
+    }
+    m_blocking_threads.join();
+
+    if (m_sqes)
+    {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring && m_cq_ring != m_sq_ring)
+    {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring)
+    {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if (m_ring_fd >= 0)
+    {
+        ::close(m_ring_fd);
+    }
+    for (const auto& [directory_path, directory_fd] : m_directory_fds)
+    {
+        ::close(directory_fd);
+    }
+}
+
+/**
+ * @brief Creates the ring, maps its queues and checks that the kernel supports the operations used.
+ *
+ * @param entries Size of the submission queue, a power of 2.
+ *
+ * @return false if io_uring can't be used.
+ */
+bool IoUringWriteEngine::setup(unsigned int entries)
+{
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * COMPLETION_RING_FACTOR;
+
+    m_ring_fd = io_uring_setup(entries, &params);
+    if (m_ring_fd < 0)
+    {
+        return false; // ENOSYS : kernel without io_uring, EPERM : io_uring disabled
+    }
+
+    // Without NODROP a full completion queue loses results, without SINGLE_MMAP the kernel is too old anyway
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> probe_buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        return false;
+    }
+    for (const uint8_t opcode : { IORING_OP_NOP, IORING_OP_OPENAT, IORING_OP_FALLOCATE, IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_FSYNC })
+    {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+
+    // Submission and completion queues share one mapping (IORING_FEAT_SINGLE_MMAP)
+    m_sq_ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED)
+    {
+        m_sq_ring = nullptr;
+        return false;
+    }
+    m_cq_ring = m_sq_ring;
+    m_cq_ring_size = m_sq_ring_size;
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    uint8_t* sq_ring = static_cast<uint8_t*>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.tail);
+    m_sq_array = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.array);
+    m_sq_mask = *reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+
+    uint8_t* cq_ring = static_cast<uint8_t*>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+    return true;
+}
+
+/**
+ * @brief Queues an operation in the submission queue and submits the queued entries to the kernel.
+ *
+ * Once the ring is stopped, the completion is called at once with the error that stopped it.
+ *
+ * @param sqe The operation, its user data is set here.
+ * @param completion Called by the completion thread with the result of the operation.
+ */
+void IoUringWriteEngine::submit(io_uring_sqe sqe, Completion completion)
+{
+    on_operation_queued();
+
+    Operation* operation = new Operation{ std::move(completion) };
+    sqe.user_data = reinterpret_cast<uint64_t>(operation);
+    if (!push_entry(sqe))
+    {
+        complete_operation(operation, -m_failure.load());
+        return;
+    }
+    flush();
+}
+
+/**
+ * @brief Copies an entry in the submission queue, waiting for a free place if the queue is full.
+ *
+ * The completion thread doesn't wait : while the queue is full, its entries are kept in the overflow list, and
+ * queued before its next wait for results. Once the ring is stopped, only the entries waking the completion thread
+ * are queued.
+ *
+ * @return false if the ring is stopped, the entry is not queued.
+ */
+bool IoUringWriteEngine::push_entry(const io_uring_sqe& sqe)
+{
+    const bool is_operation = sqe.user_data != STOP_USER_DATA && sqe.user_data != WAKE_USER_DATA;
+    const bool is_completion_thread = std::this_thread::get_id() == m_completion_thread.get_id();
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sq_mutex);
+            if (is_operation && m_failure.load() != 0)
+            {
+                return false;
+            }
+
+            const unsigned int tail = *m_sq_tail;
+            if (tail - load_acquire(m_sq_head) < m_sq_entries && (!is_completion_thread || m_overflow_entries.empty()))
+            {
+                if (is_operation)
+                {
+                    link_operation(reinterpret_cast<Operation*>(sqe.user_data));
+                }
+                const unsigned int index = tail & m_sq_mask;
+                m_sqes[index] = sqe;
+                m_sq_array[index] = index;
+                store_release(m_sq_tail, tail + 1);
+                return true;
+            }
+
+            if (is_completion_thread)
+            {
+                if (is_operation)
+                {
+                    link_operation(reinterpret_cast<Operation*>(sqe.user_data));
+                }
+                m_overflow_entries.push_back(sqe);
+                return true;
+            }
+        }
+
+        // Queue full, its entries are submitted then the kernel frees their places
+        flush();
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Submits all the entries of the submission queue to the kernel in one system call.
+ *
+ * If another thread is already submitting, the entries queued by the caller are submitted by this thread : the
+ * caller leaves the submit pending flag, which the submitting thread checks again once it released the lock, as it
+ * could have seen the queue empty before the entries were queued. When the kernel is busy, the completion thread
+ * returns at once, it submits the entries again after reading the results. If the kernel refuses the submission,
+ * the ring is stopped and the queued operations fail.
+ */
+void IoUringWriteEngine::flush()
+{
+    const bool is_completion_thread = std::this_thread::get_id() == m_completion_thread.get_id();
+    m_is_submit_pending.store(true);
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(m_submit_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            return;
+        }
+
+        m_is_submit_pending.exchange(false); // reads the flag set after queuing, so the entries queued are seen
+        const unsigned int to_submit = load_acquire(m_sq_tail) - load_acquire(m_sq_head);
+        if (to_submit == 0)
+        {
+            lock.unlock();
+            if (m_is_submit_pending.load())
+            {
+                continue; // entries queued by a thread which didn't get the lock
+            }
+            return;
+        }
+
+        if (io_uring_enter(m_ring_fd, to_submit, 0, 0) < 0)
+        {
+            const int error = errno;
+            if (error != EINTR && error != EAGAIN && error != EBUSY)
+            {
+                if (fail_queued_entries(error, lock))
+                {
+                    continue; // submits the entry waking the completion thread
+                }
+                return;
+            }
+
+            // EBUSY : completion queue overflow, the completion thread submits the entries once it read the results
+            if (is_completion_thread)
+            {
+                return;
+            }
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @brief Body of the completion thread : waits for the results of the operations and calls their completions.
+ *
+ * The thread also submits the entries left in the submission queue, and the overflow entries. It stops once asked by
+ * the destructor, or once the ring is stopped, and all the operations in flight are done. If the kernel refuses to
+ * wait for the results, the ring is stopped and the operations in flight fail.
+ */
+void IoUringWriteEngine::run_completions()
+{
+    bool stop_asked = false;
+    std::vector<std::pair<Operation*, int>> results;
+
+    while ((!stop_asked && m_failure.load() == 0) || queue_depth() > 0)
+    {
+        push_overflow_entries();
+        flush();
+
+        if (io_uring_enter(m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+        {
+            const int error = errno;
+            if (error != EINTR && error != EAGAIN && error != EBUSY)
+            {
+                fail_all_operations(error);
+                return;
+            }
+        }
+
+        // Results are copied first, so the completion queue has room for the operations submitted by the completions
+        unsigned int head = *m_cq_head;
+        const unsigned int tail = load_acquire(m_cq_tail);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+            if (cqe.user_data == STOP_USER_DATA)
+            {
+                stop_asked = true;
+                continue;
+            }
+            if (cqe.user_data == WAKE_USER_DATA)
+            {
+                continue;
+            }
+            results.emplace_back(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+        }
+        store_release(m_cq_head, head);
+
+        for (const auto& [operation, result] : results)
+        {
+            unlink_operation(operation);
+            complete_operation(operation, result);
+        }
+        results.clear();
+    }
+}
+
+/**
+ * @brief Moves the overflow entries of the completion thread to the submission queue, as many as it has room for.
+ */
+void IoUringWriteEngine::push_overflow_entries()
+{
+    std::lock_guard<std::mutex> lock(m_sq_mutex);
+
+    std::size_t pushed_count = 0;
+    for (; pushed_count < m_overflow_entries.size(); pushed_count++)
+    {
+        const unsigned int tail = *m_sq_tail;
+        if (tail - load_acquire(m_sq_head) == m_sq_entries)
+        {
+            break;
+        }
+        const unsigned int index = tail & m_sq_mask;
+        m_sqes[index] = m_overflow_entries[pushed_count];
+        m_sq_array[index] = index;
+        store_release(m_sq_tail, tail + 1);
+    }
+    m_overflow_entries.erase(m_overflow_entries.begin(), m_overflow_entries.begin() + pushed_count);
+}
+
+/**
+ * @brief Stops the ring after a refused submission : the entries not read by the kernel are taken back and their
+ * operations fail, the following operations fail at once.
+ *
+ * At the first failure, an entry waking the completion thread is queued in place of the entries taken back, so it
+ * stops once the operations in flight are done.
+ *
+ * @param error The errno value of the refused submission.
+ * @param submit_lock The lock of `m_submit_mutex`, unlocked before the completions are called.
+ *
+ * @return true at the first failure of the ring.
+ */
+bool IoUringWriteEngine::fail_queued_entries(int error, std::unique_lock<std::mutex>& submit_lock)
+{
+    bool is_first_failure = false;
+    std::vector<Operation*> failed_operations;
+    {
+        std::lock_guard<std::mutex> lock(m_sq_mutex);
+        is_first_failure = m_failure.load() == 0;
+        if (is_first_failure)
+        {
+            m_failure = error;
+        }
+
+        unsigned int position = load_acquire(m_sq_head);
+        for (; position != *m_sq_tail; position++)
+        {
+            const uint64_t user_data = m_sqes[m_sq_array[position & m_sq_mask]].user_data;
+            if (user_data != STOP_USER_DATA && user_data != WAKE_USER_DATA)
+            {
+                failed_operations.push_back(reinterpret_cast<Operation*>(user_data));
+            }
+        }
+        for (const io_uring_sqe& sqe : m_overflow_entries)
+        {
+            if (sqe.user_data != STOP_USER_DATA && sqe.user_data != WAKE_USER_DATA)
+            {
+                failed_operations.push_back(reinterpret_cast<Operation*>(sqe.user_data));
+            }
+        }
+        m_overflow_entries.clear();
+
+        position = load_acquire(m_sq_head);
+        if (is_first_failure)
+        {
+            const unsigned int index = position & m_sq_mask;
+            m_sqes[index] = {};
+            m_sqes[index].opcode = IORING_OP_NOP;
+            m_sqes[index].user_data = WAKE_USER_DATA;
+            m_sq_array[index] = index;
+            position++;
+        }
+        store_release(m_sq_tail, position);
+
+        for (Operation* operation : failed_operations)
+        {
+            unlink_operation(operation);
+        }
+    }
+
+    if (!is_first_failure)
+    {
+        return false;
+    }
+
+    submit_lock.unlock();
+    std::cerr << "io_uring submit fail, " << std::strerror(error) << ", the file operations fail" << std::endl;
+    for (Operation* operation : failed_operations)
+    {
+        complete_operation(operation, -error);
+    }
+    submit_lock.lock();
+    return true;
+}
+
+/**
+ * @brief Stops the ring after the completion thread failed to wait for the results : all the operations queued or in
+ * flight fail, their results will never be read.
+ *
+ * @param error The errno value of the failed wait.
+ */
+void IoUringWriteEngine::fail_all_operations(int error)
+{
+    {
+        std::lock_guard<std::mutex> submit_lock(m_submit_mutex);
+        std::lock_guard<std::mutex> lock(m_sq_mutex);
+        m_failure = error;
+        store_release(m_sq_tail, load_acquire(m_sq_head));
+        m_overflow_entries.clear();
+    }
+    std::cerr << "io_uring wait fail, " << std::strerror(error) << ", the file operations fail" << std::endl;
+
+    for (;;)
+    {
+        Operation* operation = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_operations_mutex);
+            operation = m_operations;
+            if (!operation)
+            {
+                return;
+            }
+            m_operations = operation->next;
+            if (m_operations)
+            {
+                m_operations->previous = nullptr;
+            }
+        }
+        complete_operation(operation, -error); // its completion can queue an other operation, which fails at once
+    }
+}
+
+/**
+ * @brief Adds an operation to the list of the operations queued or in flight, before its entry is queued.
+ */
+void IoUringWriteEngine::link_operation(Operation* operation)
+{
+    std::lock_guard<std::mutex> lock(m_operations_mutex);
+
+    operation->next = m_operations;
+    if (m_operations)
+    {
+        m_operations->previous = operation;
+    }
+    m_operations = operation;
+}
+
+/**
+ * @brief Removes an operation from the list of the operations queued or in flight, before its completion.
+ */
+void IoUringWriteEngine::unlink_operation(Operation* operation)
+{
+    std::lock_guard<std::mutex> lock(m_operations_mutex);
+
+    if (operation->previous)
+    {
+        operation->previous->next = operation->next;
+    }
+    else
+    {
+        m_operations = operation->next;
+    }
+    if (operation->next)
+    {
+        operation->next->previous = operation->previous;
+    }
+}
+
+/**
+ * @brief Calls the completion of an unlinked operation with its result, then frees it.
+ */
+void IoUringWriteEngine::complete_operation(Operation* operation, int result)
+{
+    operation->completion(result);
+    delete operation;
+    end_operation();
+}
+
+/**
+ * @brief Counts the end of an operation. When the engine is destroyed or the ring is stopped, the end of the last
+ * operation outside the completion thread wakes it, so it stops once nothing is queued.
+ */
+void IoUringWriteEngine::end_operation()
+{
+    on_operation_done();
+
+    if ((m_is_stopping || m_failure.load() != 0) && queue_depth() == 0 && std::this_thread::get_id() != m_completion_thread.get_id())
+    {
+        io_uring_sqe sqe = {};
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = WAKE_USER_DATA;
+        push_entry(sqe);
+        flush();
+    }
+}
+
+/**
+ * @brief Runs a blocking call on the helper threads, counted in the queue depth until its end.
+ *
+ * The completion thread doesn't stop while a call runs, its operations are submitted by the call.
+ */
+void IoUringWriteEngine::post_blocking(std::function<void()> job)
+{
+    on_operation_queued();
+
+    boost::asio::post(m_blocking_threads, [this, job = std::move(job)]() {
+        job();
+        end_operation();
+        });
+}
+
+/**
+ * @brief Starts the opening of the destination file of a received file.
+ *
+ * The file name is made unique in the save directory by the file name index, then the file is created.
+ * When the file size is known, the disk space of the whole file is allocated before any write.
+ *
+ * @param file_name The file name sent by the client.
+ * @param file_size The size announced by the client, 0 if unknown.
+ * @param handler Called once the file is opened.
+ *
+ * @return The file, to give to the other operations.
+ */
+std::shared_ptr<FileWriteEngine::File> IoUringWriteEngine::open(const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    std::shared_ptr<RingFile> file = std::make_shared<RingFile>();
+    file->file_name = file_name;
+    file->file_size = file_size;
+    file->pending_operations = 1; // the open, done once the allocation is done
+
+    open_ring_file(file, std::move(handler));
+    return file;
+}
+
+/**
+ * @brief Submits the creation of a file with a free name, again with the next free name if the name is taken on disk.
+ */
+void IoUringWriteEngine::open_ring_file(const std::shared_ptr<RingFile>& file, Handler handler)
+{
+    if (file->name_resolution_start == std::chrono::steady_clock::time_point())
+    {
+        file->name_resolution_start = std::chrono::steady_clock::now();
+    }
+    file->full_path = m_file_name_index.reserve_unique_path(file->file_name, false);
+    file->name_resolution_end = std::chrono::steady_clock::now();
+
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_OPENAT;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<uint64_t>(file->full_path.c_str());
+    sqe.len = 0666; // mode
+    sqe.open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+
+    submit(sqe, [this, file, handler = std::move(handler)](int result) mutable {
+        if (result == -EEXIST)
+        {
+            open_ring_file(file, std::move(handler)); // created by another program after the scan of the directory
+            return;
+        }
+        if (result < 0)
+        {
+            m_file_name_index.release_path(file->full_path); // nothing to remove, discard() skips a file not opened
+            finish_open(file, std::move(handler), make_error("Failed to open file: " + file->full_path + " for writing", -result));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(file->mutex);
+            file->fd = result;
+        }
+        allocate_ring_file(file, std::move(handler));
+        });
+}
+
+/**
+ * @brief Submits the allocation of the disk space of an opened file.
+ */
+void IoUringWriteEngine::allocate_ring_file(const std::shared_ptr<RingFile>& file, Handler handler)
+{
+    if (file->file_size == 0)
+    {
+        finish_open(file, std::move(handler), nullptr);
+        return;
+    }
+
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_FALLOCATE;
+    sqe.fd = file->fd;
+    sqe.off = 0;
+    sqe.addr = file->file_size; // length
+    sqe.len = 0; // mode
+
+    submit(sqe, [this, file, handler = std::move(handler)](int result) mutable {
+        // EINVAL and EOPNOTSUPP : file system without allocation, the file grows with the writes
+        if (result < 0 && result != -EINVAL && result != -EOPNOTSUPP)
+        {
+            finish_open(file, std::move(handler), make_error("Failed to allocate " + std::to_string(file->file_size) + " octets for file: " + file->full_path, -result));
+            return;
+        }
+        finish_open(file, std::move(handler), nullptr);
+        });
+}
+
+/**
+ * @brief Ends the open of a file : submits the writes asked during the open, or fails them with the error of the open.
+ */
+void IoUringWriteEngine::finish_open(const std::shared_ptr<RingFile>& file, Handler handler, std::exception_ptr error)
+{
+    std::vector<RingFile::WaitingWrite> waiting_writes;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (error && !file->error)
+        {
+            file->error = error;
+        }
+        waiting_writes.swap(file->waiting_writes);
+    }
+
+    for (RingFile::WaitingWrite& waiting_write : waiting_writes)
+    {
+        if (error)
+        {
+            waiting_write.handler(error);
+            end_file_operation(file, error);
+        }
+        else
+        {
+            submit_write(file, waiting_write.offset, waiting_write.data, waiting_write.size, std::move(waiting_write.handler));
+        }
+    }
+
+    handler(error);
+    end_file_operation(file, error);
+}
+
+/**
+ * @brief Writes received data at their position in the file.
+ *
+ * The write is submitted at once if the file is opened, else once its open is done.
+ *
+ * @param file The file given by `open()`.
+ * @param offset The position in the file of the first byte.
+ * @param data The data, must stay valid until the handler is called.
+ * @param size The number of bytes to write.
+ * @param handler Called once the data are written.
+ */
+void IoUringWriteEngine::write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler)
+{
+    std::shared_ptr<RingFile> ring_file = std::static_pointer_cast<RingFile>(file);
+
+    std::unique_lock<std::mutex> lock(ring_file->mutex);
+    if (ring_file->error)
+    {
+        std::exception_ptr error = ring_file->error;
+        lock.unlock();
+        handler(error);
+        return;
+    }
+
+    ring_file->pending_operations++;
+    if (ring_file->fd < 0)
+    {
+        ring_file->waiting_writes.push_back({ offset, data, size, std::move(handler) });
+        return;
+    }
+    lock.unlock();
+
+    submit_write(ring_file, offset, data, size, std::move(handler));
+}
+
+/**
+ * @brief Submits a write, and the write of the remaining data if the kernel writes only a part.
+ */
+void IoUringWriteEngine::submit_write(const std::shared_ptr<RingFile>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler)
+{
+    const uint32_t write_size = static_cast<uint32_t>(std::min<size_t>(size, MAX_WRITE_SIZE));
+
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_WRITE;
+    sqe.fd = file->fd;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = write_size;
+    sqe.off = offset;
+
+    submit(sqe, [this, file, offset, data, size, handler = std::move(handler)](int result) mutable {
+        if (result <= 0)
+        {
+            std::exception_ptr error = make_error("Failed to write file: " + file->full_path, result < 0 ? -result : ENOSPC);
+            handler(error);
+            end_file_operation(file, error);
+            return;
+        }
+
+        const size_t written_size = static_cast<size_t>(result);
+        if (written_size < size)
+        {
+            submit_write(file, offset + written_size, data + written_size, size - written_size, std::move(handler));
+            return;
+        }
+
+        handler(nullptr);
+        end_file_operation(file, nullptr);
+        });
+}
+
+/**
+ * @brief Submits the closing of a file descriptor.
+ */
+void IoUringWriteEngine::submit_close(const std::shared_ptr<RingFile>& file, Completion completion)
+{
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_CLOSE;
+    sqe.fd = file->fd;
+
+    submit(sqe, std::move(completion));
+}
+
+/**
+ * @brief Submits the flush on disk of the data and attributes of a file, before its close.
+ */
+void IoUringWriteEngine::submit_flush(const std::shared_ptr<RingFile>& file, Completion completion)
+{
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_FSYNC;
+    sqe.fd = file->fd;
+
+    submit(sqe, std::move(completion));
+}
+
+/**
+ * @brief Submits the flush on disk of the directory of a closed file, so its name is on disk too, then calls the handler.
+ *
+ * @param file The closed file, at its final path.
+ * @param handler Called once the directory is flushed, with the first error of the file.
+ */
+void IoUringWriteEngine::flush_directory(const std::shared_ptr<RingFile>& file, Handler handler)
+{
+    const std::string directory_path = std::filesystem::path(file->full_path).parent_path().string();
+    {
+        std::unique_lock<std::mutex> lock(m_directory_mutex);
+        auto directory = m_directory_fds.find(directory_path);
+        if (directory != m_directory_fds.end())
+        {
+            const int directory_fd = directory->second;
+            lock.unlock();
+            submit_directory_flush(file, directory_path, directory_fd, std::move(handler));
+            return;
+        }
+    }
+
+    // First flush of the directory, opened on the helper threads
+    post_blocking([this, file, directory_path, handler = std::move(handler)]() mutable {
+        const int directory_fd = get_directory_fd(directory_path);
+        if (directory_fd < 0)
+        {
+            handler(record_error(*file, make_error("Failed to open directory: " + directory_path + " for flush", errno)));
+            return;
+        }
+        submit_directory_flush(file, directory_path, directory_fd, std::move(handler));
+        });
+}
+
+/**
+ * @brief Submits the flush on disk of an opened directory, then calls the handler with the first error of the file.
+ */
+void IoUringWriteEngine::submit_directory_flush(const std::shared_ptr<RingFile>& file, const std::string& directory_path, int directory_fd, Handler handler)
+{
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_FSYNC;
+    sqe.fd = directory_fd;
+
+    submit(sqe, [file, directory_path, handler = std::move(handler)](int result) mutable {
+        handler(record_error(*file, result < 0 ? make_error("Failed to flush directory: " + directory_path, -result) : nullptr));
+        });
+}
+
+/**
+ * @brief Returns the descriptor of a directory to flush, opened at its first flush and kept until the engine is destroyed.
+ *
+ * The open is a blocking call, made on the helper threads.
+ *
+ * @return The descriptor, or -1 with `errno` set if the directory can't be opened.
+ */
+int IoUringWriteEngine::get_directory_fd(const std::string& directory_path)
+{
+    std::lock_guard<std::mutex> lock(m_directory_mutex);
+
+    auto directory = m_directory_fds.find(directory_path);
+    if (directory != m_directory_fds.end())
+    {
+        return directory->second;
+    }
+
+    const int directory_fd = ::open(directory_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd >= 0)
+    {
+        m_directory_fds.emplace(directory_path, directory_fd);
+    }
+    return directory_fd;
+}
+
+/**
+ * @brief Counts the end of an operation of a file, and runs the close waiting for it if it was the last one.
+ */
+void IoUringWriteEngine::end_file_operation(const std::shared_ptr<RingFile>& file, std::exception_ptr error)
+{
+    std::function<void()> on_idle;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (error && !file->error)
+        {
+            file->error = error;
+        }
+        if (--file->pending_operations == 0)
+        {
+            on_idle.swap(file->on_idle);
+        }
+    }
+
+    if (on_idle)
+    {
+        on_idle();
+    }
+}
+
+/**
+ * @brief Keeps the first error of a file.
+ *
+ * @param error The error of an operation of the file, or null.
+ *
+ * @return The first error of the file, null if none of its operations failed.
+ */
+std::exception_ptr IoUringWriteEngine::record_error(RingFile& file, std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(file.mutex);
+    if (error && !file.error)
+    {
+        file.error = error;
+    }
+    return file.error;
+}
+
+/**
+ * @brief Runs an action at once if no operation of the file is in flight, else after the last one.
+ */
+void IoUringWriteEngine::run_when_idle(const std::shared_ptr<RingFile>& file, std::function<void()> action)
+{
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (file->pending_operations > 0)
+        {
+            file->on_idle = std::move(action);
+            return;
+        }
+    }
+
+    action();
+}
+
+/**
+ * @brief Applies the file date and closes the file, after its last write.
+ *
+ * The date is applied on the descriptor used for writing with `futimens`, which has no io_uring operation, it runs on
+ * the helper threads. A part file is then renamed with a free name made from the name asked for the file, the rename
+ * has no io_uring operation before Linux 5.11, it runs on the helper threads too.
+ * With `flush_files`, the file is flushed before its close, and its directory after its rename.
+ *
+ * @param file The file given by `open()`.
+ * @param date The date of the file, in milliseconds since Unix epoch.
+ * @param handler Called once the file is closed.
+ */
+void IoUringWriteEngine::close(const std::shared_ptr<File>& file, double date, Handler handler)
+{
+    std::shared_ptr<RingFile> ring_file = std::static_pointer_cast<RingFile>(file);
+
+    run_when_idle(ring_file, [this, ring_file, date, handler = std::move(handler)]() mutable {
+        std::exception_ptr error;
+        int fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(ring_file->mutex);
+            error = ring_file->error;
+            fd = ring_file->fd;
+        }
+        if (fd < 0)
+        {
+            handler(error);
+            return;
+        }
+
+        auto flush_and_close = [this, ring_file, handler = std::move(handler)]() mutable {
+            if (!m_flush_files || record_error(*ring_file, nullptr))
+            {
+                close_ring_file(ring_file, std::move(handler));
+                return;
+            }
+
+            submit_flush(ring_file, [this, ring_file, handler = std::move(handler)](int result) mutable {
+                if (result < 0)
+                {
+                    record_error(*ring_file, make_error("Failed to flush file: " + ring_file->full_path, -result));
+                }
+                close_ring_file(ring_file, std::move(handler));
+                });
+        };
+
+        if (error)
+        {
+            flush_and_close();
+            return;
+        }
+
+        post_blocking([fd, date, flush_and_close = std::move(flush_and_close)]() mutable {
+            WindowsFileDiag::apply_date_on_file(fd, date);
+            flush_and_close();
+            });
+        });
+}
+
+/**
+ * @brief Closes a dated file, renames a part file into place, and with `flush_files` flushes its directory.
+ *
+ * @param file The file, with no operation in flight.
+ * @param handler Called once the file is closed.
+ */
+void IoUringWriteEngine::close_ring_file(const std::shared_ptr<RingFile>& file, Handler handler)
+{
+    submit_close(file, [this, file, handler = std::move(handler)](int result) mutable {
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(file->mutex);
+            file->fd = -1;
+            if (result < 0 && !file->error)
+            {
+                file->error = make_error("Failed to close file: " + file->full_path, -result);
+            }
+            error = file->error;
+        }
+
+        auto flush_renamed_file = [this, file, handler = std::move(handler)]() mutable {
+            std::exception_ptr error = record_error(*file, nullptr);
+            if (m_flush_files && !error)
+            {
+                flush_directory(file, std::move(handler));
+                return;
+            }
+            handler(error);
+        };
+
+        if (!file->is_part || error)
+        {
+            flush_renamed_file();
+            return;
+        }
+
+        post_blocking([this, file, flush_renamed_file = std::move(flush_renamed_file)]() mutable {
+            try
+            {
+                file->name_resolution_start = std::chrono::steady_clock::now();
+                file->full_path = m_file_name_index.move_to_unique_path(file->full_path, file->file_name);
+                file->name_resolution_end = std::chrono::steady_clock::now();
+            }
+            catch (...)
+            {
+                record_error(*file, std::current_exception());
+            }
+            flush_renamed_file();
+            });
+        });
+}
+
+/**
+ * @brief Closes and removes a file that will never be complete, after its operations in flight.
+ *
+ * The file is removed even if one of its operations failed.
+ *
+ * @param file The file given by `open()`.
+ */
+void IoUringWriteEngine::discard(const std::shared_ptr<File>& file)
+{
+    std::shared_ptr<RingFile> ring_file = std::static_pointer_cast<RingFile>(file);
+
+    run_when_idle(ring_file, [this, ring_file]() {
+        {
+            std::lock_guard<std::mutex> lock(ring_file->mutex);
+            if (ring_file->fd < 0)
+            {
+                return;
+            }
+        }
+
+        submit_close(ring_file, [this, ring_file](int) {
+            {
+                std::lock_guard<std::mutex> lock(ring_file->mutex);
+                ring_file->fd = -1;
+            }
+            std::error_code ec;
+            std::filesystem::remove(ring_file->full_path, ec);
+            m_file_name_index.release_path(ring_file->full_path);
+            });
+        });
+}
+
+/**
+ * @brief Starts the opening of the part file of a resumable upload.
+ *
+ * The part file is created if it doesn't exist, its data are kept otherwise. Its name is chosen by the caller, the free
+ * name of the file is chosen when the complete file is closed.
+ *
+ * @param part_path The path of the part file in the save directory.
+ * @param file_name The file name sent by the client, given to the file once complete.
+ * @param file_size The size of the whole file.
+ * @param handler Called once the file is opened.
+ *
+ * @return The file, to give to the other operations.
+ */
+std::shared_ptr<FileWriteEngine::File> IoUringWriteEngine::open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    std::shared_ptr<RingFile> file = std::make_shared<RingFile>();
+    file->full_path = part_path;
+    file->file_name = file_name;
+    file->is_part = true;
+    file->file_size = file_size;
+    file->pending_operations = 1; // the open, done once the allocation is done
+
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_OPENAT;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<uint64_t>(file->full_path.c_str());
+    sqe.len = 0666; // mode
+    sqe.open_flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+
+    submit(sqe, [this, file, handler = std::move(handler)](int result) mutable {
+        if (result < 0)
+        {
+            finish_open(file, std::move(handler), make_error("Failed to open file: " + file->full_path + " for writing", -result));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(file->mutex);
+            file->fd = result;
+        }
+        allocate_ring_file(file, std::move(handler));
+        });
+
+    return file;
+}
+
+/**
+ * @brief Closes a part file after its operations in flight, the part file is kept to resume the upload later.
+ *
+ * @param file The file given by `open_part()`.
+ * @param handler Called once the file is closed, all the data given to `write()` are then written.
+ */
+void IoUringWriteEngine::detach(const std::shared_ptr<File>& file, Handler handler)
+{
+    std::shared_ptr<RingFile> ring_file = std::static_pointer_cast<RingFile>(file);
+
+    run_when_idle(ring_file, [this, ring_file, handler = std::move(handler)]() mutable {
+        std::exception_ptr error;
+        int fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(ring_file->mutex);
+            error = ring_file->error;
+            fd = ring_file->fd;
+        }
+        if (fd < 0)
+        {
+            handler(error);
+            return;
+        }
+
+        submit_close(ring_file, [ring_file, handler = std::move(handler)](int) mutable {
+            std::exception_ptr error;
+            {
+                std::lock_guard<std::mutex> lock(ring_file->mutex);
+                ring_file->fd = -1;
+                error = ring_file->error;
+            }
+            handler(error);
+            });
+        });
+}
+
+/**
+ * @brief Runs a job reading saved files on the helper threads, after the operations in flight of a file.
+ *
+ * The reads are blocking calls, like the rename of a part file. The job must end before the next operation of the
+ * file is asked.
+ *
+ * @param file The file whose writes the job reads, or null.
+ * @param job The job, it can throw.
+ * @param handler Called with the error thrown by the job, or the first error of the file, or null.
+ */
+void IoUringWriteEngine::run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler)
+{
+    if (!file)
+    {
+        run_blocking_read(std::move(job), std::move(handler));
+        return;
+    }
+
+    std::shared_ptr<RingFile> ring_file = std::static_pointer_cast<RingFile>(file);
+    run_when_idle(ring_file, [this, ring_file, job = std::move(job), handler = std::move(handler)]() mutable {
+        std::exception_ptr error = record_error(*ring_file, nullptr);
+        if (error)
+        {
+            handler(error);
+            return;
+        }
+        run_blocking_read(std::move(job), std::move(handler));
+        });
+}
+
+/**
+ * @brief Runs a job reading saved files on the helper threads, then its handler with the error it threw.
+ */
+void IoUringWriteEngine::run_blocking_read(std::function<void()> job, Handler handler)
+{
+    post_blocking([job = std::move(job), handler = std::move(handler)]() {
+        std::exception_ptr error;
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        handler(error);
+        });
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "FileNameIndex.h"
+#include "FileWriteEngine.h"
+#include <boost/asio/thread_pool.hpp>
+#include <linux/io_uring.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class IoUringWriteEngine : public FileWriteEngine
+{
+public:
+	static std::unique_ptr<IoUringWriteEngine> try_create(FileNameIndex& file_name_index, std::size_t max_queue_depth, bool flush_files);
+	~IoUringWriteEngine() override;
+
+	const char* name() const override { return "io_uring"; }
+
+	std::shared_ptr<File> open(const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler) override;
+	void close(const std::shared_ptr<File>& file, double date, Handler handler) override;
+	void discard(const std::shared_ptr<File>& file) override;
+	std::shared_ptr<File> open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void detach(const std::shared_ptr<File>& file, Handler handler) override;
+	void run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler) override;
+
+private:
+	struct RingFile;
+	struct Operation;
+	using Completion = std::function<void(int result)>; // result of the operation, a negative errno value on error
+
+	IoUringWriteEngine(FileNameIndex& file_name_index, std::size_t max_queue_depth, bool flush_files);
+
+	bool setup(unsigned int entries);
+	void submit(io_uring_sqe sqe, Completion completion);
+	bool push_entry(const io_uring_sqe& sqe);
+	void flush();
+	void run_completions();
+	void push_overflow_entries();
+	bool fail_queued_entries(int error, std::unique_lock<std::mutex>& submit_lock);
+	void fail_all_operations(int error);
+	void link_operation(Operation* operation);
+	void unlink_operation(Operation* operation);
+	void complete_operation(Operation* operation, int result);
+	void end_operation();
+	void post_blocking(std::function<void()> job);
+	void run_blocking_read(std::function<void()> job, Handler handler);
+
+	void open_ring_file(const std::shared_ptr<RingFile>& file, Handler handler);
+	void allocate_ring_file(const std::shared_ptr<RingFile>& file, Handler handler);
+	void finish_open(const std::shared_ptr<RingFile>& file, Handler handler, std::exception_ptr error);
+	void submit_write(const std::shared_ptr<RingFile>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler);
+	void submit_close(const std::shared_ptr<RingFile>& file, Completion completion);
+	void submit_flush(const std::shared_ptr<RingFile>& file, Completion completion);
+	void close_ring_file(const std::shared_ptr<RingFile>& file, Handler handler);
+	void flush_directory(const std::shared_ptr<RingFile>& file, Handler handler);
+	void submit_directory_flush(const std::shared_ptr<RingFile>& file, const std::string& directory_path, int directory_fd, Handler handler);
+	int get_directory_fd(const std::string& directory_path);
+	void end_file_operation(const std::shared_ptr<RingFile>& file, std::exception_ptr error);
+	static std::exception_ptr record_error(RingFile& file, std::exception_ptr error);
+	void run_when_idle(const std::shared_ptr<RingFile>& file, std::function<void()> action);
+
+	FileNameIndex& m_file_name_index;
+
+	int m_ring_fd = -1;
+	void* m_sq_ring = nullptr;
+	void* m_cq_ring = nullptr;
+	std::size_t m_sq_ring_size = 0;
+	std::size_t m_cq_ring_size = 0;
+	io_uring_sqe* m_sqes = nullptr;
+	std::size_t m_sqes_size = 0;
+
+	unsigned int* m_sq_head = nullptr;
+	unsigned int* m_sq_tail = nullptr;
+	unsigned int* m_sq_array = nullptr;
+	unsigned int m_sq_mask = 0;
+	unsigned int m_sq_entries = 0;
+	unsigned int* m_cq_head = nullptr;
+	unsigned int* m_cq_tail = nullptr;
+	unsigned int m_cq_mask = 0;
+	io_uring_cqe* m_cqes = nullptr;
+
+	std::mutex m_sq_mutex; // protects the filling of the submission queue, the overflow entries and the failure
+	std::mutex m_submit_mutex; // held by the thread submitting the queued entries to the kernel
+	std::atomic<bool> m_is_submit_pending = false; // entries queued by a thread which found the submit mutex held
+	std::vector<io_uring_sqe> m_overflow_entries; // pushed by the completion thread while the submission queue was full
+	std::atomic<int> m_failure = 0; // errno of the error that stopped the ring, 0 while it works
+	std::atomic<bool> m_is_stopping = false;
+	std::thread m_completion_thread;
+
+	std::mutex m_operations_mutex;
+	Operation* m_operations = nullptr; // operations queued or in flight, failed if the ring stops
+
+	boost::asio::thread_pool m_blocking_threads; // calls without io_uring operation : dates, renames and directory opens
+
+	std::mutex m_directory_mutex;
+	std::unordered_map<std::string, int> m_directory_fds; // directories flushed with flush_files, by path
+};
@@ -1,87 +1,217 @@
+#include "ClientPage.h"
+#include "ContentHasher.h"
+#include "Crc32c.h"
+#include "FileNameIndex.h"
+#include "FileWriteEngine.h"
+#include "FrameHeader.h"
+#include "GroupCommit.h"
+#include "HandlerMemory.h"
+#include "MemoryBudget.h"
+#include "MetadataDateReader.h"
+#include "MeteredStream.h"
+#include "MetricsServer.h"
+#include "PartJournal.h"
+#include "PooledBuffer.h"
+#include "ProtocolError.h"
+#include "ReceiveBlockPool.h"
+#include "ReceivedBatch.h"
+#include "SaveWorkerPool.h"
+#include "SavedFileIndex.h"
+#include "ServerMetrics.h"
+#include "ShardedWriteEngine.h"
+#include "StripedFileTable.h"
+#include "TcpListener.h"
+#include "TraceWriter.h"
 #include "WindowsFileDiag.h"
+#ifdef ITLH_IO_URING
+#include "IoUringWriteEngine.h"
+#endif
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
+namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
+using session_socket = net::basic_stream_socket<tcp, net::strand<net::io_context::executor_type>>; // the executor isn't type erased, the operations of a session don't allocate for copying it
 
-constexpr char ACK_MESSAGE[] = "ACK:image_received"; // image received
-constexpr char ACK_WARNING[] = "ACK:image_warnings"; // image received but can't be read because data are corrupt
+constexpr char ACK_MESSAGE[] = "ACK:image_received"; // image received, followed by ":<file id>" from protocol version 2
+constexpr char ACK_WARNING[] = "ACK:image_warnings"; // image received but can't be read because data are corrupt, followed by ":<file id>" from protocol version 2
+constexpr char ACK_DUPLICATE[] = "ACK:image_duplicate"; // same content as a file already saved, the copy is not kept, followed by ":<file id>", protocol version 2 only
+constexpr char ACK_CHECKSUM[] = "ACK:image_checksum"; // data don't match the checksum sent by the client, the file is not kept and must be sent again, followed by ":<file id>", protocol version 6 only
+constexpr char HELLO_MESSAGE[] = "HELLO:"; // client send "HELLO:<version>", server answer "HELLO:<version used by the session>"
+constexpr char MANIFEST_MESSAGE[] = "MANIFEST:"; // client send "MANIFEST:<id>" and one line per file, server answer "NEED:<id>:" and one character per file
+constexpr char NEED_MESSAGE[] = "NEED:";
+constexpr char RESUME_MESSAGE[] = "RESUME:"; // client send "RESUME:<client token>:<file id>:<size>:<last modified>:<name>", server answer "RESUME:<file id>:<offset>"
+constexpr char ACK_BATCH[] = "ACK:batch"; // files of a batch saved, followed by ":<batch id>:" and one character per file : 'r' received, 'w' warnings, 'd' duplicate, 'c' checksum mismatch
 constexpr uint_least16_t APP_PORT = 5000;
+constexpr char CLIENT_PAGE_FILE_NAME[] = "client.html"; // HTML client served on APP_PORT to the browsers
+constexpr char DEFLATE_PATH[] = "/deflate"; // WebSocket connections on this path negotiate permessage-deflate, the client sends on them the files worth compressing
+constexpr int DEFLATE_CLIENT_WINDOW_BITS = 15; // window of the client messages, the size of the browsers, for the best ratio on the files
+constexpr int DEFLATE_SERVER_WINDOW_BITS = 9; // window of the server messages, only short ACKs
+constexpr int DEFLATE_SERVER_MEMORY_LEVEL = 1;
+constexpr int DEFLATE_SERVER_COMPRESSION_LEVEL = 1;
+
+// Version 1 : client without HELLO message, one file per message, ACK without file id, client waits each ACK
+// Version 2 : file header with a file id and the file size, ACK with file id, client keeps many files in flight
+// Version 3 : resumable files, sent from the offset the server already has after a disconnect
+// Version 4 : striped files, a big file is sent in ranges over many connections
+// Version 5 : batches of small files, many files in one message acknowledged together
+// Version 6 : optional CRC32C of the content in the file header, checked by the server while the data are received
+// Version 7 : the content of a file can go on in chunk messages, so the client never holds a whole file in memory
+constexpr uint32_t PROTOCOL_VERSION = 7;
 
 constexpr uint32_t MAX_FILE_SAME_NAME = 500'000;
-constexpr uint32_t DATA_FILE_RECEIVE_HEADER_SIZE = 12; // sizeof(uint32_t) + sizeof(double)
+constexpr std::size_t MAX_TEXT_MESSAGE_SIZE = 8 * 1'048'576; // a manifest of 1000 files with the longest names fits, the session is closed above
+constexpr std::size_t RECEIVE_CHUNK_SIZE = 1'048'576; // 1 MO
+constexpr std::size_t IDLE_READ_SIZE = 4'096; // read between two messages, without holding a chunk
+constexpr std::size_t MAX_FREE_FILES = 16; // files and ACK messages kept by a session for reuse, like a window of files in flight
+constexpr std::size_t MAX_KEPT_MESSAGE_SIZE = 256; // memory of a message kept for reuse, enough for an ACK
+constexpr std::size_t RECEIVE_CHUNK_COUNT = 4; // default maximum chunks of a session, memory used by a session for receive file data, whatever the file size
+constexpr std::size_t MEMORY_BUDGET_MB = 256; // default memory for the receive chunks of all the sessions
+constexpr unsigned int GROUP_COMMIT_DELAY_MS = 5; // default time a closed file waits for other files before they are flushed together
+constexpr uint64_t GROUP_COMMIT_MAX_BYTES = 64 * 1'048'576; // bytes of closed files flushed without waiting the end of the delay
 
 std::string global_save_directory_path = "";
 
-static std::string generate_unique_file_path(const std::string& directory, const std::string& file_name)
+/**
+ * @struct StorageRootOption
+ * @brief A save directory given with `--dest`, with the file extensions saved in it by `--placement extension`.
+ */
+struct StorageRootOption
 {
-    const std::filesystem::path dir_path(directory);
-    const std::filesystem::path file_path = dir_path / file_name;
-
-    // File name not take, so we can use it
-    if (!std::filesystem::exists(file_path))
-    {
-        return file_path.string();
-    }
-
-    const std::string& base_name = file_path.stem().string();
-    const std::string& extension = file_path.extension().string();
-
-    uint32_t counter = 1;
-
-    // Generate new name
-    while (true)
-    {
-        const std::string& new_file_name = base_name + "_" + std::to_string(counter) + extension;
-        const std::filesystem::path& new_file_path = dir_path / new_file_name;
-
-        if (!std::filesystem::exists(new_file_path))
-        {
-            return new_file_path.string();
-        }
-
-        counter++;
-
-        if (counter > MAX_FILE_SAME_NAME)
-        {
-            throw std::runtime_error("Error generating name, more than 500 000 files with the same name, program close");
-        }
-    }
+    std::string directory;
+    std::vector<std::string> extensions; // without the dot, empty : any file
+};
 
-    return "";
-}
+/**
+ * @struct ServerOptions
+ * @brief Server settings that can be changed from the command line.
+ */
+struct ServerOptions
+{
+    unsigned int network_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int save_thread_count = 4;
+    std::size_t save_queue_depth = 256;
+    std::size_t memory_budget = MEMORY_BUDGET_MB * 1'048'576; // bytes of receive chunks of all the sessions
+    std::size_t session_chunk_count = RECEIVE_CHUNK_COUNT; // maximum receive chunks of a session
+    std::vector<StorageRootOption> storage_roots; // empty : one folder asked with the folder selection dialog, the first one holds the journals
+    Placement placement = Placement::round_robin; // root of each new file when there are several
+    bool sync_io = false; // true : blocking writes on the save threads even if io_uring is available
+    bool reuse_port = false; // true : one io_context and one SO_REUSEPORT acceptor per network thread
+    Durability durability = Durability::none;
+    unsigned int group_commit_delay_ms = GROUP_COMMIT_DELAY_MS;
+    uint_least16_t metrics_port = 0; // 0 : no metrics endpoint
+    std::string trace_path; // empty : no trace of the files
+    std::string client_page_path; // empty : client.html next to the server executable, or in the current folder
+    bool log_files = true; // false : no console line for each saved file
+    bool dedupe = true; // false : files with the same content as a saved file are saved again
+    bool deflate = true; // false : no compression, even on the connections asked on DEFLATE_PATH
+};
 
-static bool save_file(const std::string& file_name, const uint8_t* data, size_t size, double last_modified)
+/**
+ * @struct ReceivedFile
+ * @brief State of a file received from a client, used by its session only.
+ */
+struct ReceivedFile
 {
-    const std::string& full_path = generate_unique_file_path(global_save_directory_path, file_name);
+    uint32_t file_id = 0; // 0 with protocol version 1
+    std::string file_name;
+    double last_modified = 0.0;
+    uint64_t expected_size = 0; // announced by the client from protocol version 2
+    uint64_t size = 0;
+    bool is_part = false; // resumable file, written in its part file
+    uint64_t start_offset = 0; // position of the first byte of the message in the file : bytes of a resumable file received before, start of a range
+    std::shared_ptr<StripedFile> striped_file; // file this range belongs to, null for other messages
+    std::shared_ptr<ReceivedBatch> batch; // batch message of the file until it's acknowledged, null for other messages
+    uint32_t batch_index = 0; // position of the file in its batch
+    std::shared_ptr<FileWriteEngine::File> output;
+    MetadataDateReader metadata_date_reader;
+    ContentHasher content_hasher;
+    bool is_continued = false; // the content goes on in the next binary message, a chunk frame
+    bool has_checksum = false; // the client sent the CRC32C of the content of the message
+    uint32_t expected_checksum = 0;
+    Crc32c checksum;
+    bool is_checksum_failed = false; // the data of a previous message of the file don't match their checksum
+    FileTimings timings;
 
-    std::ofstream out_file(full_path, std::ios::binary);
-    if (!out_file)
+    /**
+     * @brief Clears the file for the next file of its session, its name and the buffers of its date reader keep their memory.
+     */
+    void reset()
     {
-        throw std::ios_base::failure("Failed to open file: " + full_path + " for writing");
-
-        return false;
+        std::string name = std::move(file_name);
+        MetadataDateReader reader = std::move(metadata_date_reader);
+        *this = ReceivedFile();
+        file_name = std::move(name);
+        file_name.clear();
+        metadata_date_reader = std::move(reader);
+        metadata_date_reader.reset();
     }
-    out_file.write(reinterpret_cast<const char*>(data), size);
-    out_file.close();
+};
 
-    WindowsFileDiag::apply_last_modified_date_on_file(full_path, last_modified);
-    bool no_error = WindowsFileDiag::apply_metadata_date_on_file(full_path);
+/**
+ * @struct SharedChunk
+ * @brief A receive chunk whose data can be written to many files, given back to its session after its last write.
+ */
+struct SharedChunk
+{
+    ReceiveBlockPool::Block buffer;
+    std::size_t pending_write_count = 0;
+};
 
-    std::cout << "File save : " << file_name << " (" << size << " octets)" << std::endl;
+/**
+ * @struct OutgoingMessage
+ * @brief A text message queued for the client, with the files it acknowledges.
+ */
+struct OutgoingMessage
+{
+    std::string text;
+    std::vector<std::shared_ptr<ReceivedFile>> files; // their times are recorded once the message is sent
+};
 
-    return no_error;
-}
+/**
+ * @struct SessionContext
+ * @brief Objects shared by all the sessions, owned by main and alive until the io_context is destroyed.
+ */
+struct SessionContext
+{
+    FileWriteEngine& write_engine;
+    GroupCommit* group_commit; // null : files acknowledged once closed, without waiting for a group flush
+    ServerMetrics& metrics;
+    TraceWriter* trace_writer; // null : no trace of the files
+    SavedFileIndex& saved_file_index;
+    PartJournal& part_journal;
+    StripedFileTable& striped_file_table;
+    MemoryBudget& memory_budget;
+    ReceiveBlockPool& block_pool;
+    const ClientPage& client_page; // answers the connections that ask the page instead of a WebSocket
+    std::size_t max_chunk_count; // receive chunks a session can allocate
+    bool dedupe; // false : files with the same content as a saved file are saved again
+    bool deflate; // false : no compression, even on the connections asked on DEFLATE_PATH
+    bool log_files;
+};
 
 /**
  * @class Session
@@ -93,10 +223,67 @@ static bool save_file(const std::string& file_name, const uint8_t* data, size_t
  * proper lifetime handling.
  *
  * The `run()` function initiates the WebSocket handshake and starts listening for incoming messages.
- * The `do_read()` function continuously reads messages asynchronously, while `process_binary_message()`
- * handles the binary data received by extracting metadata and saving the file to disk.
+ * The `do_read()` function continuously reads message frames asynchronously in fixed size chunks,
+ * while `process_binary_frame()` extracts the file metadata from the first bytes of a message and
+ * hands the rest of the data to the `FileWriteEngine`, which writes it to the file on disk.
+ * A file is never fully loaded in memory, so the memory used by a session doesn't depend on the size
+ * of the files sent.
+ *
+ * The disk operations of a file (open, write, close and dates) are run by the write engine, so the network
+ * threads never wait for the disk, and their completions are posted back to the session. The date of
+ * the file is read from the data by the session while they are received. A session allocates up to `max_chunk_count`
+ * chunks, each one reserved in the memory budget shared by all the sessions : a chunk is given back once its data is
+ * written, and the session stops reading while all its chunks are in use, while the budget is exhausted or while
+ * the engine queue is full. The session keeps its chunks while it receives a message, but frees them between two
+ * messages, and at once when other sessions wait for memory while it has more than its share of the budget. The
+ * chunks are blocks borrowed from the receive block pool, reused by all the sessions. Between two messages the
+ * session reads the first bytes of the next one in a small buffer of its own, so an idle session holds no chunk, and
+ * a text message is collected in a pooled buffer that gives back its blocks once the message is processed. The
+ * session can start reading the next file while the previous one is still flushing, the acknowledgment of a file
+ * is sent once it is closed.
+ *
+ * A client that sends "HELLO:2" first uses the protocol version 2 : each file carries an id chosen by the client,
+ * and the client sends many files without waiting their acknowledgment. Files are flushed in parallel, so their
+ * acknowledgments can be sent out of order, each one ends with the id of its file. Clients that don't send HELLO
+ * keep the protocol version 1. Outgoing messages are queued, so only one write is in progress at a time.
+ *
+ * The content of each file is hashed while it is received. When the index of saved files holds a file with the
+ * same content, the copy received is removed instead of being closed, and the client gets a duplicate ACK.
+ * Before sending its files, a client can send a manifest of them, the session answers which ones it needs.
+ *
+ * From protocol version 3, a client can send a file as resumable : it first asks with a "RESUME:" message the offset
+ * the server already has, then sends the file from this offset. The file is written in a part file recorded in the part
+ * journal, with the token of the client. If the client leaves before the end, the part file is kept and the bytes written
+ * are recorded, the client sends only the rest on its next connection. The complete part file is renamed into place.
+ *
+ * From protocol version 4, a big file can be striped : the client sends ranges of the file over many connections,
+ * all with the same transfer id. The sessions share the file through the striped file table : it is opened and its
+ * disk space allocated once, each range is written at its offset, and the session that writes the last bytes reads
+ * the file back for its date and hash, then closes it once. The ACK of the file is sent on every connection that sent
+ * a range of it. If one of these connections is lost before the end, the file is removed.
  *
- * Errors during communication or processing are reported using exceptions.
+ * From protocol version 5, small files can be sent many in one message : each file of a batch whose content is in a
+ * single chunk is saved by one operation of the write engine, and the batch is acknowledged by a single message
+ * giving the status of each file once they are all saved. A receive chunk can then hold the data of many files,
+ * it's given back after the last write of its data.
+ *
+ * From protocol version 6, the client can send the CRC32C of the content of each message in its header. The checksum is
+ * computed while the data are received, with the content hash, and a file whose data don't match it is removed instead of
+ * being closed : the client gets a checksum ACK and sends the file again.
+ *
+ * A connection asked on `DEFLATE_PATH` negotiates permessage-deflate : the client sends on it the files its content
+ * check finds worth compressing, the others go on its uncompressed connection. The session counts the bytes of the
+ * messages it reads, the bytes read from the network for them and the time spent to decode them.
+ *
+ * Each file is timed from its first byte to its ACK, the times of its steps are added to the server metrics
+ * and, if asked, written to the trace. The console line of each saved file can be turned off, it locks the
+ * console on the hot path.
+ *
+ * The socket given to a session is bound to its own strand, so all the handlers of a session are
+ * serialized even when the io_context is run by many threads, while different sessions run in parallel.
+ *
+ * Errors during communication or processing are reported using exceptions. Errors of a disk operation are
+ * rethrown on the session strand.
  *
  * @note This implementation is designed to handle binary WebSocket messages containing file data
  * in a custom format. Other message types are not expected and will be logged.
@@ -110,166 +297,2065 @@ public:
      * This constructor takes ownership of a TCP socket and initializes the WebSocket stream
      * for communication with the client.
      *
-     * @param socket The TCP socket representing the client connection.
+     * @param socket The TCP socket representing the client connection, its executor must be a strand.
+     * @param context The write engine, metrics and trace shared by the sessions.
+     */
+    Session(session_socket socket, const SessionContext& context)
+        : m_ws(std::move(socket))
+        , m_write_engine(context.write_engine)
+        , m_group_commit(context.group_commit)
+        , m_metrics(context.metrics)
+        , m_trace_writer(context.trace_writer)
+        , m_saved_file_index(context.saved_file_index)
+        , m_part_journal(context.part_journal)
+        , m_striped_file_table(context.striped_file_table)
+        , m_memory_budget(context.memory_budget)
+        , m_block_pool(context.block_pool)
+        , m_client_page(context.client_page)
+        , m_max_chunk_count(context.max_chunk_count)
+        , m_dedupe(context.dedupe)
+        , m_deflate(context.deflate)
+        , m_log_files(context.log_files)
+        , m_text_buffer(context.block_pool)
+    {
+        ServerMetrics::add(m_metrics.active_sessions, 1);
+
+        m_ws.read_message_max(0); // no max size, file are write on disk frame by frame, text messages are limited by on_text_read()
+    }
+
+    ~Session()
+    {
+        ServerMetrics::add(m_metrics.active_sessions, -1);
+        m_memory_budget.release(m_chunk_count * RECEIVE_CHUNK_SIZE);
+    }
+
+    /**
+     * @brief Starts the WebSocket session by performing the handshake.
+     *
+     * The `run()` function reads the first HTTP request of the connection. A WebSocket upgrade begins
+     * the WebSocket handshake asynchronously and, upon success, transitions to reading messages from the client.
+     * Any other request, a browser loading the client page, is given to the client page with the connection.
+     * An upgrade asked on `DEFLATE_PATH` negotiates the permessage-deflate extension.
+     */
+    void run()
+    {
+        http::async_read(m_ws.next_layer(), m_http_buffer, m_upgrade_request, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec)
+            {
+                return; // closed or not HTTP
+            }
+
+            if (!websocket::is_upgrade(self->m_upgrade_request))
+            {
+                self->m_client_page.serve(tcp::socket(std::move(self->m_ws.next_layer().next_layer())), std::move(self->m_http_buffer), std::move(self->m_upgrade_request));
+                return;
+            }
+
+            self->set_deflate();
+            self->set_timeout();
+
+            self->m_ws.async_accept(self->m_upgrade_request, [self](beast::error_code ec) {
+                self->m_upgrade_request = {};
+                self->m_http_buffer = beast::flat_buffer();
+                self->on_accept(ec);
+                });
+            });
+    }
+
+private:
+    websocket::stream<MeteredStream<session_socket>> m_ws;
+    beast::flat_buffer m_http_buffer; // first request of the connection, released once the WebSocket is accepted
+    ClientPage::Request m_upgrade_request;
+    FileWriteEngine& m_write_engine;
+    GroupCommit* m_group_commit;
+    ServerMetrics& m_metrics;
+    TraceWriter* m_trace_writer;
+    SavedFileIndex& m_saved_file_index;
+    PartJournal& m_part_journal;
+    StripedFileTable& m_striped_file_table;
+    MemoryBudget& m_memory_budget;
+    ReceiveBlockPool& m_block_pool;
+    const ClientPage& m_client_page;
+    const std::size_t m_max_chunk_count;
+    std::size_t m_chunk_count = 0; // chunks allocated, free or in use, each one reserved in the memory budget
+    bool m_is_reserving_chunk = false; // a chunk is added once an other session releases memory
+    const bool m_dedupe;
+    const bool m_deflate;
+    const bool m_log_files;
+    bool m_is_deflate = false; // permessage-deflate negotiated, the reads are counted and timed
+    uint64_t m_message_bytes = 0; // bytes of the messages read, once inflated
+    uint64_t m_network_bytes_start = 0; // bytes read from the network before the first message
+    uint64_t m_network_bytes_counted = 0; // bytes read from the network added to the metrics
+    std::chrono::steady_clock::duration m_decode_time_counted{}; // time to decode the messages added to the metrics
+    std::vector<ReceiveBlockPool::Block> m_free_chunks;
+    ReceiveBlockPool::Block m_read_chunk;
+    std::size_t m_read_size = 0; // bytes read in the current chunk, processed once the chunk is full or the message is done
+    bool m_read_paused = false;
+    bool m_is_in_message = false; // the last read didn't reach the end of its message
+    std::array<uint8_t, IDLE_READ_SIZE> m_idle_buffer; // first bytes of a message, read without holding a chunk
+    std::size_t m_idle_size = 0;
+    bool m_has_idle_data = false; // binary data of the idle buffer not processed yet, they are copied in the next chunk
+    PooledBuffer m_text_buffer;
+    std::deque<OutgoingMessage> m_write_queue;
+    std::optional<websocket::close_reason> m_close_reason; // set once the client broke the protocol, the session closes after the queued messages
+    HandlerMemory m_read_memory; // operation of the read in progress
+    HandlerMemory m_write_memory; // operation of the write in progress
+
+    // Objects of the files and messages done, reused by the next ones
+    std::vector<std::shared_ptr<SharedChunk>> m_shared_chunks; // free once the session holds their only reference
+    std::vector<std::shared_ptr<ReceivedFile>> m_free_files;
+    std::vector<OutgoingMessage> m_free_messages;
+    uint32_t m_protocol_version = 1;
+    std::string m_client_token; // token of the client given by its "RESUME:" messages
+    std::vector<std::shared_ptr<StripedFile>> m_waiting_striped_files; // striped files with a range received by this session, not finished yet
+
+    // State of the file currently received
+    FrameHeader m_header; // header of the message or of the file of a batch being received
+    std::shared_ptr<ReceivedFile> m_file;
+    std::shared_ptr<ReceivedFile> m_continued_file; // file whose content goes on in the next binary message
+    std::shared_ptr<ReceivedBatch> m_batch; // batch message being received
+    std::chrono::steady_clock::time_point m_message_start;
+
+    /**
+     * @brief Makes the handler of a disk operation, which runs a function on the session strand.
+     *
+     * If the operation failed, the function isn't run and the session ends with `fail_session()` instead, the
+     * sessions of the other clients go on.
+     *
+     * @param function The function to run once the operation is done, it receives the session.
+     */
+    template <class Function>
+    FileWriteEngine::Handler make_engine_handler(Function&& function)
+    {
+        return [self = shared_from_this(), function = std::forward<Function>(function)](std::exception_ptr error) mutable {
+            net::post(self->m_ws.get_executor(), [self, error, function = std::move(function)]() mutable {
+                if (error)
+                {
+                    self->fail_session(error);
+                    return;
+                }
+                function(self);
+                });
+            };
+    }
+
+    /**
+     * @brief Makes the handler of a disk operation that has nothing to do once done, like an open : only its error
+     * is posted to the session strand, a success isn't posted to the session.
+     */
+    FileWriteEngine::Handler make_error_handler()
+    {
+        return [self = shared_from_this()](std::exception_ptr error) {
+            if (error)
+            {
+                net::post(self->m_ws.get_executor(), [self, error]() {
+                    self->fail_session(error);
+                    });
+            }
+            };
+    }
+
+    /**
+     * @brief Runs a function once a closed file is on disk : at once, or after the flush of its group with
+     * `Durability::group`. The function acknowledges the file, so no ACK is sent for a file that could still be lost.
+     *
+     * @param file The file, closed by the write engine.
+     * @param function The function to run on the session strand, it receives the session.
+     */
+    template <class Function>
+    void commit_file(const ReceivedFile& file, Function&& function)
+    {
+        if (!m_group_commit)
+        {
+            function(shared_from_this());
+            return;
+        }
+        m_group_commit->commit(file.output->full_path, file.size, make_engine_handler(std::forward<Function>(function)));
+    }
+
+    /**
+     * @brief Processes a part of a binary message received from the WebSocket client.
+     *
+     * The binary message is a header in a custom format, read by `FrameHeader` with the rules of the protocol version of
+     * the session, followed by the content of the file. A batch message holds many files, each one with its header and
+     * its content. From protocol version 6, the data are checked while they are received against the checksum of the
+     * header, a file whose data don't match is not kept and is acknowledged with `ACK_CHECKSUM`. From protocol version 7,
+     * the content of a file can go on in the next messages, text messages can come between them, the checksum of
+     * each message covers the content of the message.
+     *
+     * A message can be received in many parts. The header and the file name are accumulated
+     * until they are complete, then the destination file is opened and every following byte
+     * of the file is written to it, and read by the metadata date reader. A file of a batch whose whole content
+     * is in the chunk is saved by a single operation of the write engine.
+     *
+     * @param chunk The chunk that holds the bytes received, it is given to the write operations.
+     * @param size The number of bytes received.
+     *
+     * @throws ProtocolError If the header or the content of the message breaks the protocol.
+     */
+    void process_binary_frame(ReceiveBlockPool::Block chunk, size_t size)
+    {
+        // The chunk is given back after the last write of its data, the data of a batch go to many files
+        std::shared_ptr<SharedChunk> shared_chunk = make_shared_chunk(std::move(chunk));
+        const uint8_t* data = shared_chunk->buffer.data();
+
+        if (!m_file && m_header.empty() && !m_batch)
+        {
+            m_message_start = std::chrono::steady_clock::now();
+        }
+
+        while (size > 0)
+        {
+            if (!m_file)
+            {
+                read_header(data, size);
+                if (m_file && m_batch && m_file->expected_size == 0)
+                {
+                    save_whole_file(shared_chunk, data);
+                }
+                continue;
+            }
+
+            // A file of a batch ends before the end of the message, the next bytes are the header of the next file
+            const size_t file_part_size = m_batch ? static_cast<size_t>(std::min<uint64_t>(size, m_file->expected_size - m_file->size)) : size;
+            if (!m_file->output && file_part_size == m_file->expected_size)
+            {
+                save_whole_file(shared_chunk, data);
+            }
+            else
+            {
+                if (!m_file->output)
+                {
+                    m_file->output = m_write_engine.open(m_file->file_name, m_file->expected_size, make_error_handler());
+                }
+                write_file_part(shared_chunk, data, file_part_size);
+
+                if (m_batch && m_file->size == m_file->expected_size)
+                {
+                    finish_received_file();
+                    m_header.clear();
+                }
+            }
+            data += file_part_size;
+            size -= file_part_size;
+        }
+
+        if (shared_chunk->pending_write_count == 0)
+        {
+            give_back_chunk(std::move(shared_chunk->buffer));
+        }
+    }
+
+    /**
+     * @brief Gives a chunk to a shared chunk that no write operation holds anymore, a new one if all are in use.
+     */
+    std::shared_ptr<SharedChunk> make_shared_chunk(ReceiveBlockPool::Block chunk)
+    {
+        auto shared_chunk = std::find_if(m_shared_chunks.begin(), m_shared_chunks.end(), [](const std::shared_ptr<SharedChunk>& shared_chunk) {
+            return shared_chunk.use_count() == 1;
+            });
+        if (shared_chunk == m_shared_chunks.end())
+        {
+            shared_chunk = m_shared_chunks.insert(m_shared_chunks.end(), std::make_shared<SharedChunk>());
+        }
+        (*shared_chunk)->buffer = std::move(chunk);
+        return *shared_chunk;
+    }
+
+    /**
+     * @brief Accumulates the header and the file name of the next file, takes only the missing bytes.
+     *
+     * The file is opened once its header and its name are complete, the header of a batch starts the batch.
+     *
+     * @param data The bytes received, moved after the bytes taken.
+     * @param size The number of bytes received, decreased by the bytes taken.
+     *
+     * @throws ProtocolError If the header breaks the protocol.
+     */
+    void read_header(const uint8_t*& data, size_t& size)
+    {
+        while (!m_file && size > 0)
+        {
+            m_header.read(data, size);
+            if (!m_header.is_complete())
+            {
+                continue;
+            }
+
+            if (m_header.is_batch())
+            {
+                open_batch();
+                continue;
+            }
+            open_received_file();
+        }
+    }
+
+    /**
+     * @brief Writes a part of the current file, and reads it for the date, the hash and the checksum of the file.
+     *
+     * @param chunk The chunk that holds the data, given back once its writes are done.
+     * @param data The data of the file.
+     * @param size The number of bytes of the file in the data.
+     */
+    void write_file_part(const std::shared_ptr<SharedChunk>& chunk, const uint8_t* data, size_t size)
+    {
+        if (!m_file->striped_file && m_file->start_offset == 0)
+        {
+            m_file->metadata_date_reader.feed(data, size); // a striped or resumed file is read back once all its data are written
+            m_file->content_hasher.feed(data, size);
+        }
+        if (m_file->has_checksum)
+        {
+            m_file->checksum.feed(data, size);
+        }
+        const uint64_t file_offset = m_file->size;
+        m_file->size += size;
+
+        const auto write_start = std::chrono::steady_clock::now();
+        if (m_file->timings.write_start == std::chrono::steady_clock::time_point())
+        {
+            m_file->timings.write_start = write_start;
+        }
+        ServerMetrics::add(m_metrics.bytes_received, size);
+        ServerMetrics::add(m_metrics.bytes_buffered, static_cast<int64_t>(size));
+
+        // The chunk is held by the handler, its data stay valid until the write is done
+        chunk->pending_write_count++;
+        FileWriteEngine::Handler handler = make_engine_handler([chunk, size, write_start, file = m_file](std::shared_ptr<Session> self) {
+            file->timings.write_end = std::chrono::steady_clock::now();
+            self->m_metrics.disk_write_time.observe(file->timings.write_end - write_start);
+            ServerMetrics::add(self->m_metrics.bytes_buffered, -static_cast<int64_t>(size));
+
+            self->release_chunk(*chunk);
+
+            if (file->striped_file && file->striped_file->add_written(size))
+            {
+                self->finalize_striped_file(file->striped_file);
+            }
+            });
+        m_write_engine.write(m_file->output, file_offset, data, size, std::move(handler));
+    }
+
+    /**
+     * @brief Saves a file of a batch whose whole content is in the received chunk, with a single operation of the write engine.
+     *
+     * The content is read for its date, hash and checksum before anything is written, so a duplicate or a file whose
+     * data don't match their checksum is never written on disk. A saved file with the same hash is compared with the
+     * content in memory, the chunk is kept until then.
+     *
+     * @param chunk The chunk that holds the content, given back once the file is saved.
+     * @param data The content of the file.
+     */
+    void save_whole_file(const std::shared_ptr<SharedChunk>& chunk, const uint8_t* data)
+    {
+        const size_t size = static_cast<size_t>(m_file->expected_size);
+        m_file->metadata_date_reader.feed(data, size);
+        m_file->content_hasher.feed(data, size);
+        if (m_file->has_checksum)
+        {
+            m_file->checksum.feed(data, size);
+        }
+        m_file->size = size;
+        m_file->timings.receive_end = std::chrono::steady_clock::now();
+        ServerMetrics::add(m_metrics.bytes_received, size);
+
+        if (!is_checksum_valid(*m_file))
+        {
+            reject_corrupt_file(std::move(m_file));
+            m_header.clear();
+            return;
+        }
+
+        const uint64_t content_hash = m_file->content_hasher.digest();
+        chunk->pending_write_count++;
+        find_duplicate(*m_file, content_hash, nullptr, data, [chunk, data, file = m_file, content_hash](std::shared_ptr<Session> self, const std::string& duplicate_path) {
+            if (!duplicate_path.empty())
+            {
+                self->release_chunk(*chunk);
+                self->record_duplicate(*file, content_hash, duplicate_path);
+                self->acknowledge(file, ACK_DUPLICATE);
+                return;
+            }
+            self->write_whole_file(chunk, data, file, content_hash);
+            });
+
+        m_file.reset();
+        m_header.clear();
+    }
+
+    /**
+     * @brief Writes a checked file of a batch with a single operation of the write engine.
+     *
+     * @param chunk The chunk that holds the content, its write is already counted.
+     * @param data The content of the file.
+     * @param file The file.
+     * @param content_hash The hash of the content.
+     */
+    void write_whole_file(const std::shared_ptr<SharedChunk>& chunk, const uint8_t* data, const std::shared_ptr<ReceivedFile>& file, uint64_t content_hash)
+    {
+        const MetadataDate metadata_date = file->metadata_date_reader.read_date();
+        const double date = metadata_date.status == MetadataDateStatus::found ? metadata_date.date : file->last_modified;
+        const bool no_error = metadata_date.status != MetadataDateStatus::corrupt;
+
+        ServerMetrics::add(m_metrics.bytes_buffered, static_cast<int64_t>(file->size));
+        file->timings.write_start = std::chrono::steady_clock::now();
+        file->timings.stamping_start = file->timings.write_start;
+        file->output = m_write_engine.save(file->file_name, data, static_cast<size_t>(file->size), date, make_engine_handler([chunk, file, no_error, content_hash](std::shared_ptr<Session> self) {
+            file->timings.write_end = std::chrono::steady_clock::now();
+            file->timings.stamping_end = file->timings.write_end;
+            self->m_metrics.disk_write_time.observe(file->timings.write_end - file->timings.write_start);
+            ServerMetrics::add(self->m_metrics.bytes_buffered, -static_cast<int64_t>(file->size));
+
+            self->release_chunk(*chunk);
+            self->on_file_saved(file, no_error, content_hash);
+            }));
+    }
+
+    /**
+     * @brief Ends a write of the data of a chunk, the chunk is given back to the session after its last write.
+     */
+    void release_chunk(SharedChunk& chunk)
+    {
+        if (--chunk.pending_write_count == 0)
+        {
+            give_back_chunk(std::move(chunk.buffer));
+        }
+    }
+
+    /**
+     * @brief Gives back a chunk to the session once its data are used, and restarts the reading if it was paused.
+     *
+     * The chunk is kept for the next reads of the message. Between two messages it's freed unless the reading is
+     * paused for lack of a chunk, and it's freed when other sessions wait for memory while this one has more than
+     * its share of the budget. While a message is received, the last chunk of the session is always kept for its next read.
+     *
+     * @param chunk The chunk.
+     */
+    void give_back_chunk(ReceiveBlockPool::Block chunk)
+    {
+        m_free_chunks.push_back(std::move(chunk));
+        trim_free_chunks(is_receiving_message() ? m_free_chunks.size() : m_read_paused ? 1 : 0);
+        resume_read();
+    }
+
+    /**
+     * @brief Frees the free chunks of the session above a count, and releases their memory in the budget.
+     *
+     * When other sessions wait for memory, the free chunks are also freed while the session has more chunks than
+     * its share of the budget : the budget divided by the number of sessions. A session under its share keeps its
+     * chunks, so the sessions don't free and allocate again their chunks at each read. While a message is received,
+     * the last chunk is never freed : a session waiting for memory must still be able to read, its data may be needed
+     * to free the memory of an other session, like the ranges of a striped file.
+     *
+     * @param kept_count Number of free chunks kept.
+     */
+    void trim_free_chunks(std::size_t kept_count)
+    {
+        const std::size_t session_count = static_cast<std::size_t>(std::max<int64_t>(1, m_metrics.active_sessions.load()));
+        const std::size_t share_chunk_count = m_memory_budget.capacity() / RECEIVE_CHUNK_SIZE / session_count; // 0 with more sessions than chunks, they take turns
+        const bool is_over_share = m_memory_budget.has_waiters() && m_chunk_count > share_chunk_count;
+
+        while (!m_free_chunks.empty() && (m_chunk_count > 1 || !is_receiving_message()) && (m_free_chunks.size() > kept_count || (is_over_share && m_chunk_count > share_chunk_count)))
+        {
+            m_free_chunks.pop_back();
+            m_chunk_count--;
+            m_memory_budget.release(RECEIVE_CHUNK_SIZE);
+        }
+    }
+
+    /**
+     * @brief Borrows a free chunk from the block pool, its memory reserved in the budget.
+     */
+    void add_chunk()
+    {
+        m_chunk_count++;
+        m_free_chunks.push_back(m_block_pool.acquire());
+    }
+
+    /**
+     * @brief Checks if a binary message is being received, or the next message of a file continued.
+     */
+    bool is_receiving_message() const
+    {
+        return m_file || m_continued_file || m_batch || !m_header.empty();
+    }
+
+    /**
+     * @brief Starts the batch of a complete batch header, the header of its first file follows.
+     *
+     * @throws ProtocolError If the batch holds more than `MAX_BATCH_FILE_COUNT` files, or if a file isn't finished.
+     */
+    void open_batch()
+    {
+        throw_if_continued_file();
+        const BatchHeader header = m_header.start_batch();
+        m_batch = std::make_shared<ReceivedBatch>(header.batch_id, header.file_count);
+    }
+
+    /**
+     * @brief Returns a file acknowledged before and no longer used, or a new file.
+     */
+    std::shared_ptr<ReceivedFile> make_received_file()
+    {
+        if (m_free_files.empty())
+        {
+            return std::make_shared<ReceivedFile>();
+        }
+        std::shared_ptr<ReceivedFile> file = std::move(m_free_files.back());
+        m_free_files.pop_back();
+        return file;
+    }
+
+    /**
+     * @brief Keeps an acknowledged file for the next file of the session, if nothing else holds it.
+     */
+    void recycle_file(std::shared_ptr<ReceivedFile> file)
+    {
+        if (file.use_count() == 1 && m_free_files.size() < MAX_FREE_FILES)
+        {
+            file->reset();
+            m_free_files.push_back(std::move(file));
+        }
+    }
+
+    /**
+     * @brief Extracts the file metadata from the complete header and starts the opening of the destination file.
+     *
+     * The operations of this file can run while the operations of the previous file are not done.
+     *
+     * @throws ProtocolError If the frame type of a protocol version 2 header is unknown, if a resumable file
+     * doesn't match its "RESUME:" message, if a range is out of its file, if a chunk isn't the chunk of the file continued,
+     * or if a batch holds more files than announced.
+     */
+    void open_received_file()
+    {
+        if (m_header.is_chunk())
+        {
+            continue_file();
+            return;
+        }
+        if (!m_batch)
+        {
+            throw_if_continued_file();
+        }
+
+        const FileHeader header = m_header.file();
+        m_file = make_received_file();
+        m_file->timings.receive_start = m_message_start;
+        m_file->file_id = header.file_id;
+        m_file->last_modified = header.last_modified;
+        m_file->expected_size = header.size;
+        m_file->is_continued = header.is_continued;
+        m_file->has_checksum = header.has_checksum;
+        m_file->expected_checksum = header.checksum;
+        m_file->file_name.assign(header.file_name);
+
+        if (m_batch)
+        {
+            m_file->batch = m_batch;
+            m_file->batch_index = m_batch->add_file();
+            m_file->timings.receive_start = std::chrono::steady_clock::now();
+            return; // opened once its content comes, or saved at once when its whole content is in a chunk
+        }
+
+        m_file->start_offset = header.offset;
+        if (header.is_range)
+        {
+            open_range_file();
+            return;
+        }
+        if (header.is_part)
+        {
+            m_file->is_part = true;
+            open_part_file();
+            return;
+        }
+        m_file->output = m_write_engine.open(m_file->file_name, m_file->expected_size, make_error_handler());
+    }
+
+    /**
+     * @brief Takes back the file continued by the previous message, for the content of a complete chunk header.
+     *
+     * The file keeps its destination, its size and its readers, only the checksum of the chunk and its flags are taken.
+     *
+     * @throws ProtocolError If no file is continued, or if the chunk is sent for an other file.
+     */
+    void continue_file()
+    {
+        const ChunkHeader header = m_header.chunk();
+        if (!m_continued_file || m_continued_file->file_id != header.file_id)
+        {
+            throw ProtocolError("Chunk of file " + std::to_string(header.file_id) + " sent without the start of the file");
+        }
+
+        m_file = std::move(m_continued_file);
+        m_file->is_continued = header.is_continued;
+        m_file->has_checksum = header.has_checksum;
+        m_file->expected_checksum = header.checksum;
+    }
+
+    /**
+     * @brief Stops the session when a new file or batch starts while the content of the previous file goes on.
+     *
+     * @throws ProtocolError If a file is continued.
+     */
+    void throw_if_continued_file() const
+    {
+        if (m_continued_file)
+        {
+            throw ProtocolError("File " + m_continued_file->file_name + " not finished before the next file, at " + std::to_string(m_continued_file->size) + " octets");
+        }
+    }
+
+    /**
+     * @brief Starts the opening of the part file of a resumable file, to write it from the offset sent by the client.
+     *
+     * The date and the hash are read from the whole content of the file : once all its data are written, the part file
+     * is read back by an engine thread (`read_back_file()`), so the network thread never reads the disk.
+     *
+     * @throws ProtocolError If no "RESUME:" message was sent for the file, or if the offset is after the bytes written.
+     */
+    void open_part_file()
+    {
+        std::string part_path;
+        uint64_t committed = 0;
+        if (!m_part_journal.find(m_client_token, m_file->file_id, m_file->expected_size, part_path, committed))
+        {
+            throw ProtocolError("Resumable file " + m_file->file_name + " sent without resume message");
+        }
+        if (m_file->start_offset > committed)
+        {
+            throw ProtocolError("File " + m_file->file_name + " resumed at " + std::to_string(m_file->start_offset) + " octets, only " + std::to_string(committed) + " octets were received");
+        }
+
+        m_file->size = m_file->start_offset;
+        m_file->output = m_write_engine.open_part(part_path, m_file->file_name, m_file->expected_size, make_error_handler());
+    }
+
+    /**
+     * @brief Reads back a received file once all its data are written, for its date and its hash, then runs a function
+     * on the session strand.
+     *
+     * The file is read by an engine thread, after the writes of the file. A read failure is given to the function,
+     * which rejects only this file.
+     *
+     * @param file The received file, its size set.
+     * @param output The file on disk.
+     * @param function The function to run once the file is read, it receives the session and false if the file can't be read.
+     */
+    template <class Function>
+    void read_back_file(const std::shared_ptr<ReceivedFile>& file, const std::shared_ptr<FileWriteEngine::File>& output, Function&& function)
+    {
+        std::shared_ptr<bool> is_read = std::make_shared<bool>(false);
+        m_write_engine.run_read_job(output, [file, output, is_read]() {
+            try
+            {
+                read_back(*file, output->full_path, file->size);
+                *is_read = true;
+            }
+            catch (const std::ios_base::failure& error)
+            {
+                std::cerr << error.what() << std::endl;
+            }
+            }, make_engine_handler([is_read, function = std::forward<Function>(function)](std::shared_ptr<Session> self) mutable {
+                function(self, *is_read);
+                }));
+    }
+
+    /**
+     * @brief Removes a received file that can't be read back, and acknowledges it with `ACK_CHECKSUM` so the client sends it again.
+     */
+    void reject_unreadable_file(std::shared_ptr<ReceivedFile> file)
+    {
+        m_write_engine.discard(file->output);
+        if (file->is_part)
+        {
+            m_part_journal.finish(m_client_token, file->file_id, this); // the client sends the whole file again
+        }
+        ServerMetrics::add(m_metrics.files_discarded, 1);
+        std::cout << "File rejected, it can't be read back : " << file->file_name << " (" << file->size << " octets)" << std::endl;
+        acknowledge(std::move(file), ACK_CHECKSUM);
+    }
+
+    /**
+     * @brief Feeds the first bytes of a file written on disk to the metadata date reader and the content hasher of a received file.
+     *
+     * @param file The received file.
+     * @param full_path The path of the file on disk.
+     * @param size The number of bytes to read.
+     *
+     * @throws std::ios_base::failure If the file can't be read up to the size.
+     */
+    static void read_back(ReceivedFile& file, const std::string& full_path, uint64_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        std::ifstream disk_file(full_path, std::ios::binary);
+        std::vector<uint8_t> buffer(RECEIVE_CHUNK_SIZE);
+        for (uint64_t remaining_size = size; remaining_size > 0;)
+        {
+            const std::size_t read_size = static_cast<std::size_t>(std::min<uint64_t>(remaining_size, buffer.size()));
+            if (!disk_file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(read_size)))
+            {
+                throw std::ios_base::failure("Failed to read back file: " + full_path);
+            }
+            file.metadata_date_reader.feed(buffer.data(), read_size);
+            file.content_hasher.feed(buffer.data(), read_size);
+            remaining_size -= read_size;
+        }
+    }
+
+    /**
+     * @brief Joins the striped file of a range, the session of the first range opens the file with its whole size.
+     *
+     * @throws ProtocolError If the range starts after the end of the file.
+     */
+    void open_range_file()
+    {
+        if (m_file->expected_size == 0 || m_file->start_offset >= m_file->expected_size)
+        {
+            throw ProtocolError("Range of file " + m_file->file_name + " starts at " + std::to_string(m_file->start_offset) + " octets, after its end at " + std::to_string(m_file->expected_size) + " octets");
+        }
+
+        std::shared_ptr<StripedFile> striped_file = m_striped_file_table.join(m_file->file_id, m_file->file_name, m_file->last_modified, m_file->expected_size, [this]() {
+            return m_write_engine.open(m_file->file_name, m_file->expected_size, make_error_handler());
+            });
+
+        m_file->striped_file = striped_file;
+        m_file->output = striped_file->output();
+        m_file->size = m_file->start_offset;
+    }
+
+    /**
+     * @brief Ends the range of a striped file fully received, and finalizes the file if it was the last one.
+     *
+     * When the data of a range don't match their checksum, the file is removed once no range of it is being received,
+     * and every range is acknowledged with `ACK_CHECKSUM`.
+     *
+     * @throws ProtocolError If the range overlaps another range or goes after the end of the file.
+     */
+    void finish_range()
+    {
+        std::erase_if(m_waiting_striped_files, [](const std::shared_ptr<StripedFile>& waiting_file) {
+            return waiting_file->is_finished();
+            });
+
+        const std::shared_ptr<StripedFile> striped_file = m_file->striped_file;
+        StripedFile::RangeEnd range_end = striped_file->end_range(m_file->start_offset, m_file->size, is_checksum_valid(*m_file), { shared_from_this(), m_file });
+        m_waiting_striped_files.push_back(striped_file);
+
+        if (range_end.is_first_corrupt)
+        {
+            ServerMetrics::add(m_metrics.files_checksum_failed, 1);
+            std::cout << "File rejected, a range doesn't match its checksum : " << m_file->file_name << std::endl;
+        }
+        if (range_end.is_discarded)
+        {
+            discard_striped_file(*striped_file);
+        }
+
+        // The ranges ended are acknowledged as rejected at once, the next ones when they end, the client sends the file again
+        reject_striped_ranges(range_end.rejected_ranges, false);
+
+        if (range_end.is_complete)
+        {
+            finalize_striped_file(striped_file);
+        }
+    }
+
+    /**
+     * @brief Finalizes a striped file once all its ranges are written, on the strand of the session that wrote the last bytes.
+     *
+     * The file is read back for its date and hash by an engine thread (`read_back_file()`), the ACKs are sent from its
+     * handler. Then the file is handled like a file received on one connection : removed if it's a duplicate, else
+     * closed with its date. The ACK is sent to every session that sent a range, the first range gets the times of the
+     * file. A file that can't be read back is removed and acknowledged with `ACK_CHECKSUM` on every range.
+     *
+     * @param striped_file The striped file, marked finished.
+     */
+    void finalize_striped_file(const std::shared_ptr<StripedFile>& striped_file)
+    {
+        m_striped_file_table.remove(*striped_file);
+        const std::vector<StripedFile::EndedRange> ended_ranges = striped_file->take_ended_ranges();
+
+        // The first range holds the state of the whole file, the file is timed from the start of its first range
+        std::shared_ptr<ReceivedFile> file = ended_ranges.front().second;
+        for (const auto& [session, range] : ended_ranges)
+        {
+            file->timings.receive_start = std::min(file->timings.receive_start, range->timings.receive_start);
+            file->timings.receive_end = std::max(file->timings.receive_end, range->timings.receive_end);
+        }
+        file->size = striped_file->size();
+
+        auto send_acks = [ended_ranges](const char* ack) {
+            for (const auto& [session, range] : ended_ranges)
+            {
+                net::post(session->m_ws.get_executor(), [session = session, range = range, file = ended_ranges.front().second, ack]() {
+                    if (range == file)
+                    {
+                        session->send_ack(file, ack);
+                    }
+                    else
+                    {
+                        session->send_text(std::string(ack) + ":" + std::to_string(range->file_id));
+                    }
+                    });
+            }
+            };
+
+        read_back_file(file, striped_file->output(), [file, range_count = ended_ranges.size(), send_acks](std::shared_ptr<Session> self, bool is_read) {
+            if (!is_read)
+            {
+                self->m_write_engine.discard(file->output);
+                ServerMetrics::add(self->m_metrics.files_discarded, 1);
+                std::cout << "File rejected, it can't be read back : " << file->file_name << " (" << file->size << " octets in " << range_count << " ranges)" << std::endl;
+                send_acks(ACK_CHECKSUM);
+                return;
+            }
+            self->check_striped_file(file, range_count, send_acks);
+            });
+    }
+
+    /**
+     * @brief Looks for a saved file with the same content as a striped file read back, then closes the file or removes it as a duplicate.
+     *
+     * @param file The state of the whole file, held by its first range.
+     * @param range_count The number of ranges of the file.
+     * @param send_acks Sends an acknowledgment to the session of each range.
+     */
+    template <class SendAcks>
+    void check_striped_file(const std::shared_ptr<ReceivedFile>& file, std::size_t range_count, const SendAcks& send_acks)
+    {
+        const uint64_t content_hash = file->content_hasher.digest();
+        find_duplicate(*file, content_hash, file->output, nullptr, [file, content_hash, range_count, send_acks](std::shared_ptr<Session> self, const std::string& duplicate_path) {
+            if (!duplicate_path.empty())
+            {
+                self->m_write_engine.discard(file->output);
+                self->m_saved_file_index.add(file->file_name, file->last_modified, content_hash, file->size, duplicate_path);
+                ServerMetrics::add(self->m_metrics.files_duplicate, 1);
+                if (self->m_log_files)
+                {
+                    std::cout << "File duplicate : " << file->file_name << " (" << file->size << " octets in " << range_count << " ranges), same content as " << duplicate_path << std::endl;
+                }
+                send_acks(ACK_DUPLICATE);
+                return;
+            }
+            self->close_striped_file(file, content_hash, range_count, send_acks);
+            });
+    }
+
+    /**
+     * @brief Closes a striped file that is not a duplicate, with the date read from its first bytes.
+     *
+     * @param file The state of the whole file, held by its first range.
+     * @param content_hash The hash of the content.
+     * @param range_count The number of ranges of the file.
+     * @param send_acks Sends an acknowledgment to the session of each range.
+     */
+    template <class SendAcks>
+    void close_striped_file(const std::shared_ptr<ReceivedFile>& file, uint64_t content_hash, std::size_t range_count, const SendAcks& send_acks)
+    {
+        const MetadataDate metadata_date = file->metadata_date_reader.read_date();
+        const double date = metadata_date.status == MetadataDateStatus::found ? metadata_date.date : file->last_modified;
+        const bool no_error = metadata_date.status != MetadataDateStatus::corrupt;
+
+        file->timings.stamping_start = std::chrono::steady_clock::now();
+        m_write_engine.close(file->output, date, make_engine_handler([file, no_error, content_hash, range_count, send_acks](std::shared_ptr<Session> self) {
+            file->timings.stamping_end = std::chrono::steady_clock::now();
+
+            self->m_saved_file_index.add(file->file_name, file->last_modified, content_hash, file->size, file->output->full_path);
+            if (self->m_log_files)
+            {
+                std::cout << "File save : " << file->file_name << " (" << file->size << " octets in " << range_count << " ranges)" << std::endl;
+            }
+
+            if (!no_error)
+            {
+                ServerMetrics::add(self->m_metrics.files_warning, 1);
+            }
+            self->commit_file(*file, [send_acks, ack = no_error ? ACK_MESSAGE : ACK_WARNING](std::shared_ptr<Session>) {
+                send_acks(ack);
+                });
+            }));
+    }
+
+    /**
+     * @brief Removes a failed striped file, after a lost connection or a corrupt range, once no range of it is being received.
+     *
+     * @param striped_file The striped file, marked finished by the call to `StripedFile` that failed it.
+     */
+    void discard_striped_file(const StripedFile& striped_file)
+    {
+        // All the writes of the file are queued, the removal runs after them
+        m_write_engine.discard(striped_file.output());
+        m_striped_file_table.remove(striped_file);
+        ServerMetrics::add(m_metrics.files_discarded, 1);
+        std::cout << "File discard, a range of the file is missing or corrupt : " << striped_file.file_name() << std::endl;
+    }
+
+    /**
+     * @brief Acknowledges the ranges of a failed striped file with `ACK_CHECKSUM`, on the strand of their sessions.
+     *
+     * @param ranges The ranges given back by `StripedFile` when it failed.
+     * @param is_leaving true if this session is leaving, its own ranges are not acknowledged.
+     */
+    void reject_striped_ranges(const std::vector<StripedFile::EndedRange>& ranges, bool is_leaving)
+    {
+        for (const auto& [session, range] : ranges)
+        {
+            if (is_leaving && session.get() == this)
+            {
+                continue;
+            }
+            net::post(session->m_ws.get_executor(), [session = session, file_id = range->file_id]() {
+                session->send_text(std::string(ACK_CHECKSUM) + ":" + std::to_string(file_id));
+                });
+        }
+    }
+
+    /**
+     * @brief Finishes a fully received binary message.
+     *
+     * The file of the message is finished by `finish_received_file()`, a range by `finish_range()`. A batch is
+     * acknowledged once all its files are saved, the files were finished one by one while they were received.
+     * A file whose content goes on in the next message is kept open, once the checksum of this message is checked.
+     *
+     * @throws ProtocolError If the message was too short to contain the header and the file name,
+     * if the data received don't match the file size announced by a protocol version 2 client,
+     * or if a batch ends before its last file.
+     */
+    void finish_binary_message()
+    {
+        if (m_batch)
+        {
+            m_batch->end_message(m_file || !m_header.empty());
+            send_batch_ack(*m_batch);
+            m_batch.reset();
+            m_header.reset();
+            return;
+        }
+
+        // Vrifier la longueur minimale pour contenir un prfixe
+        if (!m_file)
+        {
+            throw ProtocolError("Binary data too short to be parse into file");
+        }
+
+        if (m_file->is_continued)
+        {
+            m_file->is_checksum_failed = !is_checksum_valid(*m_file);
+            m_file->checksum = Crc32c();
+            m_continued_file = std::move(m_file);
+            m_header.reset();
+            return;
+        }
+
+        if (m_file->striped_file)
+        {
+            m_file->timings.receive_end = std::chrono::steady_clock::now();
+            finish_range();
+            m_file.reset();
+            m_header.reset();
+            return;
+        }
+
+        if (m_protocol_version >= 2 && m_file->size != m_file->expected_size)
+        {
+            throw ProtocolError("File " + m_file->file_name + " received with " + std::to_string(m_file->size) + " octets instead of " + std::to_string(m_file->expected_size));
+        }
+
+        finish_received_file();
+        m_header.reset();
+    }
+
+    /**
+     * @brief Finishes the current file once all its data are received.
+     *
+     * The date a photo or a video was taken, read from the data received, replaces the last modified date
+     * sent by the client. The date is applied by the write engine on the file opened for writing, so the file
+     * is never opened again. The closing of the file runs after its last write, the acknowledgment is sent
+     * back to the client once it is done, with a warning if the data are corrupt (like a JPEG that contains no image).
+     * A file with the same hash as a file already saved is compared with it byte for byte once its writes are done, on an
+     * engine thread, and if the contents are the same it's removed and acknowledged at once
+     * as a duplicate. Both are added to the index of saved files, the file once closed. The line of the saved file is written on the console only if `log_files` is set.
+     * The part file of a resumable file is renamed into place by the close, then the file is removed from the part journal.
+     * A file whose data don't match the checksum sent by the client is removed, with its part file, and acknowledged with
+     * `ACK_CHECKSUM` so the client sends it again.
+     */
+    void finish_received_file()
+    {
+        m_file->timings.receive_end = std::chrono::steady_clock::now();
+
+        if (!is_checksum_valid(*m_file))
+        {
+            m_write_engine.discard(m_file->output);
+            if (m_file->is_part)
+            {
+                m_part_journal.finish(m_client_token, m_file->file_id, this); // the client sends the whole file again
+            }
+            reject_corrupt_file(std::move(m_file));
+            return;
+        }
+
+        if (m_file->start_offset > 0)
+        {
+            read_back_file(m_file, m_file->output, [file = m_file](std::shared_ptr<Session> self, bool is_read) {
+                if (!is_read)
+                {
+                    self->reject_unreadable_file(file);
+                    return;
+                }
+                self->check_received_file(file);
+                });
+            m_file.reset();
+            return;
+        }
+
+        check_received_file(std::move(m_file));
+    }
+
+    /**
+     * @brief Looks for a saved file with the same content as a received file, then closes the file or removes it as a duplicate.
+     */
+    void check_received_file(std::shared_ptr<ReceivedFile> file)
+    {
+        const uint64_t content_hash = file->content_hasher.digest();
+        find_duplicate(*file, content_hash, file->output, nullptr, [file, content_hash](std::shared_ptr<Session> self, const std::string& duplicate_path) {
+            if (!duplicate_path.empty())
+            {
+                self->m_write_engine.discard(file->output);
+                if (file->is_part)
+                {
+                    self->m_part_journal.finish(self->m_client_token, file->file_id, self.get());
+                }
+                self->record_duplicate(*file, content_hash, duplicate_path);
+                self->acknowledge(file, ACK_DUPLICATE);
+                return;
+            }
+            self->close_received_file(file, content_hash);
+            });
+    }
+
+    /**
+     * @brief Closes a received file that is not a duplicate, with the date read from its data.
+     */
+    void close_received_file(const std::shared_ptr<ReceivedFile>& file, uint64_t content_hash)
+    {
+        const MetadataDate metadata_date = file->metadata_date_reader.read_date();
+        const double date = metadata_date.status == MetadataDateStatus::found ? metadata_date.date : file->last_modified;
+        const bool no_error = metadata_date.status != MetadataDateStatus::corrupt;
+
+        file->timings.stamping_start = std::chrono::steady_clock::now();
+        m_write_engine.close(file->output, date, make_engine_handler([file, no_error, content_hash](std::shared_ptr<Session> self) {
+            file->timings.stamping_end = std::chrono::steady_clock::now();
+
+            if (file->is_part)
+            {
+                self->m_part_journal.finish(self->m_client_token, file->file_id, self.get());
+            }
+            self->on_file_saved(file, no_error, content_hash);
+            }));
+    }
+
+    /**
+     * @brief Looks for a saved file with the same content as a received file, then runs a function on the session strand
+     * with its path, empty if there is none.
+     *
+     * A saved file with the same hash and size is compared byte for byte with the content on an engine thread : with
+     * the content in memory, or with the received file once its writes are done. The function runs at once when
+     * no saved file has the same hash.
+     *
+     * @param file The received file, its size set.
+     * @param content_hash The hash of its content.
+     * @param output The received file on disk, null if its content is in memory.
+     * @param data The content in memory, must stay valid until the function runs, null if the file is on disk.
+     * @param function The function, it receives the session and the path of the duplicate.
+     */
+    template <class Function>
+    void find_duplicate(const ReceivedFile& file, uint64_t content_hash, const std::shared_ptr<FileWriteEngine::File>& output, const uint8_t* data, Function&& function)
+    {
+        const std::string duplicate_path = m_dedupe ? m_saved_file_index.find_duplicate(content_hash, file.size) : std::string();
+        if (duplicate_path.empty())
+        {
+            function(shared_from_this(), duplicate_path);
+            return;
+        }
+
+        std::shared_ptr<bool> is_same = std::make_shared<bool>(false);
+        m_write_engine.run_read_job(output, [is_same, duplicate_path, output, data, size = file.size]() {
+            *is_same = data ? SavedFileIndex::has_content(duplicate_path, data, size) : SavedFileIndex::has_same_content(output->full_path, duplicate_path, size);
+            }, make_engine_handler([is_same, duplicate_path, function = std::forward<Function>(function)](std::shared_ptr<Session> self) mutable {
+                function(self, *is_same ? duplicate_path : std::string());
+                }));
+    }
+
+    /**
+     * @brief Checks the data received for a file against the checksum sent by the client, if any, and the data of its previous messages.
+     */
+    static bool is_checksum_valid(const ReceivedFile& file)
+    {
+        return !file.is_checksum_failed && (!file.has_checksum || file.checksum.digest() == file.expected_checksum);
+    }
+
+    /**
+     * @brief Acknowledges a file whose data don't match their checksum, its data are already removed or never written.
+     */
+    void reject_corrupt_file(std::shared_ptr<ReceivedFile> file)
+    {
+        ServerMetrics::add(m_metrics.files_checksum_failed, 1);
+        std::cout << "File rejected, its data don't match their checksum : " << file->file_name << " (" << file->size << " octets)" << std::endl;
+        acknowledge(std::move(file), ACK_CHECKSUM);
+    }
+
+    /**
+     * @brief Adds a duplicate file to the index of saved files, with the path of the file that has its content.
+     */
+    void record_duplicate(const ReceivedFile& file, uint64_t content_hash, const std::string& duplicate_path)
+    {
+        m_saved_file_index.add(file.file_name, file.last_modified, content_hash, file.size, duplicate_path);
+        ServerMetrics::add(m_metrics.files_duplicate, 1);
+        if (m_log_files)
+        {
+            std::cout << "File duplicate : " << file.file_name << " (" << file.size << " octets), same content as " << duplicate_path << std::endl;
+        }
+    }
+
+    /**
+     * @brief Adds a file closed on disk to the index of saved files, and acknowledges it once it's on disk.
+     *
+     * @param file The saved file.
+     * @param no_error false if the data of the file are corrupt, it's acknowledged with a warning.
+     * @param content_hash The hash of the content of the file.
+     */
+    void on_file_saved(std::shared_ptr<ReceivedFile> file, bool no_error, uint64_t content_hash)
+    {
+        m_saved_file_index.add(file->file_name, file->last_modified, content_hash, file->size, file->output->full_path);
+
+        if (m_log_files)
+        {
+            std::cout << "File save : " << file->file_name << " (" << file->size << " octets"
+                << (file->start_offset > 0 ? ", resumed at " + std::to_string(file->start_offset) : std::string()) << ")"
+                << " [save queue : " << m_write_engine.queue_depth() << "/" << m_write_engine.max_queue_depth()
+                << ", peak " << m_write_engine.peak_queue_depth() << "]" << std::endl;
+        }
+
+        if (!no_error)
+        {
+            ServerMetrics::add(m_metrics.files_warning, 1);
+        }
+        commit_file(*file, [file, ack = no_error ? ACK_MESSAGE : ACK_WARNING](std::shared_ptr<Session> self) {
+            self->acknowledge(file, ack);
+            });
+    }
+
+    /**
+     * @brief Acknowledges a file : at once, or with the other files of its batch once they are all saved.
+     *
+     * @param file The file.
+     * @param ack `ACK_MESSAGE`, `ACK_WARNING`, `ACK_DUPLICATE` or `ACK_CHECKSUM`.
+     */
+    void acknowledge(std::shared_ptr<ReceivedFile> file, const char* ack)
+    {
+        if (!file->batch)
+        {
+            send_ack(std::move(file), ack);
+            return;
+        }
+
+        // The file leaves its batch, so the batch and its saved files don't hold each other
+        std::shared_ptr<ReceivedBatch> batch = std::move(file->batch);
+        const char status = ack == ACK_DUPLICATE ? 'd' : ack == ACK_CHECKSUM ? 'c' : ack == ACK_WARNING ? 'w' : 'r';
+        const bool is_kept = ack != ACK_DUPLICATE && ack != ACK_CHECKSUM; // the times of a file not kept are not added to the metrics
+        const uint32_t file_index = file->batch_index;
+        batch->acknowledge(file_index, status, is_kept ? std::move(file) : nullptr);
+        send_batch_ack(*batch);
+    }
+
+    /**
+     * @brief Sends the ACK of a batch, "ACK:batch:<batch id>:" and the status of each file, once the batch
+     * is fully received and all its files are acknowledged.
+     */
+    void send_batch_ack(ReceivedBatch& batch)
+    {
+        if (!batch.is_acknowledged())
+        {
+            return;
+        }
+        send_text(std::string(ACK_BATCH) + ":" + std::to_string(batch.batch_id()) + ":" + batch.statuses(), batch.take_saved_files());
+    }
+
+    /**
+     * @brief Sends the confirmation that a file is saved by the server.
+     *
+     * Protocol version 1 clients only know `ACK_MESSAGE` and `ACK_WARNING`, a duplicate is confirmed to them as received.
+     *
+     * @param file The file, its id is added to the message from protocol version 2.
+     * @param ack `ACK_MESSAGE`, `ACK_WARNING` if the file is saved but its data are corrupt, `ACK_DUPLICATE`, or
+     * `ACK_CHECKSUM` if the data don't match the checksum sent by a protocol version 6 client.
+     */
+    void send_ack(std::shared_ptr<ReceivedFile> file, const char* ack)
+    {
+        const bool is_duplicate = ack == ACK_DUPLICATE;
+        const bool is_kept = !is_duplicate && ack != ACK_CHECKSUM;
+
+        // The message is written in the memory of a message already sent
+        OutgoingMessage message;
+        if (!m_free_messages.empty())
+        {
+            message = std::move(m_free_messages.back());
+            m_free_messages.pop_back();
+        }
+        message.text = ack;
+        if (m_protocol_version >= 2)
+        {
+            char file_id[16];
+            const std::to_chars_result result = std::to_chars(file_id, file_id + sizeof(file_id), file->file_id);
+            message.text.append(1, ':').append(file_id, result.ptr);
+        }
+        else if (is_duplicate)
+        {
+            message.text = ACK_MESSAGE;
+        }
+
+        // The times of a file not kept stop at its receive, they are not added to the metrics
+        if (is_kept)
+        {
+            message.files.push_back(std::move(file));
+        }
+        else
+        {
+            recycle_file(std::move(file));
+        }
+        send_message(std::move(message));
+    }
+
+    /**
+     * @brief Records the times of a file once its ACK is written on the socket.
+     *
+     * @param file The acknowledged file.
+     */
+    void on_ack_sent(ReceivedFile& file)
+    {
+        FileTimings& timings = file.timings;
+        timings.ack_end = std::chrono::steady_clock::now();
+
+        ServerMetrics::add(m_metrics.files_saved, 1);
+        m_metrics.receive_time.observe(timings.receive_end - timings.receive_start);
+        m_metrics.name_resolution_time.observe(file.output->name_resolution_end - file.output->name_resolution_start);
+        m_metrics.metadata_stamping_time.observe(timings.stamping_end - timings.stamping_start);
+        m_metrics.ack_time.observe(timings.ack_end - timings.stamping_end);
+        m_metrics.file_time.observe(timings.ack_end - timings.receive_start);
+
+        if (m_trace_writer)
+        {
+            m_trace_writer->write_file_trace(file.file_name, file.size, timings, file.output->name_resolution_start, file.output->name_resolution_end);
+        }
+    }
+
+    /**
+     * @brief Queues a text message for the client.
+     *
+     * A websocket stream supports only one write at a time, the messages are written one after the other.
+     *
+     * @param message The message to send.
+     * @param files The files acknowledged by the message, empty for other messages.
+     */
+    void send_text(std::string message, std::vector<std::shared_ptr<ReceivedFile>> files = {})
+    {
+        send_message(OutgoingMessage{ std::move(message), std::move(files) });
+    }
+
+    /**
+     * @brief Queues a message for the client, see `send_text()`.
+     */
+    void send_message(OutgoingMessage message)
+    {
+        if (m_close_reason)
+        {
+            return; // closed after an error of the client, the files left are not acknowledged
+        }
+
+        m_write_queue.push_back(std::move(message));
+        if (m_write_queue.size() == 1)
+        {
+            do_write();
+        }
+    }
+
+    /**
+     * @brief Writes the first message of the write queue, then the next ones until the queue is empty.
+     */
+    void do_write()
+    {
+        m_ws.async_write(
+            boost::asio::buffer(m_write_queue.front().text), bind_handler_memory(m_write_memory,
+            [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                if (ec)
+                {
+                    std::cerr << "Error while send ACK : " << ec.message() << std::endl; // the read of the lost connection ends the session
+                    return;
+                }
+
+                OutgoingMessage message = std::move(self->m_write_queue.front());
+                self->m_write_queue.pop_front();
+                for (const std::shared_ptr<ReceivedFile>& file : message.files)
+                {
+                    self->on_ack_sent(*file);
+                }
+                self->recycle_message(std::move(message));
+
+                if (!self->m_write_queue.empty())
+                {
+                    self->do_write();
+                }
+                else if (self->m_close_reason)
+                {
+                    self->do_close();
+                }
+            }));
+    }
+
+    /**
+     * @brief Closes the session after an error of the client, with a WebSocket close code, the other sessions go on.
+     *
+     * The file being received is discarded like after a lost connection. The messages already queued are sent, then
+     * the close frame.
+     *
+     * @param code The close code sent to the client.
+     * @param reason The error, shown on the console.
+     */
+    void close_session(websocket::close_code code, const std::string& reason)
+    {
+        if (m_close_reason)
+        {
+            return;
+        }
+
+        std::cout << "Client rejected : " << reason << std::endl;
+        ServerMetrics::add(m_metrics.sessions_rejected, 1);
+        start_close(code);
+    }
+
+    /**
+     * @brief Closes the session after a failed disk operation (disk full, file that can't be opened, written or
+     * flushed), the other sessions go on.
+     *
+     * The file of the operation isn't acknowledged and the file being received is discarded, the client gets the
+     * close code 1011 and sends the files not acknowledged again on a new connection.
+     *
+     * @param error The error of the write engine.
+     */
+    void fail_session(std::exception_ptr error)
+    {
+        if (m_close_reason)
+        {
+            return; // the next operations of the failed file fail too
+        }
+
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception& exception)
+        {
+            std::cerr << "File save failed : " << exception.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << "File save failed : unknown error" << std::endl;
+        }
+        start_close(websocket::close_code::internal_error);
+    }
+
+    /**
+     * @brief Discards the file being received and sends the close frame once the messages already queued are sent.
+     */
+    void start_close(websocket::close_code code)
+    {
+        m_close_reason = websocket::close_reason(code);
+        discard_received_file();
+        log_compression();
+        if (m_write_queue.empty())
+        {
+            do_close();
+        }
+    }
+
+    /**
+     * @brief Sends the close frame, the connection ends once the client answers.
+     */
+    void do_close()
+    {
+        m_ws.async_close(*m_close_reason, [self = shared_from_this()](beast::error_code) {
+            // the client may be gone already, the session ends with its last handler
+            });
+    }
+
+    /**
+     * @brief Keeps a sent message for the next ACK of a single file, and the files it acknowledged for the next files.
+     */
+    void recycle_message(OutgoingMessage message)
+    {
+        for (std::shared_ptr<ReceivedFile>& file : message.files)
+        {
+            recycle_file(std::move(file));
+        }
+        if (message.text.capacity() <= MAX_KEPT_MESSAGE_SIZE && m_free_messages.size() < MAX_FREE_FILES)
+        {
+            message.text.clear();
+            message.files.clear();
+            m_free_messages.push_back(std::move(message));
+        }
+    }
+
+    /**
+     * @brief Processes a complete text message received from the client.
+     *
+     * With the "HELLO:<version>" message, the session then uses the highest protocol version known by both
+     * sides and answers with this version. A "MANIFEST:" message is answered by `process_manifest()`, a "RESUME:"
+     * message by `process_resume()`. Other messages are only shown.
+     *
+     * @param message The text message.
+     */
+    void process_text_message(const std::string& message)
+    {
+        if (message.rfind(MANIFEST_MESSAGE, 0) == 0)
+        {
+            process_manifest(message);
+            return;
+        }
+
+        if (message.rfind(RESUME_MESSAGE, 0) == 0)
+        {
+            process_resume(message);
+            return;
+        }
+
+        if (message.rfind(HELLO_MESSAGE, 0) != 0)
+        {
+            // this should never happen because we don't do that on HTML client page actualy
+            std::cout << "Message : " << message << std::endl;
+            return;
+        }
+
+        const char* version_begin = message.data() + sizeof(HELLO_MESSAGE) - 1;
+        uint32_t client_version = 1;
+        std::from_chars(version_begin, message.data() + message.size(), client_version);
+
+        m_protocol_version = std::clamp(client_version, 1u, PROTOCOL_VERSION);
+        m_header.set_protocol_version(m_protocol_version);
+        send_text(HELLO_MESSAGE + std::to_string(m_protocol_version));
+    }
+
+    /**
+     * @brief Answers a manifest of client files with the files the server needs.
+     *
+     * The manifest is "MANIFEST:<manifest id>" followed by one line per file, each line starting with "\n" :
+     * "<size>\t<last modified>\t<name>". The answer is "NEED:<manifest id>:" followed by one character per file,
+     * '0' if a file with the same name, size and last modified date was already received and is unchanged on disk,
+     * '1' if it must be sent. A line that can't be read is answered '1', the client then sends the file.
+     *
+     * @param message The manifest message.
+     */
+    void process_manifest(const std::string& message)
+    {
+        constexpr std::size_t id_begin = sizeof(MANIFEST_MESSAGE) - 1;
+        std::size_t line_begin = message.find('\n');
+        const std::string manifest_id = message.substr(id_begin, line_begin == std::string::npos ? std::string::npos : line_begin - id_begin);
+
+        std::string answer = NEED_MESSAGE + manifest_id + ":";
+        std::size_t needed_count = 0;
+        while (line_begin != std::string::npos)
+        {
+            line_begin++;
+            const std::size_t line_end = message.find('\n', line_begin);
+            const std::string_view line(message.data() + line_begin, (line_end == std::string::npos ? message.size() : line_end) - line_begin);
+
+            const bool is_needed = is_file_needed(line);
+            answer += is_needed ? '1' : '0';
+            needed_count += is_needed ? 1 : 0;
+            line_begin = line_end;
+        }
+
+        if (m_log_files)
+        {
+            std::cout << "Manifest : " << answer.size() - sizeof(NEED_MESSAGE) - manifest_id.size() << " files, " << needed_count << " needed" << std::endl;
+        }
+        send_text(std::move(answer));
+    }
+
+    /**
+     * @brief Checks a manifest line "<size>\t<last modified>\t<name>" against the index of saved files.
+     *
+     * @return false if the file is already saved, true if it must be sent or if the line can't be read.
+     */
+    bool is_file_needed(std::string_view line)
+    {
+        const char* position = line.data();
+        const char* end = line.data() + line.size();
+
+        uint64_t size = 0;
+        std::from_chars_result result = std::from_chars(position, end, size);
+        if (result.ec != std::errc() || result.ptr == end || *result.ptr != '\t')
+        {
+            return true;
+        }
+        position = result.ptr + 1;
+
+        double last_modified = 0.0;
+        result = std::from_chars(position, end, last_modified);
+        if (result.ec != std::errc() || result.ptr == end || *result.ptr != '\t')
+        {
+            return true;
+        }
+        position = result.ptr + 1;
+
+        return !m_saved_file_index.contains(std::string(position, end), size, last_modified);
+    }
+
+    /**
+     * @brief Answers the offset from which a client sends a resumable file.
+     *
+     * The message is "RESUME:<client token>:<file id>:<size>:<last modified>:<name>", the file id is chosen by the client
+     * and stays the same across its connections. The answer is "RESUME:<file id>:<offset>", the number of bytes of the
+     * file already written in its part file, 0 for a new file. The client then sends the file from this offset.
+     *
+     * @param message The resume message.
+     *
+     * @throws ProtocolError If the message can't be read.
+     */
+    void process_resume(const std::string& message)
+    {
+        const char* position = message.data() + sizeof(RESUME_MESSAGE) - 1;
+        const char* end = message.data() + message.size();
+
+        auto read_value = [&position, end](auto& value) {
+            const std::from_chars_result result = std::from_chars(position, end, value);
+            if (result.ec != std::errc() || result.ptr == end || *result.ptr != ':')
+            {
+                return false;
+            }
+            position = result.ptr + 1;
+            return true;
+            };
+
+        const char* token_end = std::find(position, end, ':');
+        const std::string client_token(position, token_end);
+        position = token_end == end ? end : token_end + 1;
+
+        uint32_t file_id = 0;
+        uint64_t size = 0;
+        double last_modified = 0.0;
+        if (!PartJournal::is_valid_token(client_token) || !read_value(file_id) || !read_value(size) || !read_value(last_modified))
+        {
+            throw ProtocolError("Resume message can't be read : " + message);
+        }
+
+        m_client_token = client_token;
+        const std::string file_name(position, end);
+        const uint64_t offset = m_part_journal.start(client_token, file_id, file_name, size, last_modified, this);
+        if (offset > 0 && m_log_files)
+        {
+            std::cout << "File resume : " << file_name << " from " << offset << "/" << size << " octets" << std::endl;
+        }
+        send_text(RESUME_MESSAGE + std::to_string(file_id) + ":" + std::to_string(offset));
+    }
+
+    /**
+     * @brief Writes the bytes of the chunk being filled when the session ends, the broken bytes of a client rejected are dropped.
+     */
+    void process_last_bytes()
+    {
+        try
+        {
+            process_binary_frame(std::move(m_read_chunk), std::exchange(m_read_size, 0));
+        }
+        catch (const ProtocolError& error)
+        {
+            std::cerr << "Last bytes dropped : " << error.what() << std::endl;
+        }
+    }
+
+    /**
+     * @brief Removes the file of a message that will never be complete.
+     *
+     * Called when the client leaves in the middle of a file, we don't want to keep a truncated file.
+     * The part file of a resumable file is kept instead, with the bytes of the chunk being filled, and the bytes written
+     * are recorded in the part journal once their writes are done, the client sends the rest on a new connection. A striped file can't be complete without
+     * this session anymore, the striped files it has ranges of are failed. A file whose content goes on in the next message
+     * is handled the same way, between two of its messages.
+     */
+    void discard_received_file()
+    {
+        for (const std::shared_ptr<StripedFile>& striped_file : m_waiting_striped_files)
+        {
+            const StripedFile::RangeEnd range_end = striped_file->fail();
+            if (range_end.is_discarded)
+            {
+                discard_striped_file(*striped_file);
+            }
+            reject_striped_ranges(range_end.rejected_ranges, true);
+        }
+        m_waiting_striped_files.clear();
+        m_batch.reset();
+
+        if (!m_file && m_continued_file)
+        {
+            // The chunk being filled holds the header of the next chunk of the file, then its first bytes
+            if (m_continued_file->is_part && m_read_size > 0)
+            {
+                process_last_bytes();
+            }
+            if (!m_file)
+            {
+                m_file = std::move(m_continued_file);
+            }
+        }
+
+        if (!m_file)
+        {
+            return;
+        }
+
+        if (m_file->striped_file)
+        {
+            const StripedFile::RangeEnd range_end = m_file->striped_file->abort_range();
+            if (range_end.is_discarded)
+            {
+                discard_striped_file(*m_file->striped_file);
+            }
+            reject_striped_ranges(range_end.rejected_ranges, true);
+            m_file.reset();
+            return;
+        }
+
+        if (m_file->is_part && m_file->output) // no output : the part file was refused before its open
+        {
+            // The bytes of the chunk not full yet are written before, the client doesn't send them again
+            if (m_read_size > 0)
+            {
+                process_last_bytes();
+            }
+            const uint64_t committed = m_file->size;
+            m_write_engine.detach(m_file->output, make_engine_handler([file_id = m_file->file_id, committed](std::shared_ptr<Session> self) {
+                self->m_part_journal.commit(self->m_client_token, file_id, committed, self.get());
+                }));
+            std::cout << "File paused, client leave before end of file : " << m_file->file_name << " (" << committed << "/" << m_file->expected_size << " octets kept)" << std::endl;
+            m_file.reset();
+            return;
+        }
+
+        if (m_file->output) // a file of a batch is opened once its content comes
+        {
+            m_write_engine.discard(m_file->output);
+        }
+        ServerMetrics::add(m_metrics.files_discarded, 1);
+        std::cout << "File discard, client leave before end of file : " << m_file->file_name << std::endl;
+        m_file.reset();
+    }
+
+    /**
+     * @brief Handles the WebSocket handshake result.
+     *
+     * This function is called after the asynchronous WebSocket handshake is completed.
+     * If the handshake is successful, it begins reading data from the client.
+     *
+     * @param ec The error code indicating the result of the handshake.
+     */
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+        {
+            std::cerr << "Handshake failed : " << ec.message() << std::endl; // the client is gone, not the server
+            return;
+        }
+        // After accept new client we launch infinite do_read func for get all this files send
+        std::cout << "Connection with client accept" << (m_is_deflate ? " (compressed)" : "") << std::endl;
+        m_network_bytes_start = m_network_bytes_counted = m_ws.next_layer().bytes_read();
+        do_read();
+    }
+
+    /**
+     * @brief Offers the permessage-deflate extension when the upgrade request asks `DEFLATE_PATH` and offers it.
+     *
+     * The browsers compress every message of a connection once the extension is negotiated, they can't skip a file
+     * already compressed : the client opens a second connection on `DEFLATE_PATH` for the files worth compressing,
+     * and sends the others on its main connection, never slowed down by deflate. The window of the client messages
+     * is kept at its full size for the ratio, the server sends only short ACKs, compressed with a small window and
+     * little memory. The reads of a compressed session are timed, for the time spent to inflate the messages.
+     */
+    void set_deflate()
+    {
+        const auto extensions = m_upgrade_request.find(http::field::sec_websocket_extensions);
+        m_is_deflate = m_deflate && m_upgrade_request.target() == DEFLATE_PATH
+            && extensions != m_upgrade_request.end() && extensions->value().find("permessage-deflate") != beast::string_view::npos;
+        if (!m_is_deflate)
+        {
+            return;
+        }
+
+        websocket::permessage_deflate deflate;
+        deflate.server_enable = true;
+        deflate.client_max_window_bits = DEFLATE_CLIENT_WINDOW_BITS;
+        deflate.server_max_window_bits = DEFLATE_SERVER_WINDOW_BITS;
+        deflate.server_no_context_takeover = true;
+        deflate.memLevel = DEFLATE_SERVER_MEMORY_LEVEL;
+        deflate.compLevel = DEFLATE_SERVER_COMPRESSION_LEVEL;
+        m_ws.set_option(deflate);
+        m_ws.next_layer().enable_timing();
+    }
+
+    /**
+     * @brief Sets the timeouts of the WebSocket : the handshake, and the connection of a client gone without closing it,
+     * like a phone gone off Wi-Fi. The server pings an idle connection, the browsers answer, so only a connection
+     * that receives nothing anymore times out, and its session ends with the bytes of its file recorded for the resume.
+     */
+    void set_timeout()
+    {
+        websocket::stream_base::timeout timeout = websocket::stream_base::timeout::suggested(beast::role_type::server);
+        timeout.keep_alive_pings = true;
+        m_ws.set_option(timeout);
+    }
+
+    /**
+     * @brief Counts the bytes of messages read by a compressed session, with the bytes read from the network for them
+     * and the time spent to decode them, in the server metrics.
+     *
+     * Called first by each read handler, so the processing of the session isn't timed.
+     *
+     * @param size The number of bytes of messages read.
      */
-    explicit Session(tcp::socket socket)
-        : m_ws(std::move(socket))
+    void count_read(std::size_t size)
     {
-        [[maybe_unused]] std::size_t last_value = m_ws.read_message_max();
-        m_ws.read_message_max(2'147'483'648); // 2 GO max size file receive, if more you need incr value, make a dev for cut un part or discard file
+        if (!m_is_deflate)
+        {
+            return;
+        }
+
+        MeteredStream<session_socket>& stream = m_ws.next_layer();
+        stream.stop_timing();
+        m_message_bytes += size;
+        ServerMetrics::add(m_metrics.deflate_message_bytes, size);
+        ServerMetrics::add(m_metrics.deflate_network_bytes, stream.bytes_read() - std::exchange(m_network_bytes_counted, stream.bytes_read()));
+        const std::chrono::steady_clock::duration decode_time = stream.processing_time() - std::exchange(m_decode_time_counted, stream.processing_time());
+        ServerMetrics::add(m_metrics.deflate_decode_ns, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(decode_time).count()));
     }
 
     /**
-     * @brief Starts the WebSocket session by performing the handshake.
-     *
-     * The `run()` function begins the WebSocket handshake asynchronously and, upon success,
-     * transitions to reading messages from the client. The handshake ensures the WebSocket
-     * protocol is properly established.
+     * @brief Writes on the console the bytes saved by the compression of the session, against the time spent to inflate them.
      */
-    void run()
+    void log_compression() const
     {
-        m_ws.async_accept([self = shared_from_this()](beast::error_code ec) {
-            self->on_accept(ec);
-            });
-    }
+        if (!m_is_deflate || m_message_bytes == 0)
+        {
+            return;
+        }
 
-private:
-    websocket::stream<tcp::socket> m_ws;
-    beast::flat_buffer m_buffer;
+        const uint64_t network_bytes = m_ws.next_layer().bytes_read() - m_network_bytes_start;
+        const int64_t saved_percent = (static_cast<int64_t>(m_message_bytes) - static_cast<int64_t>(network_bytes)) * 100 / static_cast<int64_t>(m_message_bytes);
+        const auto decode_ms = std::chrono::duration_cast<std::chrono::milliseconds>(m_ws.next_layer().processing_time()).count();
+        std::cout << "Compression : " << m_message_bytes << " bytes of messages received in " << network_bytes << " bytes ("
+            << saved_percent << " % saved), " << decode_ms << " ms to inflate them" << std::endl;
+    }
 
     /**
-     * @brief Processes binary messages received from the WebSocket client.
+     * @brief Restarts the reading of a paused session.
      *
-     * This function interprets binary data in a custom format. The data contains:
-     * - A file name length (4 bytes).
-     * - The file's last modification timestamp (8 bytes, double).
-     * - The file name (variable length).
-     * - The file content.
+     * Called each time a chunk is given back or the save queue has room again.
+     */
+    void resume_read()
+    {
+        if (m_read_paused)
+        {
+            m_read_paused = false;
+            do_read();
+        }
+    }
+
+    /**
+     * @brief Reads incoming WebSocket message frames from the client.
      *
-     * It extracts these components, saves the file to disk, and sends an acknowledgment back
-     * to the client.
+     * The `do_read()` function waits for data from the client asynchronously. Between two messages, the first bytes
+     * of the next message are read in the idle buffer of the session, at most `IDLE_READ_SIZE` bytes, so a session
+     * waiting for its client holds no chunk. The rest of a binary message is read in chunks, at most
+     * `RECEIVE_CHUNK_SIZE` bytes at a time, and processed each time a chunk is full or the message is done : the bytes
+     * of the idle buffer are copied at the start of the first chunk. A text message is read in the pooled text buffer, and processed once complete.
+     * When the end of a binary message is reached, the received file is finished.
      *
-     * @param buffer A `beast::flat_buffer` containing the binary data from the client.
+     * A chunk is allocated when none is free, if the session has less than `m_max_chunk_count` chunks and the memory
+     * budget has room. The first chunk of the session is allocated even when the budget is exhausted. The read is
+     * paused while no chunk is free, while the budget is exhausted or while the save queue is full, the client is
+     * then slowed down by the TCP flow control until the disk catches up.
      *
-     * @throws std::runtime_error If the binary data is too short or improperly formatted.
+     * @note This function calls itself recursively to handle multiple messages in sequence.
      */
-    void process_binary_message(beast::flat_buffer& buffer)
+    void do_read()
     {
-        const uint8_t* data = boost::asio::buffer_cast<const uint8_t*>(buffer.data());
-        const size_t size = buffer.size();
+        if (m_close_reason)
+        {
+            return; // the close reads the end of the connection
+        }
 
-        // Vrifier la longueur minimale pour contenir un prfixe
-        if (size < DATA_FILE_RECEIVE_HEADER_SIZE)
+        if (!m_is_in_message && !m_has_idle_data)
         {
-            throw std::runtime_error("Binary data too short to be parse into file (1)");
+            m_ws.next_layer().start_timing();
+            m_ws.async_read_some(net::buffer(m_idle_buffer), bind_handler_memory(m_read_memory,
+                [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
+                    self->count_read(bytes_transferred);
+                    self->on_idle_read(ec, bytes_transferred);
+                }));
             return;
         }
 
-        // Extract file name size value (4 octets)
-        const uint32_t name_length = *reinterpret_cast<const uint32_t*>(data);
-        data += 4; // sizeof(uint32_t)
-
-        // Extract last modified date value (8 octets, double, little-endian)
-        const double last_modified = *reinterpret_cast<const double*>(data);
-        data += 8; // sizeof(double)
+        if (!m_has_idle_data && m_ws.got_text())
+        {
+            m_ws.next_layer().start_timing();
+            m_ws.async_read_some(m_text_buffer, RECEIVE_CHUNK_SIZE, bind_handler_memory(m_read_memory,
+                [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
+                    self->count_read(bytes_transferred);
+                    if (ec)
+                    {
+                        self->on_read_error(ec);
+                        return;
+                    }
+                    self->on_text_read();
+                }));
+            return;
+        }
 
-        // Check if data can contain name of file in size
-        if (size < DATA_FILE_RECEIVE_HEADER_SIZE + name_length)
+        if (m_read_size > 0)
         {
-            throw std::runtime_error("Binary data too short to be parse into file (2)");
+            read_chunk();
             return;
         }
 
-        // we can do string view
-        const std::string file_name(reinterpret_cast<const char*>(data), name_length);
+        if (m_free_chunks.empty())
+        {
+            if (m_chunk_count == 0)
+            {
+                m_memory_budget.reserve(RECEIVE_CHUNK_SIZE); // the first chunk, even above the budget
+                add_chunk();
+            }
+            else if (m_chunk_count == m_max_chunk_count || m_is_reserving_chunk)
+            {
+                m_read_paused = true; // resumed when a write operation gives back its chunk, or when the chunk reserved is added
+                return;
+            }
+            else if (m_memory_budget.reserve_or_notify(RECEIVE_CHUNK_SIZE, [self = shared_from_this()]() {
+                net::post(self->m_ws.get_executor(), [self]() {
+                    self->m_is_reserving_chunk = false;
+                    self->add_chunk();
+                    self->resume_read();
+                    });
+                }))
+            {
+                add_chunk();
+            }
+            else
+            {
+                m_is_reserving_chunk = true;
+                m_read_paused = true; // resumed once an other session releases memory for this one
+                return;
+            }
+        }
+
+        const std::shared_ptr<ReceivedFile>& file = m_file ? m_file : m_continued_file;
+        const std::shared_ptr<FileWriteEngine::File> output = file ? file->output : nullptr; // null between files : the next file can go to any storage root
+        if (m_write_engine.is_full(output))
+        {
+            m_read_paused = true;
+            m_write_engine.notify_when_not_full(output, [self = shared_from_this()]() {
+                net::post(self->m_ws.get_executor(), [self]() {
+                    self->resume_read();
+                    });
+                });
+            return;
+        }
 
-        data += name_length;
+        m_read_chunk = std::move(m_free_chunks.back());
+        m_free_chunks.pop_back();
 
-        const uint8_t* file_content = data;
-        const size_t file_size = size - DATA_FILE_RECEIVE_HEADER_SIZE - name_length;
+        if (m_has_idle_data)
+        {
+            std::copy_n(m_idle_buffer.data(), m_idle_size, m_read_chunk.data());
+            m_read_size = m_idle_size;
+            m_has_idle_data = false;
+            if (!m_is_in_message)
+            {
+                on_binary_read();
+                return;
+            }
+        }
 
-        bool no_error = save_file(file_name, file_content, file_size, last_modified);
+        read_chunk();
+    }
 
-        // Send confirmation of file is get by server
-        m_ws.async_write(
-            boost::asio::buffer(no_error ? ACK_MESSAGE : ACK_WARNING),
-            [](beast::error_code ec, std::size_t bytes_transferred) {
+    /**
+     * @brief Reads the next bytes of a binary message in the current chunk, after the bytes already read.
+     *
+     * The size of a read only depends on how the bytes come from the network, often a few kilobytes. The chunk is
+     * processed once full or at the end of the message, so its data are written to the file by a single operation
+     * of the write engine, straight from the chunk they were read in.
+     */
+    void read_chunk()
+    {
+        m_ws.next_layer().start_timing();
+        m_ws.async_read_some(net::buffer(m_read_chunk.data() + m_read_size, m_read_chunk.size() - m_read_size), bind_handler_memory(m_read_memory,
+            [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
+                self->count_read(bytes_transferred);
                 if (ec)
                 {
-                    throw std::runtime_error("Error while send ACK : " + ec.message());
+                    self->on_read_error(ec);
+                    return;
                 }
-            });
+                self->m_is_in_message = !self->m_ws.is_message_done();
+                self->m_read_size += bytes_transferred;
+                if (self->m_is_in_message && self->m_read_size < self->m_read_chunk.size())
+                {
+                    self->read_chunk();
+                    return;
+                }
+                self->on_binary_read();
+            }));
     }
 
     /**
-     * @brief Handles the WebSocket handshake result.
+     * @brief Handles the first bytes of a message, read in the idle buffer.
      *
-     * This function is called after the asynchronous WebSocket handshake is completed.
-     * If the handshake is successful, it begins reading data from the client.
+     * Binary bytes are kept in the idle buffer until a chunk is available, text bytes are moved to the text buffer.
      *
-     * @param ec The error code indicating the result of the handshake.
+     * @param ec The error of the read.
+     * @param size The number of bytes read.
      */
-    void on_accept(beast::error_code ec)
+    void on_idle_read(beast::error_code ec, std::size_t size)
     {
         if (ec)
         {
-            throw std::runtime_error("Error on_accept " + ec.message());
+            on_read_error(ec);
             return;
         }
-        // After accept new client we launch infinite do_read func for get all this files send
-        std::cout << "Connection with client accept" << std::endl;
-        do_read();
+
+        m_is_in_message = !m_ws.is_message_done();
+        if (m_ws.got_binary())
+        {
+            m_idle_size = size;
+            m_has_idle_data = true;
+            do_read();
+            return;
+        }
+
+        m_text_buffer.commit(net::buffer_copy(m_text_buffer.prepare(size), net::buffer(m_idle_buffer.data(), size)));
+        on_text_read();
     }
 
     /**
-     * @brief Reads incoming WebSocket messages from the client.
+     * @brief Processes the bytes of a binary message read in the current chunk, and reads the next ones.
      *
-     * The `do_read()` function waits for a message from the client asynchronously. Once a message
-     * is received, it determines whether it is binary data or a text message. Binary messages are
-     * processed, and the buffer is cleared for the next message.
-     *
-     * @note This function calls itself recursively to handle multiple messages in sequence.
+     * A client that breaks the protocol in the message is rejected, its session is closed.
      */
-    void do_read()
+    void on_binary_read()
     {
-        m_ws.async_read(m_buffer,
-            [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
-                boost::ignore_unused(bytes_transferred);
-                if (ec)
-                {
-                    // if client close, we won't crash server, just notify with console msg
-                    const int error_value = ec.value();
+        try
+        {
+            process_binary_frame(std::move(m_read_chunk), std::exchange(m_read_size, 0));
 
-                    // WSAECONNABORTED -> client close after send file
-                    // boost::asio::error::eof -> client close but never send file
-                    // boost::beast::websocket::error::closed -> an other error of close of html page
-                    if (error_value == WSAECONNABORTED || ec == boost::asio::error::eof || ec == boost::beast::websocket::error::closed)
-                    {
-                        std::cout << "Client close connection, he close his internet page, reload internet page or shutdown." << std::endl;
-                    }
-                    else // else, if it's an unknow error like read fail, we crash server. (we don't want a file download miss at the end)
-                    {
-                        throw std::runtime_error("Async read fail : " + ec.message() + " " + ec.what() + " " + ec.category().name() + " " + std::to_string(ec.value()) + " " + std::to_string(error_value));
-                    }
-                    return;
-                }
-                // Processing of data received here
-                if (self->m_ws.got_binary())
-                {
-                    self->process_binary_message(self->m_buffer);
-                }
-                else
+            if (m_ws.is_message_done())
+            {
+                finish_binary_message();
+                if (!m_continued_file)
                 {
-                    // If it's not binary, show message... this should never happen because we don't do that on HTML client page actualy
-                    std::cout << "Message : " << beast::buffers_to_string(self->m_buffer.data()) << std::endl;
+                    trim_free_chunks(0); // the next message is first read in the idle buffer, the chunks are kept for the next messages of a file
                 }
+            }
+        }
+        catch (const ProtocolError& error)
+        {
+            close_session(websocket::close_code::policy_error, error.what());
+            return;
+        }
 
-                // Clear buffer after we use it
-                self->m_buffer.consume(self->m_buffer.size());
+        // launch another do_read for other file client send
+        do_read();
+    }
 
-                // launch another do_read for other file client send
-                self->do_read();
-            });
+    /**
+     * @brief Processes the text message collected once complete, and reads the next bytes.
+     *
+     * A text message longer than `MAX_TEXT_MESSAGE_SIZE` closes the session, it would hold memory out of the budget.
+     */
+    void on_text_read()
+    {
+        if (m_text_buffer.size() > MAX_TEXT_MESSAGE_SIZE)
+        {
+            m_text_buffer.clear();
+            close_session(websocket::close_code::too_big, "Text message of more than " + std::to_string(MAX_TEXT_MESSAGE_SIZE) + " octets");
+            return;
+        }
+
+        if (m_ws.is_message_done())
+        {
+            m_is_in_message = false;
+            const std::string message = m_text_buffer.to_string();
+            m_text_buffer.clear();
+            try
+            {
+                process_text_message(message);
+            }
+            catch (const ProtocolError& error)
+            {
+                close_session(websocket::close_code::policy_error, error.what());
+                return;
+            }
+        }
+
+        do_read();
+    }
+
+    /**
+     * @brief Ends the session after a failed read, the other sessions go on whatever the error.
+     *
+     * A WebSocket or HTTP error is a client breaking the protocol, counted like the protocol errors of the server.
+     *
+     * @param ec The error of the read.
+     */
+    void on_read_error(beast::error_code ec)
+    {
+        if (m_close_reason)
+        {
+            return; // the session closed itself, its read ends with the close
+        }
+
+        discard_received_file();
+        log_compression();
+
+        // if client close, we won't crash server, just notify with console msg
+        // boost::asio::error::connection_aborted (WSAECONNABORTED) -> client close after send file
+        // boost::asio::error::connection_reset -> client close without websocket close, on Linux
+        // boost::asio::error::eof -> client close but never send file
+        // boost::beast::websocket::error::closed -> an other error of close of html page
+        if (ec == boost::asio::error::connection_aborted || ec == boost::asio::error::connection_reset
+            || ec == boost::asio::error::eof || ec == boost::beast::websocket::error::closed)
+        {
+            std::cout << "Client close connection, he close his internet page, reload internet page or shutdown." << std::endl;
+        }
+        else if (ec == beast::error::timeout)
+        {
+            std::cout << "Client connection timed out, the client is gone without closing it." << std::endl;
+        }
+        else if (ec.category() == websocket::make_error_code(websocket::error::closed).category()
+            || ec.category() == http::make_error_code(http::error::end_of_stream).category())
+        {
+            std::cout << "Client rejected : " << ec.message() << std::endl;
+            ServerMetrics::add(m_metrics.sessions_rejected, 1);
+        }
+        else
+        {
+            std::cerr << "Async read fail : " << ec.message() << " " << ec.category().name() << " " << ec.value() << std::endl;
+        }
     }
 };
 
@@ -281,25 +2367,38 @@ private:
  * It accepts new connections asynchronously and spawns a new session to handle each connection.
  *
  * The `accept()` function is responsible for accepting new client connections asynchronously and
- * invoking the `Session` class to handle communication with the client.
+ * invoking the `Session` class to handle communication with the client. Each accepted socket gets
+ * its own strand, so the sessions can be run by all the threads of the io_context.
+ *
+ * The acceptor listens with `TcpListener` in IPv6 with IPv4 mapped addresses (dual stack), so clients of both families
+ * connect on the same port, or in IPv4 only where IPv6 can't be used. With `reuse_port`, many servers, each with its own io_context
+ * run by one thread, listen on the same port with `SO_REUSEPORT` : the kernel spreads the new connections over their
+ * acceptors, with no lock shared by the threads, and a session is handled by the thread that accepted it for its whole life.
  */
 class WebSocketServer
 {
 public:
-    WebSocketServer(net::io_context& ioc, tcp::endpoint endpoint)
-        : m_acceptor(ioc, endpoint) {
+    WebSocketServer(net::io_context& ioc, uint_least16_t port, bool reuse_port, const SessionContext& session_context)
+        : m_ioc(ioc)
+        , m_acceptor(net::make_strand(ioc))
+        , m_session_context(session_context) {
+        TcpListener::listen(m_acceptor, port, reuse_port);
         accept();
     }
 
+    bool is_dual_stack() const { return m_acceptor.local_endpoint().address().is_v6(); }
+
 private:
     void accept() {
-        m_acceptor.async_accept([this](beast::error_code ec, tcp::socket socket) {
-            if (!ec) std::make_shared<Session>(std::move(socket))->run();
+        m_acceptor.async_accept(net::make_strand(m_ioc), [this](beast::error_code ec, session_socket socket) {
+            if (!ec) std::make_shared<Session>(std::move(socket), m_session_context)->run();
             accept(); // Accept next connections
             });
     }
 
+    net::io_context& m_ioc;
     tcp::acceptor m_acceptor;
+    SessionContext m_session_context;
 };
 
 /**
@@ -314,67 +2413,523 @@ private:
  * @param io_context A reference to the Boost.Asio io_context object, which is used for performing
  * networking operations asynchronously.
  *
+ * @return The first IPv4 address printed, written in the client page served by the server, empty if there is none.
+ *
  * @note The function will only print the IPv4 addresses of the local network interfaces and exclude
  * any non-IPv4 addresses. The printed address can be useful for setting up a server or client connection.
  */
-static void print_local_IPv4(net::io_context& io_context)
+static std::string print_local_IPv4(net::io_context& io_context)
 {
     // local interface list
     boost::asio::ip::tcp::resolver resolver(io_context);
     boost::asio::ip::tcp::resolver::query query(boost::asio::ip::host_name(), "");
     auto results = resolver.resolve(query);
 
+    std::string first_address;
     for (auto const& entry : results)
     {
         auto endpoint = entry.endpoint();
         if (endpoint.address().is_v4())
         {
             std::cout << "Important! Here is your local IPV4 address to indicate on the WEB page : " << endpoint.address().to_string() << std::endl;
+            if (first_address.empty())
+            {
+                first_address = endpoint.address().to_string();
+            }
+        }
+    }
+
+    return first_address;
+}
+
+/**
+ * @function find_client_page
+ * @brief Finds the HTML client page served on the WebSocket port.
+ *
+ * @param client_page_path The page given with `--client-page`, empty to look for `client.html` next to the server
+ * executable, then in the current folder.
+ * @param program_path The path of the server executable, first argument of the program.
+ *
+ * @return The path of the page, empty if it's not found.
+ */
+static std::string find_client_page(const std::string& client_page_path, const char* program_path)
+{
+    if (!client_page_path.empty())
+    {
+        return client_page_path;
+    }
+
+    const std::filesystem::path candidates[] = {
+        std::filesystem::absolute(program_path).parent_path() / CLIENT_PAGE_FILE_NAME,
+        std::filesystem::path(CLIENT_PAGE_FILE_NAME),
+    };
+    for (const std::filesystem::path& candidate : candidates)
+    {
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(candidate, ec))
+        {
+            return candidate.string();
+        }
+    }
+
+    return std::string();
+}
+
+/**
+ * @function parse_command_line
+ * @brief Reads the server settings given on the command line.
+ *
+ * Supported options :
+ * - `--threads <count>` : number of threads running the network io_context (default : number of cores).
+ * - `--save-threads <count>` : number of threads running the disk jobs of the received files, when io_uring is not used (default : 4).
+ * - `--save-queue <depth>` : number of queued disk operations above which sessions stop reading (default : 256).
+ * - `--memory-budget <MB>` : memory for the receive chunks of all the sessions, above which sessions stop reading (default : 256).
+ * - `--session-buffer <MB>` : memory for the receive chunks of a session (default : 4).
+ * - `--sync-io` : writes the files with blocking calls on the save threads, even if io_uring is available.
+ * - `--reuse-port` : on Linux, one io_context and one acceptor on a `SO_REUSEPORT` socket per network thread, instead of
+ *   one io_context run by all the network threads.
+ * - `--durability <none|file|group>` : when a file is acknowledged : once closed, once flushed on disk, or once flushed
+ *   on disk with the other files closed at the same time (default : none).
+ * - `--group-commit-delay <ms>` : time a closed file waits for other files before they are flushed together (default : 5).
+ * - `--dest <folder>` : folder where the received files are saved (default : asked with a folder selection dialog). Given
+ *   several times, the files are spread over the folders, each with its own write queue, the first one keeps the journals
+ *   and the part files.
+ * - `--dest-extensions <ext,ext,...>` : extensions of the files saved in the previous `--dest` folder, with `--placement extension`.
+ * - `--placement <round-robin|least-queued|extension>` : folder of each new file when several are given : the folders one
+ *   after the other, the folder with the fewest bytes waiting to be written, or the folder given for the extension of the
+ *   file, the folders without extensions taking the other files (default : round-robin).
+ * - `--metrics-port <port>` : port of the Prometheus metrics endpoint `/metrics` (default : no endpoint).
+ * - `--trace <file>` : writes the steps of each saved file to a Chrome trace file.
+ * - `--client-page <file>` : HTML client page served to the browsers on port 5000 (default : `client.html` next to the
+ *   server, or in the current folder).
+ * - `--quiet` : no console line for each saved file.
+ * - `--no-dedupe` : saves the files with the same content as a file already saved, like other files.
+ * - `--no-deflate` : no compression, the connections asked on `/deflate` by the client page are accepted without it.
+ *
+ * @param argc Number of arguments.
+ * @param argv Arguments of the program.
+ *
+ * @return The server settings, with default values for options not given.
+ *
+ * @throws std::invalid_argument If an option is unknown or has an invalid value.
+ */
+static ServerOptions parse_command_line(int argc, char* argv[])
+{
+    ServerOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            const int thread_count = std::stoi(argv[++i]);
+            if (thread_count < 1)
+            {
+                throw std::invalid_argument("--threads need at least 1 thread");
+            }
+            options.network_thread_count = static_cast<unsigned int>(thread_count);
+        }
+        else if (arg == "--save-threads" && i + 1 < argc)
+        {
+            const int thread_count = std::stoi(argv[++i]);
+            if (thread_count < 1)
+            {
+                throw std::invalid_argument("--save-threads need at least 1 thread");
+            }
+            options.save_thread_count = static_cast<unsigned int>(thread_count);
+        }
+        else if (arg == "--save-queue" && i + 1 < argc)
+        {
+            const int queue_depth = std::stoi(argv[++i]);
+            if (queue_depth < 1)
+            {
+                throw std::invalid_argument("--save-queue need a depth of at least 1 job");
+            }
+            options.save_queue_depth = static_cast<std::size_t>(queue_depth);
+        }
+        else if (arg == "--memory-budget" && i + 1 < argc)
+        {
+            const int budget_mb = std::stoi(argv[++i]);
+            if (budget_mb < 1)
+            {
+                throw std::invalid_argument("--memory-budget need at least 1 MB");
+            }
+            options.memory_budget = static_cast<std::size_t>(budget_mb) * 1'048'576;
+        }
+        else if (arg == "--session-buffer" && i + 1 < argc)
+        {
+            const int buffer_mb = std::stoi(argv[++i]);
+            if (buffer_mb < 1)
+            {
+                throw std::invalid_argument("--session-buffer need at least 1 MB");
+            }
+            options.session_chunk_count = static_cast<std::size_t>(buffer_mb) * 1'048'576 / RECEIVE_CHUNK_SIZE;
+        }
+        else if (arg == "--sync-io")
+        {
+            options.sync_io = true;
+        }
+        else if (arg == "--reuse-port")
+        {
+            options.reuse_port = true;
+        }
+        else if (arg == "--durability" && i + 1 < argc)
+        {
+            const std::string durability = argv[++i];
+            if (durability == "none")
+            {
+                options.durability = Durability::none;
+            }
+            else if (durability == "file")
+            {
+                options.durability = Durability::file;
+            }
+            else if (durability == "group")
+            {
+                options.durability = Durability::group;
+            }
+            else
+            {
+                throw std::invalid_argument("--durability need none, file or group");
+            }
+        }
+        else if (arg == "--group-commit-delay" && i + 1 < argc)
+        {
+            const int delay_ms = std::stoi(argv[++i]);
+            if (delay_ms < 0)
+            {
+                throw std::invalid_argument("--group-commit-delay need a positive delay");
+            }
+            options.group_commit_delay_ms = static_cast<unsigned int>(delay_ms);
+        }
+        else if (arg == "--dest" && i + 1 < argc)
+        {
+            StorageRootOption storage_root;
+            storage_root.directory = argv[++i];
+            if (!std::filesystem::is_directory(storage_root.directory))
+            {
+                throw std::invalid_argument("--dest folder doesn't exist : " + storage_root.directory);
+            }
+            storage_root.directory = std::filesystem::absolute(storage_root.directory).string(); // the index of saved files keeps the files of the other folders by full path
+            options.storage_roots.push_back(storage_root);
+        }
+        else if (arg == "--dest-extensions" && i + 1 < argc)
+        {
+            if (options.storage_roots.empty())
+            {
+                throw std::invalid_argument("--dest-extensions need a --dest folder before it");
+            }
+
+            std::istringstream extensions(argv[++i]);
+            std::string extension;
+            while (std::getline(extensions, extension, ','))
+            {
+                extension.erase(0, extension.find_first_not_of('.'));
+                if (!extension.empty())
+                {
+                    options.storage_roots.back().extensions.push_back(extension);
+                }
+            }
+        }
+        else if (arg == "--placement" && i + 1 < argc)
+        {
+            const std::string placement = argv[++i];
+            if (placement == "round-robin")
+            {
+                options.placement = Placement::round_robin;
+            }
+            else if (placement == "least-queued")
+            {
+                options.placement = Placement::least_queued;
+            }
+            else if (placement == "extension")
+            {
+                options.placement = Placement::extension;
+            }
+            else
+            {
+                throw std::invalid_argument("--placement need round-robin, least-queued or extension");
+            }
+        }
+        else if (arg == "--metrics-port" && i + 1 < argc)
+        {
+            const int port = std::stoi(argv[++i]);
+            if (port < 1 || port > 65535 || port == APP_PORT)
+            {
+                throw std::invalid_argument("--metrics-port need a free port between 1 and 65535");
+            }
+            options.metrics_port = static_cast<uint_least16_t>(port);
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            options.trace_path = argv[++i];
+        }
+        else if (arg == "--client-page" && i + 1 < argc)
+        {
+            options.client_page_path = argv[++i];
+            if (!std::filesystem::is_regular_file(options.client_page_path))
+            {
+                throw std::invalid_argument("--client-page file doesn't exist : " + options.client_page_path);
+            }
+        }
+        else if (arg == "--quiet")
+        {
+            options.log_files = false;
+        }
+        else if (arg == "--no-dedupe")
+        {
+            options.dedupe = false;
+        }
+        else if (arg == "--no-deflate")
+        {
+            options.deflate = false;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown command line option : " + arg);
         }
     }
+
+    const bool has_extensions = std::any_of(options.storage_roots.begin(), options.storage_roots.end(), [](const StorageRootOption& storage_root) { return !storage_root.extensions.empty(); });
+    if (has_extensions && options.placement != Placement::extension)
+    {
+        throw std::invalid_argument("--dest-extensions need --placement extension");
+    }
+
+    return options;
+}
+
+/**
+ * @function pause_console
+ * @brief Waits for a key press before the server closes on an error, so the message stays readable in the
+ * console window opened for the server on Windows. Does nothing on other systems, where the server runs headless.
+ */
+static void pause_console()
+{
+#ifdef _WIN32
+    system("pause");
+#endif
 }
 
 /**
  * @function main
  * @brief Entry point of the program to initialize and run the application.
  *
- * This function serves as the entry point of the program. It starts by using the Windows File Dialog
- * to allow the user to select a directory where data will be saved. If no folder is selected, the
+ * This function serves as the entry point of the program. It starts by using the folder given with `--dest`,
+ * or the Windows File Dialog to allow the user to select a directory where data will be saved. If no folder is selected, the
  * program terminates early. After that, a Boost.Asio io_context is set up to handle networking tasks,
  * and the local machine's IPv4 address is retrieved. A WebSocket server is then set up to listen for
- * incoming connections on port 5000, bound to all available IPv4 network interfaces. The io_context is
- * started to run the event loop that processes all network-related operations.
+ * incoming connections on port 5000, bound to all available IPv4 and IPv6 network interfaces. The io_context is
+ * started to run the event loop that processes all network-related operations, on as many threads as
+ * asked on the command line (`--threads`, one per core by default). With `--reuse-port`, each thread runs its own
+ * io_context with its own WebSocket server on the same port.
  *
  * @note
  * - If folder selection fails, an error message is displayed, and the program exits with a non-zero status.
- * - The WebSocket server listens on port 5000 for IPv4 connections from any available network interface.
+ * - The WebSocket server listens on port 5000 for IPv4 and IPv6 connections from any available network interface.
+ * - With `--metrics-port`, the metrics are served on this side port by the same io_context.
+ * - An exception thrown by a network thread stops all the threads and is reported like an exception of the main thread.
  */
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
-        global_save_directory_path = WindowsFileDiag::open_select_folder_diag_window();
+        const ServerOptions options = parse_command_line(argc, argv);
+
+        std::vector<StorageRootOption> storage_roots = options.storage_roots;
+        if (storage_roots.empty())
+        {
+            storage_roots.push_back(StorageRootOption{ WindowsFileDiag::open_select_folder_diag_window(), {} });
+        }
+        global_save_directory_path = storage_roots.front().directory;
         if (global_save_directory_path.empty())
         {
             std::cerr << "No folder selected. Server closing." << std::endl;
-            system("pause");
+            pause_console();
             return EXIT_FAILURE;
         }
 
-        net::io_context ioc;
-        print_local_IPv4(ioc);
+        // Scan of the names already taken in each save directory, done once
+        std::vector<std::unique_ptr<FileNameIndex>> file_name_indexes;
+        for (const StorageRootOption& storage_root : storage_roots)
+        {
+            file_name_indexes.push_back(std::make_unique<FileNameIndex>(storage_root.directory, MAX_FILE_SAME_NAME));
+            std::cout << file_name_indexes.back()->size() << " files already in the save directory"
+                << (storage_roots.size() > 1 ? " " + storage_root.directory : std::string()) << std::endl;
+        }
+
+        // Declared before io_context, the sessions destroyed with it still use them
+        ServerMetrics metrics;
+        std::unique_ptr<TraceWriter> trace_writer;
+        if (!options.trace_path.empty())
+        {
+            trace_writer = std::make_unique<TraceWriter>(options.trace_path);
+        }
+
+        // Content hash and client names of the files already saved, kept in a journal of the save directory
+        SavedFileIndex saved_file_index(global_save_directory_path);
+        std::cout << saved_file_index.size() << " files in the index of saved files" << std::endl;
+
+        // Files partly received that their client can resume, kept in a journal of the save directory
+        PartJournal part_journal(global_save_directory_path);
+        std::cout << part_journal.size() << " files partly received can be resumed" << std::endl;
+        StripedFileTable striped_file_table;
+
+        // Declared before io_context, destroyed last : the sessions release their chunks when they are destroyed
+        ReceiveBlockPool block_pool(RECEIVE_CHUNK_SIZE, options.memory_budget / RECEIVE_CHUNK_SIZE);
+        MemoryBudget memory_budget(options.memory_budget);
+        std::cout << "Memory budget : " << options.memory_budget / 1'048'576 << " MB for all the sessions, "
+            << options.session_chunk_count * RECEIVE_CHUNK_SIZE / 1'048'576 << " MB per session" << std::endl;
+
+        // Declared before io_context, the connections loading the page still use it when they are destroyed
+        std::unique_ptr<ClientPage> client_page;
+
+        // One io_context run by all the network threads, or one per network thread with its own acceptor
+        bool reuse_port = options.reuse_port;
+        if (reuse_port && !TcpListener::is_reuse_port_supported())
+        {
+            std::cout << "--reuse-port needs SO_REUSEPORT, not available on this system : one listener for all the network threads" << std::endl;
+            reuse_port = false;
+        }
+        std::vector<std::unique_ptr<net::io_context>> io_contexts;
+        for (unsigned int i = 0; i < (reuse_port ? options.network_thread_count : 1); i++)
+        {
+            io_contexts.push_back(std::make_unique<net::io_context>(reuse_port ? 1 : static_cast<int>(options.network_thread_count)));
+        }
+        const std::string server_address = print_local_IPv4(*io_contexts.front());
+
+        // Read once, compressed and kept in memory with the address of the server
+        client_page = std::make_unique<ClientPage>(find_client_page(options.client_page_path, argv[0]), server_address);
+        if (client_page->has_page())
+        {
+            std::cout << "Client page served on http://" << (server_address.empty() ? "<server>" : server_address) << ":" << APP_PORT << "/ (" << client_page->encodings() << ")" << std::endl;
+        }
+        else
+        {
+            std::cout << "Client page not served : put " << CLIENT_PAGE_FILE_NAME << " next to the server or give it with --client-page" << std::endl;
+        }
+
+        // Write engine of a save directory, with its own queue
+        bool is_io_uring_missing = false;
+        auto create_write_engine = [&options, &is_io_uring_missing](FileNameIndex& file_name_index) {
+            std::unique_ptr<FileWriteEngine> write_engine;
+#ifdef ITLH_IO_URING
+            if (!options.sync_io)
+            {
+                write_engine = IoUringWriteEngine::try_create(file_name_index, options.save_queue_depth, options.durability == Durability::file);
+                is_io_uring_missing = !write_engine;
+            }
+#endif
+            if (!write_engine)
+            {
+                write_engine = std::make_unique<SaveWorkerPool>(file_name_index, options.save_thread_count, options.save_queue_depth, options.durability == Durability::file);
+            }
+            return write_engine;
+            };
 
-        tcp::endpoint endpoint(tcp::v4(), APP_PORT);
-        WebSocketServer server(ioc, endpoint);
+        // Declared after io_context, destroyed first : queued disk operations are finished while io_context still exist
+        std::unique_ptr<FileWriteEngine> write_engine;
+        if (storage_roots.size() == 1)
+        {
+            write_engine = create_write_engine(*file_name_indexes.front());
+        }
+        else
+        {
+            std::unique_ptr<ShardedWriteEngine> sharded_write_engine = std::make_unique<ShardedWriteEngine>(options.placement);
+            for (std::size_t i = 0; i < storage_roots.size(); i++)
+            {
+                sharded_write_engine->add_root(storage_roots[i].directory, create_write_engine(*file_name_indexes[i]), storage_roots[i].extensions);
+            }
+            write_engine = std::move(sharded_write_engine);
+        }
+        if (is_io_uring_missing)
+        {
+            std::cout << "io_uring not available on this kernel, files are written by the save threads" << std::endl;
+        }
+        std::cout << "File write engine : " << write_engine->name() << std::endl;
+        if (storage_roots.size() > 1)
+        {
+            const char* placement_names[] = { "round-robin", "least-queued", "extension" };
+            std::cout << "Storage roots : " << storage_roots.size() << " save directories, each with its own write queue, placement "
+                << placement_names[static_cast<int>(options.placement)] << std::endl;
+        }
+
+        // Destroyed before the write engine, the files of its last group are flushed while the io_context still exist
+        std::unique_ptr<GroupCommit> group_commit;
+        if (options.durability == Durability::group)
+        {
+            group_commit = std::make_unique<GroupCommit>(metrics, std::chrono::milliseconds(options.group_commit_delay_ms), GROUP_COMMIT_MAX_BYTES);
+            std::cout << "Durability : files flushed on disk by groups before their ACK, every " << options.group_commit_delay_ms << " ms" << std::endl;
+        }
+        else if (options.durability == Durability::file)
+        {
+            std::cout << "Durability : each file flushed on disk before its ACK" << std::endl;
+        }
+        std::cout << "File checksum : CRC32C (" << Crc32c::implementation_name() << ")" << std::endl;
+
+        const SessionContext session_context{ *write_engine, group_commit.get(), metrics, trace_writer.get(), saved_file_index, part_journal, striped_file_table, memory_budget, block_pool, *client_page, options.session_chunk_count, options.dedupe, options.deflate, options.log_files };
+        std::vector<std::unique_ptr<WebSocketServer>> servers;
+        for (const std::unique_ptr<net::io_context>& io_context : io_contexts)
+        {
+            servers.push_back(std::make_unique<WebSocketServer>(*io_context, APP_PORT, reuse_port, session_context));
+        }
 
-        std::cout << "WebSocket server listening on all network interfaces available in ipv4 on port " << APP_PORT << std::endl;
+        std::unique_ptr<MetricsServer> metrics_server;
+        if (options.metrics_port != 0)
+        {
+            metrics_server = std::make_unique<MetricsServer>(*io_contexts.front(), options.metrics_port, metrics, *write_engine, memory_budget, block_pool);
+            std::cout << "Metrics served on port " << options.metrics_port << " at /metrics" << std::endl;
+        }
+
+        std::cout << "WebSocket server listening on all network interfaces available in " << (servers.front()->is_dual_stack() ? "ipv4 and ipv6" : "ipv4")
+            << " on port " << APP_PORT << " (" << options.network_thread_count << " threads" << (reuse_port ? ", one listener per thread" : "") << ")" << std::endl;
+
+        // Exception of a network thread is keep for be rethrow on main thread, it stops all the io_contexts
+        std::exception_ptr network_exception;
+        std::mutex network_exception_mutex;
+        auto run_network_thread = [&io_contexts, &network_exception, &network_exception_mutex](net::io_context& ioc) {
+            try
+            {
+                ioc.run();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(network_exception_mutex);
+                if (!network_exception)
+                {
+                    network_exception = std::current_exception();
+                }
+                for (const std::unique_ptr<net::io_context>& io_context : io_contexts)
+                {
+                    io_context->stop();
+                }
+            }
+            };
 
-        ioc.run();
+        std::vector<std::thread> network_threads;
+        network_threads.reserve(options.network_thread_count - 1);
+        for (unsigned int i = 1; i < options.network_thread_count; i++)
+        {
+            network_threads.emplace_back(run_network_thread, std::ref(*io_contexts[i % io_contexts.size()]));
+        }
+        run_network_thread(*io_contexts.front()); // main thread is one of the network threads
+
+        for (std::thread& network_thread : network_threads)
+        {
+            network_thread.join();
+        }
+        memory_budget.clear_waiters();
+
+        if (network_exception)
+        {
+            std::rethrow_exception(network_exception);
+        }
     }
     catch (const std::exception& e)
     {
         std::cerr << "Something went wrong. Exception : " << e.what() << std::endl;
-        system("pause");
+        pause_console();
         return EXIT_FAILURE;
     }
 
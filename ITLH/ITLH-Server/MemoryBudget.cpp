@@ -0,0 +1,126 @@
+#include "MemoryBudget.h"
+
+/**
+ * @class MemoryBudget
+ * @brief Bounds the memory used by all the sessions to receive data, whatever the number of clients.
+ *
+ * A session reserves the size of a receive chunk before allocating it, and releases it once the chunk is freed.
+ * When the budget is exhausted, the reservation is delayed and the session stops reading until memory is released :
+ * the client is slowed down by the TCP flow control, like when the save queue is full. Sessions that see delayed
+ * reservations free their unused chunks.
+ *
+ * The first chunk of a session is reserved even when the budget is exhausted, so every session can always read : a
+ * striped file waits for all its connections, they can't wait for each other's memory. The reserved memory can then
+ * exceed the budget by one chunk per session while memory is short.
+ *
+ * Delayed reservations are served in order, by the thread that releases the memory : while some wait, a new
+ * reservation waits too, so a busy session can't take again the memory it just released before the waiting ones.
+ *
+ * All the functions can be called from many threads at the same time.
+ */
+
+/**
+ * @param capacity Number of bytes that can be reserved at the same time.
+ */
+MemoryBudget::MemoryBudget(std::size_t capacity)
+    : m_capacity(capacity)
+{
+}
+
+/**
+ * @brief Reserves memory now, even above the capacity.
+ *
+ * @param size Number of bytes to reserve.
+ */
+void MemoryBudget::reserve(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const std::size_t reserved = m_reserved += size;
+    if (reserved > m_peak_reserved)
+    {
+        m_peak_reserved = reserved;
+    }
+}
+
+/**
+ * @brief Reserves memory now, or once enough memory is released.
+ *
+ * The callback is called by the thread that releases memory, it must be short and should only post work on
+ * its own executor.
+ *
+ * @param size Number of bytes to reserve.
+ * @param callback The function to call once the memory is reserved, if it can't be reserved now.
+ *
+ * @return true if the memory is reserved, false if the reservation is delayed.
+ */
+bool MemoryBudget::reserve_or_notify(std::size_t size, std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_waiters.empty() || m_reserved + size > m_capacity)
+    {
+        m_waiters.emplace_back(size, std::move(callback));
+        m_waiter_count = m_waiters.size();
+        m_wait_count++;
+        return false;
+    }
+
+    const std::size_t reserved = m_reserved += size;
+    if (reserved > m_peak_reserved)
+    {
+        m_peak_reserved = reserved;
+    }
+    return true;
+}
+
+/**
+ * @brief Releases reserved memory, and serves the delayed reservations that fit in the budget.
+ *
+ * @param size Number of bytes released.
+ */
+void MemoryBudget::release(std::size_t size)
+{
+    std::vector<std::function<void()>> served_waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reserved -= size;
+
+        while (!m_waiters.empty() && m_reserved + m_waiters.front().first <= m_capacity)
+        {
+            m_reserved += m_waiters.front().first;
+            served_waiters.push_back(std::move(m_waiters.front().second));
+            m_waiters.pop_front();
+        }
+        m_waiter_count = m_waiters.size();
+    }
+
+    for (const std::function<void()>& waiter : served_waiters)
+    {
+        waiter();
+    }
+}
+
+/**
+ * @brief Checks if reservations are delayed, a session then frees its unused chunks.
+ */
+bool MemoryBudget::has_waiters() const
+{
+    return m_waiter_count > 0;
+}
+
+/**
+ * @brief Drops the delayed reservations without calling their callbacks.
+ *
+ * Called once the network threads are stopped : the sessions held by the callbacks are destroyed while their
+ * io_context still exists.
+ */
+void MemoryBudget::clear_waiters()
+{
+    std::deque<std::pair<std::size_t, std::function<void()>>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        waiters.swap(m_waiters);
+        m_waiter_count = 0;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(std::size_t capacity);
+
+	void reserve(std::size_t size);
+	bool reserve_or_notify(std::size_t size, std::function<void()> callback);
+	void release(std::size_t size);
+	bool has_waiters() const;
+	void clear_waiters();
+
+	std::size_t capacity() const { return m_capacity; }
+	std::size_t reserved() const { return m_reserved; }
+	std::size_t peak_reserved() const { return m_peak_reserved; }
+	std::size_t waiter_count() const { return m_waiter_count; }
+	uint64_t wait_count() const { return m_wait_count; }
+
+private:
+	const std::size_t m_capacity;
+	std::atomic<std::size_t> m_reserved = 0;
+	std::atomic<std::size_t> m_peak_reserved = 0;
+	std::atomic<std::size_t> m_waiter_count = 0;
+	std::atomic<uint64_t> m_wait_count = 0; // reservations delayed since the start
+
+	mutable std::mutex m_mutex;
+	std::deque<std::pair<std::size_t, std::function<void()>>> m_waiters; // size and callback of the delayed reservations, in order
+};
@@ -0,0 +1,666 @@
+#include "MetadataDateReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+constexpr std::size_t MAX_PREFIX_SIZE = 262'144; // 256 KO, JPEG EXIF segment is max 64 KO and HEIF metadata are at start of file
+constexpr std::size_t MAX_MOVIE_BOX_SIZE = 65'536; // mvhd is the first box of moov, no need of the sample tables after
+constexpr uint64_t NO_MORE_BOX = UINT64_MAX;
+constexpr std::size_t MAX_KEPT_BUFFER_SIZE = 65'536; // memory of a buffer kept by reset() for the next file
+
+constexpr uint16_t EXIF_TAG_EXIF_IFD = 0x8769;
+constexpr uint16_t EXIF_TAG_DATE_TIME_ORIGINAL = 0x9003;
+constexpr uint16_t EXIF_TAG_DATE_TIME_DIGITIZED = 0x9004;
+constexpr uint16_t EXIF_TAG_OFFSET_TIME_ORIGINAL = 0x9011;
+
+constexpr double SECONDS_FROM_1904_TO_1970 = 2'082'844'800.0; // QuickTime and MP4 dates start in 1904
+
+/**
+ * @class MetadataDateReader
+ * @brief Reads the date a photo or a video was taken from the file data, while the file is received.
+ *
+ * The file content is given to `feed()` in order, chunk by chunk. The reader keeps only the first bytes of
+ * the file and, for ISO base media files, the beginning of the movie box wherever it is in the file.
+ * Once the whole file is given, `read_date()` looks for :
+ * - JPEG : the EXIF DateTimeOriginal of the APP1 segment.
+ * - TIFF based files (TIFF, DNG and most RAW formats) : the EXIF DateTimeOriginal.
+ * - HEIF (HEIC, AVIF) : the EXIF DateTimeOriginal of the Exif item.
+ * - MP4 and MOV : the creation time of the movie header box.
+ *
+ * No file is opened and no system API is used, so it works the same on all platforms.
+ *
+ * The EXIF date has no time zone : the OffsetTimeOriginal tag is used if present, else the date is read as a
+ * local time of the server, like Windows does for the "Date taken" property.
+ */
+
+/**
+ * @class ByteReader
+ * @brief Bounds checked reading of big or little endian values in a buffer.
+ */
+class ByteReader
+{
+public:
+    ByteReader(const uint8_t* data, std::size_t size, bool little_endian = false)
+        : m_data(data), m_size(size), m_little_endian(little_endian)
+    {
+    }
+
+    bool has(std::size_t offset, std::size_t length) const
+    {
+        return offset <= m_size && length <= m_size - offset;
+    }
+
+    uint64_t read(std::size_t offset, std::size_t length) const
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < length; i++)
+        {
+            const std::size_t index = m_little_endian ? offset + length - 1 - i : offset + i;
+            value = (value << 8) | m_data[index];
+        }
+        return value;
+    }
+
+    uint16_t u16(std::size_t offset) const { return static_cast<uint16_t>(read(offset, 2)); }
+    uint32_t u32(std::size_t offset) const { return static_cast<uint32_t>(read(offset, 4)); }
+    uint64_t u64(std::size_t offset) const { return read(offset, 8); }
+
+    bool is_type(std::size_t offset, const char* type) const
+    {
+        return has(offset, 4) && std::memcmp(m_data + offset, type, 4) == 0;
+    }
+
+    const uint8_t* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data;
+    std::size_t m_size;
+    bool m_little_endian;
+};
+
+/**
+ * @brief Converts a UTC civil date to days since Unix epoch.
+ */
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+    const unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+/**
+ * @brief Converts an EXIF date to ms since Unix epoch.
+ *
+ * @param date_time The EXIF date, "YYYY:MM:DD HH:MM:SS".
+ * @param offset_time The EXIF time offset, "+HH:MM" or "-HH:MM", or empty if unknown.
+ * @param date The converted date.
+ *
+ * @return false if the date is not valid, like the "0000:00:00 00:00:00" of cameras without clock.
+ */
+bool MetadataDateReader::parse_exif_date(const std::string& date_time, const std::string& offset_time, double& date)
+{
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    if (std::sscanf(date_time.c_str(), "%4d:%2d:%2d %2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6)
+    {
+        return false;
+    }
+    if (year < 1601 || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    {
+        return false;
+    }
+
+    int offset_hour = 0, offset_minute = 0;
+    char offset_sign = 0;
+    if (std::sscanf(offset_time.c_str(), "%c%2d:%2d", &offset_sign, &offset_hour, &offset_minute) == 3 && (offset_sign == '+' || offset_sign == '-'))
+    {
+        const int64_t seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+        const int64_t offset = (offset_hour * 3600 + offset_minute * 60) * (offset_sign == '-' ? -1 : 1);
+        date = static_cast<double>(seconds - offset) * 1000.0;
+        return true;
+    }
+
+    // No time zone, date is a local time
+    std::tm local_time = {};
+    local_time.tm_year = year - 1900;
+    local_time.tm_mon = month - 1;
+    local_time.tm_mday = day;
+    local_time.tm_hour = hour;
+    local_time.tm_min = minute;
+    local_time.tm_sec = second;
+    local_time.tm_isdst = -1;
+
+    const std::time_t seconds = std::mktime(&local_time);
+    if (seconds == static_cast<std::time_t>(-1))
+    {
+        return false;
+    }
+
+    date = static_cast<double>(seconds) * 1000.0;
+    return true;
+}
+
+/**
+ * @brief Reads the ASCII value of a TIFF IFD entry.
+ */
+static std::string read_tiff_ascii(const ByteReader& tiff, std::size_t entry_offset)
+{
+    const uint32_t count = tiff.u32(entry_offset + 4);
+    const std::size_t value_offset = count > 4 ? tiff.u32(entry_offset + 8) : entry_offset + 8;
+    if (count == 0 || !tiff.has(value_offset, count))
+    {
+        return "";
+    }
+
+    const char* text = reinterpret_cast<const char*>(tiff.data() + value_offset);
+    return std::string(text, strnlen(text, count));
+}
+
+/**
+ * @brief Reads the date a photo was taken from a TIFF structure (EXIF block or TIFF file).
+ *
+ * @param data The TIFF structure, starting with its byte order mark.
+ * @param size Size of the TIFF structure.
+ * @param date The date found.
+ *
+ * @return true if a valid date is found.
+ */
+static bool read_tiff_date(const uint8_t* data, std::size_t size, double& date)
+{
+    if (size < 8 || !((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M')))
+    {
+        return false;
+    }
+
+    const ByteReader tiff(data, size, data[0] == 'I');
+    if (tiff.u16(2) != 42)
+    {
+        return false;
+    }
+
+    // Find Exif IFD in IFD0
+    const uint32_t ifd0_offset = tiff.u32(4);
+    if (!tiff.has(ifd0_offset, 2))
+    {
+        return false;
+    }
+
+    uint32_t exif_ifd_offset = 0;
+    const uint16_t ifd0_count = tiff.u16(ifd0_offset);
+    for (uint16_t i = 0; i < ifd0_count && tiff.has(ifd0_offset + 2 + i * 12, 12); i++)
+    {
+        const std::size_t entry = ifd0_offset + 2 + i * 12;
+        if (tiff.u16(entry) == EXIF_TAG_EXIF_IFD)
+        {
+            exif_ifd_offset = tiff.u32(entry + 8);
+        }
+    }
+
+    if (exif_ifd_offset == 0 || !tiff.has(exif_ifd_offset, 2))
+    {
+        return false;
+    }
+
+    std::string date_time_original;
+    std::string date_time_digitized;
+    std::string offset_time_original;
+    const uint16_t exif_count = tiff.u16(exif_ifd_offset);
+    for (uint16_t i = 0; i < exif_count && tiff.has(exif_ifd_offset + 2 + i * 12, 12); i++)
+    {
+        const std::size_t entry = exif_ifd_offset + 2 + i * 12;
+        switch (tiff.u16(entry))
+        {
+        case EXIF_TAG_DATE_TIME_ORIGINAL:
+            date_time_original = read_tiff_ascii(tiff, entry);
+            break;
+        case EXIF_TAG_DATE_TIME_DIGITIZED:
+            date_time_digitized = read_tiff_ascii(tiff, entry);
+            break;
+        case EXIF_TAG_OFFSET_TIME_ORIGINAL:
+            offset_time_original = read_tiff_ascii(tiff, entry);
+            break;
+        }
+    }
+
+    return MetadataDateReader::parse_exif_date(date_time_original, offset_time_original, date)
+        || MetadataDateReader::parse_exif_date(date_time_digitized, offset_time_original, date);
+}
+
+/**
+ * @brief Gives the next part of the file content to the reader.
+ *
+ * @param data The bytes of the file, following the bytes of the previous call.
+ * @param size The number of bytes.
+ */
+void MetadataDateReader::feed(const uint8_t* data, std::size_t size)
+{
+    if (m_prefix.size() < MAX_PREFIX_SIZE)
+    {
+        const std::size_t prefix_part_size = std::min(MAX_PREFIX_SIZE - m_prefix.size(), size);
+        m_prefix.insert(m_prefix.end(), data, data + prefix_part_size);
+    }
+
+    if (m_track_boxes && m_prefix.size() >= 8)
+    {
+        // ISO base media files start with a ftyp box, old QuickTime files can start directly with another box
+        const ByteReader prefix(m_prefix.data(), m_prefix.size());
+        m_track_boxes = prefix.is_type(4, "ftyp") || prefix.is_type(4, "moov") || prefix.is_type(4, "mdat")
+            || prefix.is_type(4, "wide") || prefix.is_type(4, "free") || prefix.is_type(4, "skip");
+    }
+
+    if (m_track_boxes)
+    {
+        track_boxes(data, size);
+    }
+
+    m_total_size += size;
+}
+
+/**
+ * @brief Follows the top level boxes of an ISO base media file, and keeps the beginning of the moov box.
+ *
+ * Only the box headers are read, the content of the other boxes (the media data) is skipped.
+ */
+void MetadataDateReader::track_boxes(const uint8_t* data, std::size_t size)
+{
+    uint64_t position = m_total_size;
+    const uint64_t end = m_total_size + size;
+
+    while (position < end && m_next_box_offset != NO_MORE_BOX)
+    {
+        const uint8_t* current = data + (position - m_total_size);
+
+        // Content of a box
+        if (position < m_next_box_offset && m_box_header.empty())
+        {
+            const std::size_t part_size = static_cast<std::size_t>(std::min(end, m_next_box_offset) - position);
+            if (m_in_movie_box && m_movie_box.size() < MAX_MOVIE_BOX_SIZE)
+            {
+                m_movie_box.insert(m_movie_box.end(), current, current + std::min(part_size, MAX_MOVIE_BOX_SIZE - m_movie_box.size()));
+            }
+            position += part_size;
+            continue;
+        }
+
+        // Header of a box : 32 bits size and type, followed by a 64 bits size if size is 1
+        std::size_t header_size = 8;
+        if (m_box_header.size() >= 4 && ByteReader(m_box_header.data(), 4).u32(0) == 1)
+        {
+            header_size = 16;
+        }
+
+        const std::size_t header_part_size = static_cast<std::size_t>(std::min<uint64_t>(header_size - m_box_header.size(), end - position));
+        m_box_header.insert(m_box_header.end(), current, current + header_part_size);
+        position += header_part_size;
+
+        if (m_box_header.size() == 8 && ByteReader(m_box_header.data(), 8).u32(0) == 1)
+        {
+            continue; // 64 bits size follows
+        }
+
+        if (m_box_header.size() == header_size)
+        {
+            const ByteReader header(m_box_header.data(), m_box_header.size());
+            const uint64_t box_size = header_size == 16 ? header.u64(8) : header.u32(0);
+            const uint64_t box_offset = position - header_size;
+
+            m_in_movie_box = header.is_type(4, "moov");
+            m_box_header.clear();
+
+            if (box_size == 0)
+            {
+                m_next_box_offset = NO_MORE_BOX; // last box, up to the end of the file
+            }
+            else if (box_size < header_size)
+            {
+                m_next_box_offset = NO_MORE_BOX; // not a valid box, stop reading
+                m_in_movie_box = false;
+            }
+            else
+            {
+                m_next_box_offset = box_offset + box_size;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Prepares the reader for an other file.
+ *
+ * The buffers keep their memory up to `MAX_KEPT_BUFFER_SIZE`, so reading the next small file doesn't allocate.
+ */
+void MetadataDateReader::reset()
+{
+    for (std::vector<uint8_t>* buffer : { &m_prefix, &m_box_header, &m_movie_box })
+    {
+        buffer->clear();
+        if (buffer->capacity() > MAX_KEPT_BUFFER_SIZE)
+        {
+            buffer->shrink_to_fit();
+        }
+    }
+    m_total_size = 0;
+    m_track_boxes = true;
+    m_next_box_offset = 0;
+    m_in_movie_box = false;
+}
+
+/**
+ * @brief Finds the date a photo or a video was taken, once the whole file is given to `feed()`.
+ *
+ * @return The date if found, `MetadataDateStatus::corrupt` if the file is a JPEG that contains no image.
+ */
+MetadataDate MetadataDateReader::read_date() const
+{
+    const ByteReader prefix(m_prefix.data(), m_prefix.size());
+
+    if (prefix.has(0, 2) && m_prefix[0] == 0xFF && m_prefix[1] == 0xD8)
+    {
+        return read_jpeg_date();
+    }
+
+    MetadataDate result;
+    if (read_tiff_date(m_prefix.data(), m_prefix.size(), result.date))
+    {
+        result.status = MetadataDateStatus::found;
+        return result;
+    }
+
+    if (prefix.is_type(4, "ftyp") && prefix.has(8, 4))
+    {
+        const std::string brand(reinterpret_cast<const char*>(m_prefix.data() + 8), 4);
+        if (brand == "heic" || brand == "heix" || brand == "hevc" || brand == "heim" || brand == "mif1" || brand == "msf1" || brand == "avif")
+        {
+            return read_heif_date();
+        }
+    }
+
+    if (!m_movie_box.empty())
+    {
+        return read_movie_date();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Reads the EXIF date of a JPEG file, and checks its segments up to the start of the image data.
+ */
+MetadataDate MetadataDateReader::read_jpeg_date() const
+{
+    MetadataDate result;
+    const ByteReader jpeg(m_prefix.data(), m_prefix.size());
+    const bool whole_file = m_total_size == m_prefix.size();
+
+    std::size_t position = 2;
+    while (jpeg.has(position, 2))
+    {
+        if (m_prefix[position] != 0xFF)
+        {
+            result.status = MetadataDateStatus::corrupt;
+            return result;
+        }
+
+        const uint8_t marker = m_prefix[position + 1];
+        if (marker == 0xFF)
+        {
+            position++; // fill byte
+            continue;
+        }
+        if (marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            position += 2; // marker without segment
+            continue;
+        }
+        if (marker == 0xD9)
+        {
+            result.status = MetadataDateStatus::corrupt; // end of image before any image data
+            return result;
+        }
+        if (!jpeg.has(position + 2, 2))
+        {
+            break;
+        }
+
+        const uint16_t segment_size = jpeg.u16(position + 2);
+        if (segment_size < 2)
+        {
+            result.status = MetadataDateStatus::corrupt;
+            return result;
+        }
+
+        // Start of scan, image data follows, the metadata segments are all read
+        if (marker == 0xDA)
+        {
+            return result;
+        }
+
+        // APP1 with "Exif\0\0" then a TIFF structure
+        if (marker == 0xE1 && result.status != MetadataDateStatus::found && jpeg.has(position + 4, segment_size - 2)
+            && segment_size >= 8 && std::memcmp(m_prefix.data() + position + 4, "Exif\0\0", 6) == 0)
+        {
+            if (read_tiff_date(m_prefix.data() + position + 10, segment_size - 8, result.date))
+            {
+                result.status = MetadataDateStatus::found;
+            }
+        }
+
+        position += 2 + segment_size;
+    }
+
+    // Whole file read without finding image data
+    if (whole_file)
+    {
+        result.status = MetadataDateStatus::corrupt;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Reads the EXIF date of the Exif item of a HEIF file.
+ *
+ * The meta box lists the items of the file (iinf) and their location (iloc), the Exif item holds a TIFF structure.
+ */
+MetadataDate MetadataDateReader::read_heif_date() const
+{
+    MetadataDate result;
+    const ByteReader file(m_prefix.data(), m_prefix.size());
+
+    // Find the top level meta box
+    std::size_t meta_offset = 0;
+    uint64_t meta_size = 0;
+    for (std::size_t position = 0; file.has(position, 8);)
+    {
+        uint64_t box_size = file.u32(position);
+        std::size_t header_size = 8;
+        if (box_size == 1 && file.has(position + 8, 8))
+        {
+            box_size = file.u64(position + 8);
+            header_size = 16;
+        }
+        if (box_size < header_size)
+        {
+            return result;
+        }
+        if (file.is_type(position + 4, "meta"))
+        {
+            meta_offset = position + header_size + 4; // full box : version and flags
+            meta_size = box_size - header_size - 4;
+            break;
+        }
+        position += static_cast<std::size_t>(std::min<uint64_t>(box_size, SIZE_MAX - position));
+    }
+
+    if (meta_offset == 0 || !file.has(meta_offset, static_cast<std::size_t>(meta_size)))
+    {
+        return result;
+    }
+
+    // Find the Exif item id (iinf) and its location (iloc) in the meta box
+    uint32_t exif_item_id = 0;
+    std::size_t iloc_offset = 0;
+    std::size_t iloc_size = 0;
+    for (std::size_t position = meta_offset; position + 8 <= meta_offset + meta_size;)
+    {
+        const uint32_t box_size = file.u32(position);
+        if (box_size < 8 || !file.has(position, box_size))
+        {
+            return result;
+        }
+
+        if (file.is_type(position + 4, "iinf"))
+        {
+            const uint8_t version = m_prefix[position + 8];
+            std::size_t entry = position + 12 + (version == 0 ? 2 : 4);
+            while (entry + 8 <= position + box_size && exif_item_id == 0)
+            {
+                const uint32_t entry_size = file.u32(entry);
+                if (entry_size < 8 || entry + entry_size > position + box_size)
+                {
+                    break;
+                }
+                // infe version 2 : 16 bits item id, version 3 : 32 bits item id, then protection index and item type
+                const uint8_t infe_version = file.has(entry + 8, 1) ? m_prefix[entry + 8] : 0;
+                if (file.is_type(entry + 4, "infe") && infe_version >= 2)
+                {
+                    const std::size_t id_size = infe_version == 2 ? 2 : 4;
+                    if (file.is_type(entry + 12 + id_size + 2, "Exif"))
+                    {
+                        exif_item_id = static_cast<uint32_t>(file.read(entry + 12, id_size));
+                    }
+                }
+                entry += entry_size;
+            }
+        }
+        else if (file.is_type(position + 4, "iloc"))
+        {
+            iloc_offset = position;
+            iloc_size = box_size;
+        }
+
+        position += box_size;
+    }
+
+    if (exif_item_id == 0 || iloc_offset == 0)
+    {
+        return result;
+    }
+
+    // Read the location of the Exif item
+    const uint8_t version = m_prefix[iloc_offset + 8];
+    std::size_t position = iloc_offset + 12;
+    const std::size_t iloc_end = iloc_offset + iloc_size;
+    if (position + 2 > iloc_end)
+    {
+        return result;
+    }
+    const std::size_t offset_size = m_prefix[position] >> 4;
+    const std::size_t length_size = m_prefix[position] & 0x0F;
+    const std::size_t base_offset_size = m_prefix[position + 1] >> 4;
+    const std::size_t index_size = version >= 1 ? (m_prefix[position + 1] & 0x0F) : 0;
+    position += 2;
+
+    const std::size_t count_size = version < 2 ? 2 : 4;
+    const std::size_t id_size = version < 2 ? 2 : 4;
+    if (position + count_size > iloc_end)
+    {
+        return result;
+    }
+    const uint64_t item_count = file.read(position, count_size);
+    position += count_size;
+
+    for (uint64_t i = 0; i < item_count; i++)
+    {
+        const std::size_t item_header_size = id_size + (version >= 1 ? 2 : 0) + 2 + base_offset_size + 2;
+        if (position + item_header_size > iloc_end)
+        {
+            return result;
+        }
+
+        const uint64_t item_id = file.read(position, id_size);
+        position += id_size;
+        const uint16_t construction_method = version >= 1 ? (file.u16(position) & 0x0F) : 0;
+        position += (version >= 1 ? 2 : 0) + 2; // construction method, data reference index
+        const uint64_t base_offset = file.read(position, base_offset_size);
+        position += base_offset_size;
+        const uint16_t extent_count = file.u16(position);
+        position += 2;
+
+        const std::size_t extent_size = index_size + offset_size + length_size;
+        if (position + extent_count * extent_size > iloc_end)
+        {
+            return result;
+        }
+
+        if (item_id == exif_item_id && construction_method == 0 && extent_count >= 1)
+        {
+            const uint64_t item_offset = base_offset + file.read(position + index_size, offset_size);
+            const uint64_t item_length = file.read(position + index_size + offset_size, length_size);
+
+            // Exif item : offset of the TIFF header (4 bytes), then the EXIF data
+            if (item_offset + 4 > m_prefix.size())
+            {
+                return result; // not in the first bytes kept
+            }
+            const std::size_t exif_offset = static_cast<std::size_t>(item_offset);
+            const uint64_t tiff_offset = exif_offset + 4 + file.u32(exif_offset);
+            const uint64_t item_end = std::min<uint64_t>(item_length == 0 ? m_prefix.size() : item_offset + item_length, m_prefix.size());
+            if (tiff_offset < item_end && read_tiff_date(m_prefix.data() + tiff_offset, static_cast<std::size_t>(item_end - tiff_offset), result.date))
+            {
+                result.status = MetadataDateStatus::found;
+            }
+            return result;
+        }
+
+        position += extent_count * extent_size;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Reads the creation time of the movie header box (mvhd) of a MP4 or MOV file.
+ */
+MetadataDate MetadataDateReader::read_movie_date() const
+{
+    MetadataDate result;
+    const ByteReader movie(m_movie_box.data(), m_movie_box.size());
+
+    for (std::size_t position = 0; movie.has(position, 8);)
+    {
+        const uint32_t box_size = movie.u32(position);
+        if (box_size < 8)
+        {
+            return result;
+        }
+
+        if (movie.is_type(position + 4, "mvhd") && movie.has(position + 8, 1))
+        {
+            // version 0 : 32 bits creation time, version 1 : 64 bits creation time, in seconds since 1904
+            const uint8_t version = m_movie_box[position + 8];
+            const std::size_t time_size = version == 1 ? 8 : 4;
+            if (!movie.has(position + 12, time_size))
+            {
+                return result;
+            }
+
+            const uint64_t creation_time = movie.read(position + 12, time_size);
+            if (creation_time > SECONDS_FROM_1904_TO_1970)
+            {
+                result.date = (static_cast<double>(creation_time) - SECONDS_FROM_1904_TO_1970) * 1000.0;
+                result.status = MetadataDateStatus::found;
+            }
+            return result;
+        }
+
+        position += box_size;
+    }
+
+    return result;
+}
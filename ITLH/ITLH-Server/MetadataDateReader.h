@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class MetadataDateStatus
+{
+	not_found, // no date in the file metadata, or file type not known
+	found,
+	corrupt // file type known but its data can't be read, like a JPEG without image
+};
+
+struct MetadataDate
+{
+	MetadataDateStatus status = MetadataDateStatus::not_found;
+	double date = 0.0; // ms since Unix epoch, valid if status is found
+};
+
+class MetadataDateReader
+{
+public:
+	void feed(const uint8_t* data, std::size_t size);
+	MetadataDate read_date() const;
+	void reset();
+
+	static bool parse_exif_date(const std::string& date_time, const std::string& offset_time, double& date);
+
+private:
+	void track_boxes(const uint8_t* data, std::size_t size);
+
+	MetadataDate read_jpeg_date() const;
+	MetadataDate read_heif_date() const;
+	MetadataDate read_movie_date() const;
+
+	std::vector<uint8_t> m_prefix; // first bytes of the file
+	uint64_t m_total_size = 0;
+
+	// Top level boxes of ISO base media files (MP4, MOV, HEIC), the movie box can be anywhere in the file
+	bool m_track_boxes = true;
+	uint64_t m_next_box_offset = 0;
+	std::vector<uint8_t> m_box_header;
+	bool m_in_movie_box = false;
+	std::vector<uint8_t> m_movie_box; // first bytes of the content of the moov box
+};
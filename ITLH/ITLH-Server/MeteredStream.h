@@ -0,0 +1,122 @@
+#pragma once
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Stream layer counting the bytes read from the next layer, and optionally timing the reads of the stream above it
+template <class NextLayer>
+class MeteredStream
+{
+public:
+	using next_layer_type = NextLayer;
+	using executor_type = typename NextLayer::executor_type;
+
+	template <class... Args>
+	explicit MeteredStream(Args&&... args) : m_next_layer(std::forward<Args>(args)...) {}
+
+	next_layer_type& next_layer() { return m_next_layer; }
+	const next_layer_type& next_layer() const { return m_next_layer; }
+	executor_type get_executor() { return m_next_layer.get_executor(); }
+
+	uint64_t bytes_read() const { return m_bytes_read; }
+	std::chrono::steady_clock::duration processing_time() const { return m_processing_time; }
+
+	void enable_timing() { m_is_timing_enabled = true; }
+
+	// Times the stream above from the start of one of its reads to its handler, without the waits for the network
+	void start_timing()
+	{
+		if (m_is_timing_enabled)
+		{
+			m_timing_start = std::chrono::steady_clock::now();
+			m_is_timing = true;
+		}
+	}
+
+	void stop_timing()
+	{
+		if (m_is_timing)
+		{
+			m_processing_time += std::chrono::steady_clock::now() - m_timing_start;
+			m_is_timing = false;
+		}
+	}
+
+	template <class MutableBufferSequence, class ReadHandler>
+	auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+	{
+		if (m_is_timing)
+		{
+			m_processing_time += std::chrono::steady_clock::now() - m_timing_start; // paused until the bytes come
+		}
+		return m_next_layer.async_read_some(buffers, CountingHandler<std::decay_t<ReadHandler>>(*this, std::forward<ReadHandler>(handler)));
+	}
+
+	template <class ConstBufferSequence, class WriteHandler>
+	auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+	{
+		return m_next_layer.async_write_some(buffers, std::forward<WriteHandler>(handler));
+	}
+
+private:
+	template <class Handler>
+	class CountingHandler
+	{
+	public:
+		using allocator_type = boost::asio::associated_allocator_t<Handler>;
+		using executor_type = boost::asio::associated_executor_t<Handler, typename MeteredStream::executor_type>;
+
+		template <class DeducedHandler>
+		CountingHandler(MeteredStream& stream, DeducedHandler&& handler) : m_stream(stream), m_handler(std::forward<DeducedHandler>(handler)) {}
+
+		allocator_type get_allocator() const noexcept { return boost::asio::get_associated_allocator(m_handler); }
+		executor_type get_executor() const noexcept { return boost::asio::get_associated_executor(m_handler, m_stream.get_executor()); }
+
+		void operator()(boost::beast::error_code ec, std::size_t size)
+		{
+			m_stream.on_read(size);
+			std::move(m_handler)(ec, size);
+		}
+
+	private:
+		MeteredStream& m_stream;
+		Handler m_handler;
+	};
+
+	void on_read(std::size_t size)
+	{
+		m_bytes_read += size;
+		if (m_is_timing)
+		{
+			m_timing_start = std::chrono::steady_clock::now();
+		}
+	}
+
+	NextLayer m_next_layer;
+	uint64_t m_bytes_read = 0;
+	bool m_is_timing_enabled = false;
+	bool m_is_timing = false; // in a read of the stream above
+	std::chrono::steady_clock::time_point m_timing_start;
+	std::chrono::steady_clock::duration m_processing_time{};
+};
+
+template <class NextLayer>
+void teardown(boost::beast::role_type role, MeteredStream<NextLayer>& stream, boost::beast::error_code& ec)
+{
+	using boost::beast::websocket::teardown;
+	teardown(role, stream.next_layer(), ec);
+}
+
+template <class NextLayer, class TeardownHandler>
+void async_teardown(boost::beast::role_type role, MeteredStream<NextLayer>& stream, TeardownHandler&& handler)
+{
+	using boost::beast::websocket::async_teardown;
+	async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
@@ -0,0 +1,170 @@
+#include "MetricsServer.h"
+
+#include "AllocationCounter.h"
+#include "TcpListener.h"
+
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <memory>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+constexpr char METRICS_TARGET[] = "/metrics";
+constexpr auto METRICS_REQUEST_TIMEOUT = std::chrono::seconds(10);
+
+/**
+ * @class MetricsConnection
+ * @brief Answers one HTTP request of a metrics scraper, then closes the connection.
+ */
+class MetricsConnection : public std::enable_shared_from_this<MetricsConnection>
+{
+public:
+    MetricsConnection(tcp::socket socket, const MetricsServer& server)
+        : m_stream(std::move(socket))
+        , m_server(server)
+    {
+    }
+
+    void run()
+    {
+        m_stream.expires_after(METRICS_REQUEST_TIMEOUT);
+        http::async_read(m_stream, m_buffer, m_request, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (!ec)
+            {
+                self->respond();
+            }
+            });
+    }
+
+private:
+    beast::tcp_stream m_stream;
+    beast::flat_buffer m_buffer;
+    http::request<http::empty_body> m_request;
+    http::response<http::string_body> m_response;
+    const MetricsServer& m_server;
+
+    void respond()
+    {
+        m_response.version(m_request.version());
+        m_response.keep_alive(false);
+
+        if (m_request.method() != http::verb::get || m_request.target() != METRICS_TARGET)
+        {
+            m_response.result(http::status::not_found);
+            m_response.set(http::field::content_type, "text/plain");
+            m_response.body() = "Not found, metrics are served on " + std::string(METRICS_TARGET) + "\n";
+        }
+        else
+        {
+            m_response.result(http::status::ok);
+            m_response.set(http::field::content_type, "text/plain; version=0.0.4");
+            m_response.body() = m_server.render();
+        }
+        m_response.prepare_payload();
+
+        http::async_write(m_stream, m_response, [self = shared_from_this()](beast::error_code, std::size_t) {
+            beast::error_code ec;
+            self->m_stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+            });
+    }
+};
+
+/**
+ * @class MetricsServer
+ * @brief Serves the server metrics in the Prometheus text format on a side port.
+ *
+ * `GET /metrics` returns the counters and histograms of `ServerMetrics`, the queue depth of the write
+ * engine and the use of the memory budget. The connections are handled on the io_context of the WebSocket
+ * server, each request only reads atomic values, so a scraper doesn't slow down the transfers. Errors of a
+ * metrics connection only close this connection.
+ */
+
+/**
+ * @param ioc The io_context running the connections.
+ * @param port The port to listen on, on all the network interfaces in IPv6 dual stack, else in IPv4.
+ * @param metrics The metrics of the server.
+ * @param write_engine The engine writing the files, its queue depth is served with the metrics.
+ * @param memory_budget The memory budget of the receive chunks, its use is served with the metrics.
+ * @param block_pool The pool of the receive blocks, its size is served with the metrics.
+ */
+MetricsServer::MetricsServer(net::io_context& ioc, uint_least16_t port, const ServerMetrics& metrics, const FileWriteEngine& write_engine, const MemoryBudget& memory_budget, const ReceiveBlockPool& block_pool)
+    : m_ioc(ioc)
+    , m_acceptor(net::make_strand(ioc))
+    , m_metrics(metrics)
+    , m_write_engine(write_engine)
+    , m_memory_budget(memory_budget)
+    , m_block_pool(block_pool)
+{
+    TcpListener::listen(m_acceptor, port, false);
+    accept();
+}
+
+/**
+ * @brief Returns the metrics of the server, of the write engine, of the memory budget and of the block pool in the Prometheus text format.
+ */
+std::string MetricsServer::render() const
+{
+    std::string text = m_metrics.render();
+
+    text += "# HELP itlh_save_queue_depth Disk operations queued in the write engine.\n";
+    text += "# TYPE itlh_save_queue_depth gauge\n";
+    text += "itlh_save_queue_depth " + std::to_string(m_write_engine.queue_depth()) + "\n";
+    text += "# HELP itlh_save_queue_peak_depth Highest number of disk operations queued in the write engine.\n";
+    text += "# TYPE itlh_save_queue_peak_depth gauge\n";
+    text += "itlh_save_queue_peak_depth " + std::to_string(m_write_engine.peak_queue_depth()) + "\n";
+    text += "# HELP itlh_save_queue_max_depth Queue depth above which the sessions stop reading.\n";
+    text += "# TYPE itlh_save_queue_max_depth gauge\n";
+    text += "itlh_save_queue_max_depth " + std::to_string(m_write_engine.max_queue_depth()) + "\n";
+    m_write_engine.render_metrics(text);
+
+    text += "# HELP itlh_memory_budget_bytes Memory for the receive chunks of all the sessions.\n";
+    text += "# TYPE itlh_memory_budget_bytes gauge\n";
+    text += "itlh_memory_budget_bytes " + std::to_string(m_memory_budget.capacity()) + "\n";
+    text += "# HELP itlh_memory_reserved_bytes Memory of the receive chunks allocated by the sessions.\n";
+    text += "# TYPE itlh_memory_reserved_bytes gauge\n";
+    text += "itlh_memory_reserved_bytes " + std::to_string(m_memory_budget.reserved()) + "\n";
+    text += "# HELP itlh_memory_reserved_peak_bytes Highest memory of the receive chunks allocated by the sessions.\n";
+    text += "# TYPE itlh_memory_reserved_peak_bytes gauge\n";
+    text += "itlh_memory_reserved_peak_bytes " + std::to_string(m_memory_budget.peak_reserved()) + "\n";
+    text += "# HELP itlh_memory_waiting_sessions Sessions that stopped reading until memory is released.\n";
+    text += "# TYPE itlh_memory_waiting_sessions gauge\n";
+    text += "itlh_memory_waiting_sessions " + std::to_string(m_memory_budget.waiter_count()) + "\n";
+    text += "# HELP itlh_memory_waits_total Reads delayed because the memory budget was exhausted.\n";
+    text += "# TYPE itlh_memory_waits_total counter\n";
+    text += "itlh_memory_waits_total " + std::to_string(m_memory_budget.wait_count()) + "\n";
+    text += "# HELP itlh_receive_pool_bytes Memory of the receive blocks allocated, in use or kept free for reuse.\n";
+    text += "# TYPE itlh_receive_pool_bytes gauge\n";
+    text += "itlh_receive_pool_bytes " + std::to_string(m_block_pool.allocated_count() * m_block_pool.block_size()) + "\n";
+    text += "# HELP itlh_receive_pool_free_bytes Memory of the receive blocks kept free for reuse.\n";
+    text += "# TYPE itlh_receive_pool_free_bytes gauge\n";
+    text += "itlh_receive_pool_free_bytes " + std::to_string(m_block_pool.free_count() * m_block_pool.block_size()) + "\n";
+    if (AllocationCounter::is_enabled())
+    {
+        text += "# HELP itlh_allocations_total Memory allocations of the server since its start.\n";
+        text += "# TYPE itlh_allocations_total counter\n";
+        text += "itlh_allocations_total " + std::to_string(AllocationCounter::count()) + "\n";
+    }
+    else
+    {
+        text += "# HELP itlh_allocations_total Memory allocations of the server since its start, unavailable : server built without ITLH_COUNT_ALLOCATIONS.\n";
+        text += "# TYPE itlh_allocations_total counter\n";
+    }
+
+    return text;
+}
+
+/**
+ * @brief Accepts the next metrics connection.
+ */
+void MetricsServer::accept()
+{
+    m_acceptor.async_accept(net::make_strand(m_ioc), [this](beast::error_code ec, tcp::socket socket) {
+        if (!ec) std::make_shared<MetricsConnection>(std::move(socket), *this)->run();
+        accept();
+        });
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "FileWriteEngine.h"
+#include "MemoryBudget.h"
+#include "ReceiveBlockPool.h"
+#include "ServerMetrics.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <cstdint>
+#include <string>
+
+class MetricsServer
+{
+public:
+	MetricsServer(boost::asio::io_context& ioc, uint_least16_t port, const ServerMetrics& metrics, const FileWriteEngine& write_engine, const MemoryBudget& memory_budget, const ReceiveBlockPool& block_pool);
+
+	std::string render() const;
+
+private:
+	void accept();
+
+	boost::asio::io_context& m_ioc;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	const ServerMetrics& m_metrics;
+	const FileWriteEngine& m_write_engine;
+	const MemoryBudget& m_memory_budget;
+	const ReceiveBlockPool& m_block_pool;
+};
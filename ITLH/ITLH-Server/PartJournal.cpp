@@ -0,0 +1,352 @@
+#include "PartJournal.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <ios>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class PartJournal
+ * @brief Remembers the files partly received from clients that can resume their upload after a disconnect.
+ *
+ * A resumable file is written in a part file of the save directory, `.itlh_<client token>_<file id>.part`, and
+ * renamed into place once complete. For each part file, the journal keeps the client token, the file id, the name,
+ * size and last modified date sent by the client, and the number of bytes written in the part file (committed),
+ * recorded when the client leaves in the middle of the file. A client that connects again with the same token asks
+ * the committed offset of its file with `start()`, and sends only the rest.
+ *
+ * A part is held by the session the client sends it to. A client can connect again while its previous connection is
+ * still open on the server, like a phone gone off Wi-Fi without closing it : the new session takes the part over, and
+ * the commits and the finish of the previous session are then ignored, so they don't replace the progress of the new one.
+ *
+ * The parts are kept in memory in a hash map and saved in a journal file of the save directory, one line appended
+ * for each change. The journal is read again when the server starts and rewritten without its outdated lines,
+ * parts not resumed since `PART_EXPIRY` are removed with their part file.
+ *
+ * All the functions can be called from many threads at the same time.
+ */
+
+constexpr char JOURNAL_FILE_NAME[] = ".itlh_parts";
+constexpr std::size_t MAX_TOKEN_LENGTH = 64;
+constexpr std::chrono::hours PART_EXPIRY(24 * 7);
+
+/**
+ * @brief Returns the current time in seconds since Unix epoch.
+ */
+static int64_t get_unix_time()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Loads the journal of the directory, and opens it for recording the next changes.
+ *
+ * @param directory The save directory.
+ *
+ * @exception std::ios_base::failure Thrown if the journal can't be opened for writing.
+ */
+PartJournal::PartJournal(const std::string& directory)
+    : m_directory(directory)
+    , m_journal_path((std::filesystem::path(directory) / JOURNAL_FILE_NAME).string())
+{
+    load();
+
+    m_journal.open(m_journal_path, std::ios::binary | std::ios::app);
+    if (!m_journal)
+    {
+        throw std::ios_base::failure("Failed to open part journal: " + m_journal_path);
+    }
+}
+
+/**
+ * @brief Checks a client token : 1 to `MAX_TOKEN_LENGTH` letters, digits, '-' or '_', so it can be used in a file name.
+ */
+bool PartJournal::is_valid_token(const std::string& client_token)
+{
+    return !client_token.empty() && client_token.size() <= MAX_TOKEN_LENGTH
+        && std::all_of(client_token.begin(), client_token.end(), [](char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+            });
+}
+
+/**
+ * @brief Returns the key of a part, made of the client token and the file id.
+ */
+std::string PartJournal::make_key(const std::string& client_token, uint32_t file_id)
+{
+    return client_token + ' ' + std::to_string(file_id);
+}
+
+/**
+ * @brief Returns the name of the part file of a key.
+ */
+std::string PartJournal::make_part_name(const std::string& key)
+{
+    std::string part_name = ".itlh_" + key + ".part";
+    std::replace(part_name.begin(), part_name.end(), ' ', '_');
+    return part_name;
+}
+
+/**
+ * @brief Returns the path of the part file of a key.
+ */
+std::string PartJournal::get_full_path(const std::string& key) const
+{
+    return (std::filesystem::path(m_directory) / make_part_name(key)).string();
+}
+
+/**
+ * @brief Writes the journal line of a part.
+ *
+ * The line is `<client token> <file id> <size> <last modified date> <committed> <update time> <client file name>`,
+ * a finished part is written `<client token> <file id> -`.
+ */
+void PartJournal::write_line(std::ostream& stream, const std::string& key, const Part& part)
+{
+    char date[32];
+    const std::to_chars_result date_result = std::to_chars(date, date + sizeof(date), part.last_modified);
+
+    stream << key << ' ' << part.size << ' ';
+    stream.write(date, date_result.ptr - date);
+    stream << ' ' << part.committed << ' ' << part.update_time << ' ' << part.client_name << '\n';
+}
+
+/**
+ * @brief Reads the journal, a later line of a part replaces the previous ones.
+ *
+ * Unreadable lines are skipped. Expired parts and parts without their part file are dropped, the journal is then
+ * rewritten with one line per part when it holds more lines.
+ */
+void PartJournal::load()
+{
+    std::ifstream journal(m_journal_path, std::ios::binary);
+    if (!journal)
+    {
+        return; // no resumable file received yet
+    }
+
+    std::size_t line_count = 0;
+    std::string line;
+    while (std::getline(journal, line))
+    {
+        line_count++;
+
+        const char* position = line.data();
+        const char* end = line.data() + line.size();
+
+        auto read_value = [&position, end](auto& value) {
+            const std::from_chars_result result = std::from_chars(position, end, value);
+            if (result.ec != std::errc() || result.ptr == end || *result.ptr != ' ')
+            {
+                return false;
+            }
+            position = result.ptr + 1;
+            return true;
+            };
+
+        const char* token_end = std::find(position, end, ' ');
+        const std::string client_token(position, token_end);
+        if (token_end == end || !is_valid_token(client_token))
+        {
+            continue;
+        }
+        position = token_end + 1;
+
+        uint32_t file_id = 0;
+        if (!read_value(file_id))
+        {
+            continue;
+        }
+        const std::string key = make_key(client_token, file_id);
+
+        if (std::string_view(position, end - position) == "-")
+        {
+            m_parts.erase(key);
+            continue;
+        }
+
+        Part part;
+        if (!read_value(part.size) || !read_value(part.last_modified) || !read_value(part.committed) || !read_value(part.update_time))
+        {
+            continue;
+        }
+        part.client_name.assign(position, end);
+        m_parts[key] = part;
+    }
+    journal.close();
+
+    const int64_t expiry_time = get_unix_time() - std::chrono::duration_cast<std::chrono::seconds>(PART_EXPIRY).count();
+    for (auto part = m_parts.begin(); part != m_parts.end();)
+    {
+        std::error_code error;
+        if (part->second.update_time < expiry_time || !std::filesystem::exists(get_full_path(part->first), error))
+        {
+            std::filesystem::remove(get_full_path(part->first), error);
+            part = m_parts.erase(part);
+        }
+        else
+        {
+            ++part;
+        }
+    }
+
+    if (line_count > m_parts.size())
+    {
+        const std::string temporary_path = m_journal_path + ".tmp";
+        {
+            std::ofstream compacted(temporary_path, std::ios::binary | std::ios::trunc);
+            for (const auto& [key, part] : m_parts)
+            {
+                write_line(compacted, key, part);
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, m_journal_path, error);
+    }
+}
+
+/**
+ * @brief Gives the offset from which a client sends a resumable file, and records the part if it's new.
+ *
+ * The bytes committed are kept only if the part was started for the same file name, size and date, and if its part
+ * file is still present. Otherwise the part starts again from 0, and a previous part file is removed.
+ *
+ * @param client_token The token the client keeps across its connections.
+ * @param file_id The id of the file, chosen by the client and stable across its connections.
+ * @param client_name The name of the file on the client.
+ * @param size The size of the file.
+ * @param last_modified The last modified date sent by the client.
+ * @param holder The session the file is sent to, it holds the part from now on, also if another session still holds it.
+ *
+ * @return The number of bytes of the file already written, the client sends the file from this offset.
+ */
+uint64_t PartJournal::start(const std::string& client_token, uint32_t file_id, const std::string& client_name, uint64_t size, double last_modified, const void* holder)
+{
+    const std::string key = make_key(client_token, file_id);
+    const std::string full_path = get_full_path(key);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto existing_part = m_parts.find(key);
+    if (existing_part != m_parts.end())
+    {
+        Part& part = existing_part->second;
+        std::error_code error;
+        if (part.client_name == client_name && part.size == size && part.last_modified == last_modified && std::filesystem::exists(full_path, error))
+        {
+            part.holder = holder;
+            return part.committed;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove(full_path, error);
+
+    Part part;
+    part.client_name = client_name.find_first_of("\r\n") == std::string::npos ? client_name : std::string(); // can't be written on a journal line
+    part.size = size;
+    part.last_modified = last_modified;
+    part.update_time = get_unix_time();
+    part.holder = holder;
+    m_parts[key] = part;
+
+    write_line(m_journal, key, part);
+    m_journal.flush();
+    return 0;
+}
+
+/**
+ * @brief Finds the part of a file sent from an offset.
+ *
+ * @param client_token The token of the client.
+ * @param file_id The id of the file.
+ * @param size The size of the file, it must be the size given to `start()`.
+ * @param full_path Receives the path of the part file.
+ * @param committed Receives the number of bytes already written in the part file.
+ *
+ * @return false if `start()` wasn't called for this file.
+ */
+bool PartJournal::find(const std::string& client_token, uint32_t file_id, uint64_t size, std::string& full_path, uint64_t& committed)
+{
+    const std::string key = make_key(client_token, file_id);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto part = m_parts.find(key);
+    if (part == m_parts.end() || part->second.size != size)
+    {
+        return false;
+    }
+
+    full_path = get_full_path(key);
+    committed = part->second.committed;
+    return true;
+}
+
+/**
+ * @brief Records the number of bytes written in the part file of a file, once its writes are done.
+ *
+ * Nothing is recorded if the part is finished already, like when the client sent it again on a new connection, or
+ * if another session took the part over.
+ *
+ * @param client_token The token of the client.
+ * @param file_id The id of the file.
+ * @param committed The number of bytes of the file written in its part file.
+ * @param holder The session that wrote the bytes, it releases the part.
+ */
+void PartJournal::commit(const std::string& client_token, uint32_t file_id, uint64_t committed, const void* holder)
+{
+    const std::string key = make_key(client_token, file_id);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto part = m_parts.find(key);
+    if (part == m_parts.end() || part->second.holder != holder)
+    {
+        return;
+    }
+
+    part->second.committed = std::min(committed, part->second.size);
+    part->second.update_time = get_unix_time();
+    part->second.holder = nullptr;
+
+    write_line(m_journal, key, part->second);
+    m_journal.flush();
+}
+
+/**
+ * @brief Removes the part of a file renamed into place, or of a file not kept, unless another session took it over.
+ *
+ * @param client_token The token of the client.
+ * @param file_id The id of the file.
+ * @param holder The session that received the file.
+ */
+void PartJournal::finish(const std::string& client_token, uint32_t file_id, const void* holder)
+{
+    const std::string key = make_key(client_token, file_id);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto part = m_parts.find(key);
+    if (part == m_parts.end() || (part->second.holder != nullptr && part->second.holder != holder))
+    {
+        return;
+    }
+    m_parts.erase(part);
+
+    m_journal << key << " -\n";
+    m_journal.flush();
+}
+
+/**
+ * @brief Returns the number of parts that can be resumed.
+ */
+std::size_t PartJournal::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_parts.size();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class PartJournal
+{
+public:
+	explicit PartJournal(const std::string& directory);
+
+	static bool is_valid_token(const std::string& client_token);
+
+	uint64_t start(const std::string& client_token, uint32_t file_id, const std::string& client_name, uint64_t size, double last_modified, const void* holder);
+	bool find(const std::string& client_token, uint32_t file_id, uint64_t size, std::string& full_path, uint64_t& committed);
+	void commit(const std::string& client_token, uint32_t file_id, uint64_t committed, const void* holder);
+	void finish(const std::string& client_token, uint32_t file_id, const void* holder);
+
+	std::size_t size() const;
+
+private:
+	struct Part
+	{
+		std::string client_name;
+		uint64_t size = 0;
+		double last_modified = 0.0;
+		uint64_t committed = 0; // bytes of the file written in the part file
+		int64_t update_time = 0; // seconds since Unix epoch
+		const void* holder = nullptr; // session the file is sent to, not saved in the journal
+	};
+
+	static std::string make_key(const std::string& client_token, uint32_t file_id);
+	static std::string make_part_name(const std::string& key);
+	static void write_line(std::ostream& stream, const std::string& key, const Part& part);
+	void load();
+	std::string get_full_path(const std::string& key) const;
+
+	const std::string m_directory;
+	const std::string m_journal_path;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::string, Part> m_parts; // key : client token and file id
+	std::ofstream m_journal;
+};
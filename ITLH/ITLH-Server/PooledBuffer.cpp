@@ -0,0 +1,145 @@
+#include "PooledBuffer.h"
+
+#include <algorithm>
+#include <limits>
+
+/**
+ * @class PooledBuffer
+ * @brief A Beast dynamic buffer whose memory is made of blocks borrowed from the receive block pool.
+ *
+ * It meets the requirements of a DynamicBuffer (version 1) of Boost.Asio, so Beast can read a WebSocket message
+ * straight into it. The readable bytes span the blocks in order : growing the buffer borrows a new block instead of
+ * reallocating and copying the bytes already received, and the blocks go back to the pool as soon as their bytes
+ * are consumed. An empty buffer holds no block.
+ */
+
+/**
+ * @param pool The pool the blocks are borrowed from, it must outlive the buffer.
+ */
+PooledBuffer::PooledBuffer(ReceiveBlockPool& pool)
+    : m_pool(pool)
+{
+}
+
+/**
+ * @brief Returns the maximum number of readable bytes, the buffer is only bounded by the memory.
+ */
+std::size_t PooledBuffer::max_size() const
+{
+    return std::numeric_limits<std::size_t>::max();
+}
+
+/**
+ * @brief Returns the number of bytes that can be held without borrowing another block.
+ */
+std::size_t PooledBuffer::capacity() const
+{
+    return m_blocks.size() * m_pool.block_size() - m_offset;
+}
+
+/**
+ * @brief Returns the readable bytes, one buffer per block.
+ */
+PooledBuffer::const_buffers_type PooledBuffer::data() const
+{
+    const_buffers_type buffers;
+    std::size_t offset = m_offset;
+    std::size_t remaining_size = m_size;
+    for (auto block = m_blocks.begin(); remaining_size > 0; ++block)
+    {
+        const std::size_t size = std::min(remaining_size, block->size() - offset);
+        buffers.emplace_back(block->data() + offset, size);
+        remaining_size -= size;
+        offset = 0;
+    }
+    return buffers;
+}
+
+/**
+ * @brief Returns writable bytes after the readable ones, borrowing the blocks needed.
+ *
+ * @param size Number of writable bytes.
+ *
+ * @return The writable bytes, one buffer per block. They're invalidated by the next call to a function of the buffer.
+ */
+PooledBuffer::mutable_buffers_type PooledBuffer::prepare(std::size_t size)
+{
+    while (capacity() - m_size < size)
+    {
+        m_blocks.push_back(m_pool.acquire());
+    }
+    m_prepared_size = size;
+
+    mutable_buffers_type buffers;
+    const std::size_t block_size = m_pool.block_size();
+    std::size_t position = m_offset + m_size;
+    for (std::size_t remaining_size = size; remaining_size > 0;)
+    {
+        const ReceiveBlockPool::Block& block = m_blocks[position / block_size];
+        const std::size_t offset = position % block_size;
+        const std::size_t part_size = std::min(remaining_size, block_size - offset);
+        buffers.emplace_back(block.data() + offset, part_size);
+        position += part_size;
+        remaining_size -= part_size;
+    }
+    return buffers;
+}
+
+/**
+ * @brief Makes readable the first bytes written in the buffers given by `prepare()`.
+ *
+ * @param size Number of bytes written, the bytes above the size prepared are ignored.
+ */
+void PooledBuffer::commit(std::size_t size)
+{
+    m_size += std::min(size, m_prepared_size);
+    m_prepared_size = 0;
+}
+
+/**
+ * @brief Removes the first readable bytes, and gives back to the pool the blocks emptied.
+ *
+ * @param size Number of bytes removed, all the readable bytes if it's bigger.
+ */
+void PooledBuffer::consume(std::size_t size)
+{
+    if (size >= m_size)
+    {
+        clear();
+        return;
+    }
+
+    m_size -= size;
+    m_offset += size;
+    const std::size_t block_size = m_pool.block_size();
+    while (m_offset >= block_size)
+    {
+        m_blocks.pop_front();
+        m_offset -= block_size;
+    }
+}
+
+/**
+ * @brief Returns a copy of the readable bytes.
+ */
+std::string PooledBuffer::to_string() const
+{
+    std::string text;
+    text.reserve(m_size);
+    for (const boost::asio::const_buffer& buffer : data())
+    {
+        text.append(static_cast<const char*>(buffer.data()), buffer.size());
+    }
+    return text;
+}
+
+/**
+ * @brief Removes all the bytes, and gives back all the blocks to the pool.
+ */
+void PooledBuffer::clear()
+{
+    m_blocks.clear();
+    m_offset = 0;
+    m_size = 0;
+    m_prepared_size = 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "ReceiveBlockPool.h"
+
+#include <boost/asio/buffer.hpp>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+class PooledBuffer
+{
+public:
+	using const_buffers_type = std::vector<boost::asio::const_buffer>;
+	using mutable_buffers_type = std::vector<boost::asio::mutable_buffer>;
+
+	explicit PooledBuffer(ReceiveBlockPool& pool);
+
+	std::size_t size() const { return m_size; }
+	std::size_t max_size() const;
+	std::size_t capacity() const;
+	const_buffers_type data() const;
+	mutable_buffers_type prepare(std::size_t size);
+	void commit(std::size_t size);
+	void consume(std::size_t size);
+
+	std::string to_string() const;
+	void clear();
+
+private:
+	ReceiveBlockPool& m_pool;
+	std::deque<ReceiveBlockPool::Block> m_blocks;
+	std::size_t m_offset = 0; // first readable byte in the first block
+	std::size_t m_size = 0; // readable bytes
+	std::size_t m_prepared_size = 0; // writable bytes after the readable ones, given by the last prepare()
+};
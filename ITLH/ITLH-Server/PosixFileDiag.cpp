@@ -0,0 +1,209 @@
+#include "WindowsFileDiag.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <ios>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief POSIX implementation of the folder selection, there is no dialog on a headless server.
+ *
+ * The destination folder is given on the command line with `--dest <folder>`, this function is only
+ * called when it's missing.
+ *
+ * @return An empty string, no folder is selected.
+ */
+std::string WindowsFileDiag::open_select_folder_diag_window()
+{
+    std::cerr << "No folder selection dialog on this system, give the destination folder with --dest <folder>." << std::endl;
+    return "";
+}
+
+/**
+ * @brief Creates a file and opens it for writing the data received.
+ *
+ * The file is created or truncated, or kept as it is to write the rest of a part file. When the size of the file is known, the disk space is allocated
+ * at once with `posix_fallocate`, so the file isn't fragmented and a full disk is detected before any
+ * data is written. The same descriptor is used to write the data and to apply the file date, so the
+ * file is opened only once.
+ *
+ * @param file_path The path of the file to create.
+ * @param file_size The size the file will have, 0 if unknown.
+ * @param keep_data true to keep the data of an existing file, false to truncate it.
+ *
+ * @return The descriptor of the opened file.
+ *
+ * @exception std::ios_base::failure Thrown if the file can't be created or its disk space can't be allocated.
+ */
+WindowsFileDiag::FileHandle WindowsFileDiag::open_file_for_write(const std::string& file_path, uint64_t file_size, bool keep_data)
+{
+    const int file_descriptor = open(file_path.c_str(), O_WRONLY | O_CREAT | (keep_data ? 0 : O_TRUNC) | O_CLOEXEC, 0666);
+    if (file_descriptor < 0)
+    {
+        throw std::ios_base::failure("Failed to open file: " + file_path + " for writing, " + std::strerror(errno));
+    }
+
+    if (file_size > 0)
+    {
+        const int error = posix_fallocate(file_descriptor, 0, static_cast<off_t>(file_size));
+        // EINVAL and EOPNOTSUPP : file system without allocation, the file grows with the writes
+        if (error != 0 && error != EINVAL && error != EOPNOTSUPP)
+        {
+            close(file_descriptor);
+            throw std::ios_base::failure("Failed to allocate " + std::to_string(file_size) + " octets for file: " + file_path + ", " + std::strerror(error));
+        }
+    }
+
+    return file_descriptor;
+}
+
+/**
+ * @brief Writes data at a given position of an opened file.
+ *
+ * The data are written with `pwrite`, one call for a whole received chunk unless the system writes less.
+ *
+ * @param file_handle The descriptor given by `open_file_for_write()`.
+ * @param offset The position in the file of the first byte to write.
+ * @param data The data to write.
+ * @param size The number of bytes to write.
+ *
+ * @exception std::ios_base::failure Thrown if the data can't be written, like when the disk is full.
+ */
+void WindowsFileDiag::write_file(FileHandle file_handle, uint64_t offset, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written_size = pwrite(file_handle, data, size, static_cast<off_t>(offset));
+        if (written_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written_size <= 0)
+        {
+            throw std::ios_base::failure(std::string("Failed to write file, ") + std::strerror(errno));
+        }
+
+        data += written_size;
+        size -= static_cast<size_t>(written_size);
+        offset += static_cast<uint64_t>(written_size);
+    }
+}
+
+/**
+ * @brief Sets the date of an opened file based on a Unix timestamp.
+ *
+ * POSIX systems have no settable creation time, the date is applied as access and modification time
+ * with `futimens` on the descriptor used for writing.
+ *
+ * @param file_handle The descriptor given by `open_file_for_write()`.
+ * @param date The timestamp in milliseconds since Unix epoch.
+ *
+ * @warning If the file times cannot be modified, an error message is logged to `std::cerr`,
+ * and no changes are made.
+ */
+void WindowsFileDiag::apply_date_on_file(FileHandle file_handle, double date)
+{
+    const double seconds = std::floor(date / 1000.0);
+
+    timespec times[2];
+    times[0].tv_sec = static_cast<time_t>(seconds);
+    times[0].tv_nsec = static_cast<long>((date - seconds * 1000.0) * 1'000'000.0);
+    times[1] = times[0];
+
+    if (futimens(file_handle, times) != 0)
+    {
+        std::cerr << "Error : Can't change file time attribut. " << std::strerror(errno) << std::endl;
+    }
+}
+
+/**
+ * @brief Closes a file opened by `open_file_for_write()`.
+ *
+ * @param file_handle The descriptor of the file.
+ */
+void WindowsFileDiag::close_file(FileHandle file_handle)
+{
+    close(file_handle);
+}
+
+/**
+ * @brief Opens a closed file again to flush its data on disk.
+ *
+ * `fsync` works on a descriptor opened for reading, the data written by another descriptor are flushed with it.
+ *
+ * @param file_path The path of the file.
+ *
+ * @return The descriptor of the file, to close with `close_file()`.
+ *
+ * @exception std::ios_base::failure Thrown if the file can't be opened.
+ */
+WindowsFileDiag::FileHandle WindowsFileDiag::open_file_for_flush(const std::string& file_path)
+{
+    const int file_descriptor = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_descriptor < 0)
+    {
+        throw std::ios_base::failure("Failed to open file: " + file_path + " for flush, " + std::strerror(errno));
+    }
+    return file_descriptor;
+}
+
+/**
+ * @brief Starts the write on disk of the data of a file without waiting for it.
+ *
+ * On Linux, `sync_file_range` queues the write back of the dirty pages of the file, so the writes of many files run
+ * together on the disk before each file is flushed by `flush_file()`. Does nothing on other systems.
+ *
+ * @param file_handle The descriptor of the file.
+ */
+void WindowsFileDiag::start_flush_file(FileHandle file_handle)
+{
+#ifdef __linux__
+    sync_file_range(file_handle, 0, 0, SYNC_FILE_RANGE_WRITE);
+#else
+    (void)file_handle;
+#endif
+}
+
+/**
+ * @brief Waits until the data and the attributes of a file are written on disk, with `fsync`.
+ *
+ * @param file_handle The descriptor of the file.
+ *
+ * @exception std::ios_base::failure Thrown if the disk reports an error, the data of the file may be lost.
+ */
+void WindowsFileDiag::flush_file(FileHandle file_handle)
+{
+    if (fsync(file_handle) != 0)
+    {
+        throw std::ios_base::failure(std::string("Failed to flush file on disk, ") + std::strerror(errno));
+    }
+}
+
+/**
+ * @brief Waits until the entries of a directory are written on disk, so the files created or renamed in it
+ * are found after a power loss.
+ *
+ * @param directory_path The path of the directory.
+ *
+ * @exception std::ios_base::failure Thrown if the directory can't be opened or flushed.
+ */
+void WindowsFileDiag::flush_directory(const std::string& directory_path)
+{
+    const int directory_descriptor = open(directory_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_descriptor < 0)
+    {
+        throw std::ios_base::failure("Failed to open directory: " + directory_path + " for flush, " + std::strerror(errno));
+    }
+
+    const int result = fsync(directory_descriptor);
+    const int error = errno;
+    close(directory_descriptor);
+    if (result != 0)
+    {
+        throw std::ios_base::failure("Failed to flush directory: " + directory_path + ", " + std::strerror(error));
+    }
+}
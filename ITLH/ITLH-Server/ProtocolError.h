@@ -0,0 +1,10 @@
+#pragma once
+#include <stdexcept>
+
+// Error of a client that doesn't follow the protocol, it closes the session of the client only : thrown while a message
+// is parsed, caught where the session processes the bytes read. The other exceptions of a network thread stop the server.
+class ProtocolError : public std::runtime_error
+{
+public:
+	using std::runtime_error::runtime_error;
+};
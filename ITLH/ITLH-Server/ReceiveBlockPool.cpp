@@ -0,0 +1,119 @@
+#include "ReceiveBlockPool.h"
+
+/**
+ * @class ReceiveBlockPool
+ * @brief Fixed-size blocks shared by all the sessions to receive data, reused instead of allocated for each read.
+ *
+ * A session borrows a block with `acquire()`, the block goes back to the pool when its `Block` is destroyed, once
+ * its data are written to disk. The blocks freed are kept for the next sessions up to `max_free_count`, so a burst
+ * of uploads doesn't allocate, zero and fault in again its memory at each new connection. The blocks above are
+ * freed, the memory kept by the pool is bounded like the memory budget of the sessions.
+ *
+ * The blocks aren't initialized, the data read into them are the only bytes used.
+ *
+ * All the functions can be called from many threads at the same time. The pool must outlive its blocks.
+ */
+
+/**
+ * @param block_size Number of bytes of each block.
+ * @param max_free_count Number of free blocks kept for reuse.
+ */
+ReceiveBlockPool::ReceiveBlockPool(std::size_t block_size, std::size_t max_free_count)
+    : m_block_size(block_size)
+    , m_max_free_count(max_free_count)
+{
+}
+
+ReceiveBlockPool::~ReceiveBlockPool()
+{
+    for (uint8_t* data : m_free_blocks)
+    {
+        delete[] data;
+    }
+}
+
+/**
+ * @brief Borrows a block, a free block of the pool or a new one.
+ */
+ReceiveBlockPool::Block ReceiveBlockPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free_blocks.empty())
+        {
+            uint8_t* data = m_free_blocks.back();
+            m_free_blocks.pop_back();
+            m_free_count = m_free_blocks.size();
+            return Block(this, data);
+        }
+    }
+
+    uint8_t* data = new uint8_t[m_block_size];
+    m_allocated_count++;
+    return Block(this, data);
+}
+
+/**
+ * @brief Takes back a block, it's kept for reuse or freed if the pool holds enough free blocks.
+ */
+void ReceiveBlockPool::give_back(uint8_t* data)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free_blocks.size() < m_max_free_count)
+        {
+            m_free_blocks.push_back(data);
+            m_free_count = m_free_blocks.size();
+            return;
+        }
+    }
+
+    delete[] data;
+    m_allocated_count--;
+}
+
+ReceiveBlockPool::Block::Block(ReceiveBlockPool* pool, uint8_t* data)
+    : m_pool(pool)
+    , m_data(data)
+{
+}
+
+ReceiveBlockPool::Block::Block(Block&& other) noexcept
+    : m_pool(other.m_pool)
+    , m_data(other.m_data)
+{
+    other.m_pool = nullptr;
+    other.m_data = nullptr;
+}
+
+ReceiveBlockPool::Block& ReceiveBlockPool::Block::operator=(Block&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_data)
+        {
+            m_pool->give_back(m_data);
+        }
+        m_pool = other.m_pool;
+        m_data = other.m_data;
+        other.m_pool = nullptr;
+        other.m_data = nullptr;
+    }
+    return *this;
+}
+
+ReceiveBlockPool::Block::~Block()
+{
+    if (m_data)
+    {
+        m_pool->give_back(m_data);
+    }
+}
+
+/**
+ * @brief Returns the number of bytes of the block, 0 for an empty block.
+ */
+std::size_t ReceiveBlockPool::Block::size() const
+{
+    return m_pool ? m_pool->block_size() : 0;
+}
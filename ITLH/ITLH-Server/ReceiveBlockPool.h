@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class ReceiveBlockPool
+{
+public:
+	class Block
+	{
+	public:
+		Block() = default;
+		Block(Block&& other) noexcept;
+		Block& operator=(Block&& other) noexcept;
+		~Block();
+
+		uint8_t* data() const { return m_data; }
+		std::size_t size() const;
+
+	private:
+		friend class ReceiveBlockPool;
+		Block(ReceiveBlockPool* pool, uint8_t* data);
+
+		ReceiveBlockPool* m_pool = nullptr;
+		uint8_t* m_data = nullptr;
+	};
+
+	ReceiveBlockPool(std::size_t block_size, std::size_t max_free_count);
+	~ReceiveBlockPool();
+	ReceiveBlockPool(const ReceiveBlockPool&) = delete;
+	ReceiveBlockPool& operator=(const ReceiveBlockPool&) = delete;
+
+	Block acquire();
+
+	std::size_t block_size() const { return m_block_size; }
+	std::size_t allocated_count() const { return m_allocated_count; }
+	std::size_t free_count() const { return m_free_count; }
+
+private:
+	void give_back(uint8_t* data);
+
+	const std::size_t m_block_size;
+	const std::size_t m_max_free_count;
+	std::atomic<std::size_t> m_allocated_count = 0; // blocks in use or free
+	std::atomic<std::size_t> m_free_count = 0;
+
+	std::mutex m_mutex;
+	std::vector<uint8_t*> m_free_blocks;
+};
@@ -0,0 +1,85 @@
+#include "ReceivedBatch.h"
+
+#include "ProtocolError.h"
+
+#include <utility>
+
+/**
+ * @class ReceivedBatch
+ * @brief State of a batch message, its files are acknowledged by a single message once they are all saved.
+ *
+ * The batch counts the files whose header was received, and keeps the status of each file once it is saved,
+ * removed as a duplicate or rejected. Its ACK can be sent once the end of the message is reached and every file is
+ * acknowledged, with the saved files whose times are recorded then. The batch is used by its session only.
+ */
+
+/**
+ * @param batch_id The id of the batch chosen by the client.
+ * @param file_count The number of files announced in the batch header.
+ */
+ReceivedBatch::ReceivedBatch(uint32_t batch_id, uint32_t file_count)
+    : m_batch_id(batch_id)
+    , m_file_count(file_count)
+    , m_statuses(file_count, '-')
+{
+}
+
+/**
+ * @brief Counts a file whose header was received.
+ *
+ * @return The position of the file in the batch.
+ *
+ * @throws ProtocolError If the batch already holds all its files.
+ */
+uint32_t ReceivedBatch::add_file()
+{
+    if (m_received_count == m_file_count)
+    {
+        throw ProtocolError("Batch " + std::to_string(m_batch_id) + " holds more than its " + std::to_string(m_file_count) + " files");
+    }
+    return m_received_count++;
+}
+
+/**
+ * @brief Marks the end of the message reached.
+ *
+ * @param is_file_pending true if a file or a header of the batch is not fully received.
+ *
+ * @throws ProtocolError If the message ends before its last file.
+ */
+void ReceivedBatch::end_message(bool is_file_pending)
+{
+    if (is_file_pending || m_received_count != m_file_count)
+    {
+        throw ProtocolError("Batch " + std::to_string(m_batch_id) + " ended after " + std::to_string(m_received_count) + " of its " + std::to_string(m_file_count) + " files");
+    }
+    m_is_received = true;
+}
+
+/**
+ * @brief Records the status of a file of the batch.
+ *
+ * @param file_index The position of the file in the batch.
+ * @param status The character of the file in the ACK of the batch.
+ * @param saved_file The file if it's kept on disk, null otherwise, the times of a file not kept are not added to the metrics.
+ *
+ * @return true if the batch can be acknowledged, see `is_acknowledged()`.
+ */
+bool ReceivedBatch::acknowledge(uint32_t file_index, char status, std::shared_ptr<ReceivedFile> saved_file)
+{
+    m_statuses[file_index] = status;
+    m_acknowledged_count++;
+    if (saved_file)
+    {
+        m_saved_files.push_back(std::move(saved_file));
+    }
+    return is_acknowledged();
+}
+
+/**
+ * @brief Checks if the batch is fully received and all its files are acknowledged.
+ */
+bool ReceivedBatch::is_acknowledged() const
+{
+    return m_is_received && m_acknowledged_count == m_file_count;
+}
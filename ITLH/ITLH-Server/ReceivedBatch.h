@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ReceivedFile;
+
+class ReceivedBatch
+{
+public:
+	ReceivedBatch(uint32_t batch_id, uint32_t file_count);
+
+	uint32_t batch_id() const { return m_batch_id; }
+	const std::string& statuses() const { return m_statuses; }
+
+	uint32_t add_file();
+	void end_message(bool is_file_pending);
+	bool acknowledge(uint32_t file_index, char status, std::shared_ptr<ReceivedFile> saved_file);
+	bool is_acknowledged() const;
+	std::vector<std::shared_ptr<ReceivedFile>> take_saved_files() { return std::move(m_saved_files); }
+
+private:
+	const uint32_t m_batch_id;
+	const uint32_t m_file_count;
+	uint32_t m_received_count = 0; // files whose header was received
+	uint32_t m_acknowledged_count = 0;
+	bool m_is_received = false; // end of the message reached
+	std::string m_statuses; // one character per file
+	std::vector<std::shared_ptr<ReceivedFile>> m_saved_files; // their times are recorded once the ACK is sent
+};
@@ -0,0 +1,346 @@
+#include "SaveWorkerPool.h"
+#include "WindowsFileDiag.h"
+
+#include <boost/asio/post.hpp>
+#include <filesystem>
+
+/**
+ * @class SaveWorkerPool
+ * @brief File write engine running blocking disk calls (open, write, close, dates) on its own threads.
+ *
+ * The pool owns its own threads, so a slow disk never stalls the network io_context. Each file gets its
+ * own strand : all the jobs of one file run one after the other in the order they were posted, while jobs
+ * of different files run in parallel on the pool threads. It works on every system, and is the fallback
+ * of `IoUringWriteEngine` on Linux kernels without io_uring.
+ */
+
+/**
+ * @struct SaveWorkerPool::PoolFile
+ * @brief State of a file written by the pool, only used by the jobs running on its strand.
+ */
+struct SaveWorkerPool::PoolFile : File
+{
+    explicit PoolFile(boost::asio::thread_pool& threads)
+        : strand(boost::asio::make_strand(threads.get_executor()))
+    {
+    }
+
+    boost::asio::strand<boost::asio::thread_pool::executor_type> strand;
+    bool is_open = false;
+    std::string file_name; // part file : name asked for the file once complete, empty for other files
+    WindowsFileDiag::FileHandle handle = {};
+    std::exception_ptr error; // first error of the file, given to the handlers of the following jobs
+};
+
+/**
+ * @brief Starts the threads of the pool.
+ *
+ * @param file_name_index The index giving a unique name in the save directory to each file.
+ * @param thread_count Number of threads that run the disk jobs.
+ * @param max_queue_depth Number of queued jobs above which `is_full()` returns true.
+ * @param flush_files true to flush each file on disk when it's closed.
+ */
+SaveWorkerPool::SaveWorkerPool(FileNameIndex& file_name_index, unsigned int thread_count, std::size_t max_queue_depth, bool flush_files)
+    : FileWriteEngine(max_queue_depth, flush_files)
+    , m_file_name_index(file_name_index)
+    , m_threads(thread_count)
+{
+}
+
+/**
+ * @brief Waits for all the queued jobs to be done before stopping the threads.
+ *
+ * Queued jobs are not dropped, so files already received are fully written on disk.
+ */
+SaveWorkerPool::~SaveWorkerPool()
+{
+    m_threads.join();
+}
+
+/**
+ * @brief Posts a job of a file on its strand.
+ *
+ * Once the file had an error, the following jobs are not run, their handler receives the first error.
+ *
+ * @param file The file.
+ * @param handler Called with the error thrown by the job, or null. Can be empty.
+ * @param job The job to run, it receives the state of the file.
+ */
+template <class Job>
+void SaveWorkerPool::post(const std::shared_ptr<File>& file, Handler handler, Job&& job)
+{
+    on_operation_queued();
+
+    std::shared_ptr<PoolFile> pool_file = std::static_pointer_cast<PoolFile>(file);
+    boost::asio::post(pool_file->strand, [this, pool_file, handler = std::move(handler), job = std::forward<Job>(job)]() mutable {
+        if (!pool_file->error)
+        {
+            try
+            {
+                job(*pool_file);
+            }
+            catch (...)
+            {
+                pool_file->error = std::current_exception();
+            }
+        }
+
+        if (handler)
+        {
+            handler(pool_file->error);
+        }
+        on_operation_done();
+        });
+}
+
+/**
+ * @brief Queues the opening of the destination file of a received file.
+ *
+ * The file name is made unique in the save directory by the file name index, then the file is opened.
+ * When the file size is known, the disk space of the whole file is reserved at once.
+ *
+ * @param file_name The file name sent by the client.
+ * @param file_size The size announced by the client, 0 if unknown.
+ * @param handler Called once the file is opened.
+ *
+ * @return The file, to give to the other operations.
+ */
+std::shared_ptr<FileWriteEngine::File> SaveWorkerPool::open(const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    std::shared_ptr<File> file = std::make_shared<PoolFile>(m_threads);
+
+    post(file, std::move(handler), [this, file_name, file_size](PoolFile& pool_file) {
+        open_unique_file(pool_file, file_name, file_size);
+        });
+
+    return file;
+}
+
+/**
+ * @brief Queues the writing of received data at their position in the file.
+ *
+ * @param file The file given by `open()`.
+ * @param offset The position in the file of the first byte.
+ * @param data The data, must stay valid until the handler is called.
+ * @param size The number of bytes to write.
+ * @param handler Called once the data are written.
+ */
+void SaveWorkerPool::write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler)
+{
+    post(file, std::move(handler), [offset, data, size](PoolFile& pool_file) {
+        WindowsFileDiag::write_file(pool_file.handle, offset, data, size);
+        });
+}
+
+/**
+ * @brief Queues the application of the file date and the closing of the file, after its last write.
+ *
+ * A part file is then renamed with a free name made from the name asked for the file.
+ *
+ * @param file The file given by `open()`.
+ * @param date The date of the file, in milliseconds since Unix epoch.
+ * @param handler Called once the file is closed.
+ */
+void SaveWorkerPool::close(const std::shared_ptr<File>& file, double date, Handler handler)
+{
+    post(file, std::move(handler), [this, date](PoolFile& pool_file) {
+        WindowsFileDiag::apply_date_on_file(pool_file.handle, date);
+        close_file(pool_file);
+        });
+}
+
+/**
+ * @brief Opens a new file with a free name made from the name sent by the client.
+ *
+ * The name is released if the file can't be opened, `discard()` has no file to remove then.
+ *
+ * @param pool_file The state of the file, run on its strand.
+ * @param file_name The file name sent by the client.
+ * @param file_size The size announced by the client, 0 if unknown.
+ */
+void SaveWorkerPool::open_unique_file(PoolFile& pool_file, const std::string& file_name, uint64_t file_size)
+{
+    pool_file.name_resolution_start = std::chrono::steady_clock::now();
+    pool_file.full_path = m_file_name_index.reserve_unique_path(file_name);
+    pool_file.name_resolution_end = std::chrono::steady_clock::now();
+    try
+    {
+        pool_file.handle = WindowsFileDiag::open_file_for_write(pool_file.full_path, file_size);
+    }
+    catch (...)
+    {
+        m_file_name_index.release_path(pool_file.full_path);
+        throw;
+    }
+    pool_file.is_open = true;
+}
+
+/**
+ * @brief Closes a dated file, flushed on disk before with `flush_files`, and renames a part file into place.
+ *
+ * With `flush_files`, the directory is flushed last, so the new name of the file is on disk too.
+ *
+ * @param pool_file The state of the file, run on its strand.
+ */
+void SaveWorkerPool::close_file(PoolFile& pool_file)
+{
+    if (m_flush_files)
+    {
+        WindowsFileDiag::flush_file(pool_file.handle);
+    }
+    WindowsFileDiag::close_file(pool_file.handle);
+    pool_file.is_open = false;
+
+    if (!pool_file.file_name.empty())
+    {
+        pool_file.name_resolution_start = std::chrono::steady_clock::now();
+        pool_file.full_path = m_file_name_index.move_to_unique_path(pool_file.full_path, pool_file.file_name);
+        pool_file.name_resolution_end = std::chrono::steady_clock::now();
+    }
+
+    if (m_flush_files)
+    {
+        WindowsFileDiag::flush_directory(std::filesystem::path(pool_file.full_path).parent_path().string());
+    }
+}
+
+/**
+ * @brief Queues the closing and the removal of a file that will never be complete.
+ *
+ * The file is removed even if one of its operations failed.
+ *
+ * @param file The file given by `open()`.
+ */
+void SaveWorkerPool::discard(const std::shared_ptr<File>& file)
+{
+    on_operation_queued();
+
+    std::shared_ptr<PoolFile> pool_file = std::static_pointer_cast<PoolFile>(file);
+    boost::asio::post(pool_file->strand, [this, pool_file]() {
+        if (pool_file->is_open)
+        {
+            WindowsFileDiag::close_file(pool_file->handle);
+            pool_file->is_open = false;
+            std::error_code ec;
+            std::filesystem::remove(pool_file->full_path, ec);
+            m_file_name_index.release_path(pool_file->full_path);
+        }
+        on_operation_done();
+        });
+}
+
+/**
+ * @brief Queues the whole writing of a file received at once, as a single job : open, write, date and close.
+ *
+ * @param file_name The file name sent by the client.
+ * @param data The content of the file, must stay valid until the handler is called.
+ * @param size The size of the file.
+ * @param date The date of the file, in milliseconds since Unix epoch.
+ * @param handler Called once the file is closed.
+ *
+ * @return The file, its path is set once the handler is called.
+ */
+std::shared_ptr<FileWriteEngine::File> SaveWorkerPool::save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler)
+{
+    std::shared_ptr<File> file = std::make_shared<PoolFile>(m_threads);
+
+    post(file, std::move(handler), [this, file_name, data, size, date](PoolFile& pool_file) {
+        open_unique_file(pool_file, file_name, 0);
+
+        // The caller doesn't discard a file saved at once, a file not fully saved is removed here
+        try
+        {
+            WindowsFileDiag::write_file(pool_file.handle, 0, data, size);
+            WindowsFileDiag::apply_date_on_file(pool_file.handle, date);
+            close_file(pool_file);
+        }
+        catch (...)
+        {
+            if (pool_file.is_open)
+            {
+                WindowsFileDiag::close_file(pool_file.handle);
+                pool_file.is_open = false;
+            }
+            std::error_code ec;
+            std::filesystem::remove(pool_file.full_path, ec);
+            m_file_name_index.release_path(pool_file.full_path);
+            throw;
+        }
+        });
+
+    return file;
+}
+
+/**
+ * @brief Queues the opening of the part file of a resumable upload.
+ *
+ * The part file is created if it doesn't exist, its data are kept otherwise. Its name is chosen by the caller, the free
+ * name of the file is chosen when the complete file is closed.
+ *
+ * @param part_path The path of the part file in the save directory.
+ * @param file_name The file name sent by the client, given to the file once complete.
+ * @param file_size The size of the whole file.
+ * @param handler Called once the file is opened.
+ *
+ * @return The file, to give to the other operations.
+ */
+std::shared_ptr<FileWriteEngine::File> SaveWorkerPool::open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    std::shared_ptr<PoolFile> file = std::make_shared<PoolFile>(m_threads);
+    file->full_path = part_path;
+    file->file_name = file_name;
+
+    post(file, std::move(handler), [file_size](PoolFile& pool_file) {
+        pool_file.handle = WindowsFileDiag::open_file_for_write(pool_file.full_path, file_size, true);
+        pool_file.is_open = true;
+        });
+
+    return file;
+}
+
+/**
+ * @brief Queues the closing of a part file after its last write, the part file is kept to resume the upload later.
+ *
+ * @param file The file given by `open_part()`.
+ * @param handler Called once the file is closed, all the data given to `write()` are then written.
+ */
+void SaveWorkerPool::detach(const std::shared_ptr<File>& file, Handler handler)
+{
+    post(file, std::move(handler), [](PoolFile& pool_file) {
+        WindowsFileDiag::close_file(pool_file.handle);
+        pool_file.is_open = false;
+        });
+}
+
+/**
+ * @brief Queues a job reading saved files, on the strand of a file after its queued writes, else on any thread of the pool.
+ *
+ * @param file The file whose writes the job reads, or null.
+ * @param job The job, it can throw.
+ * @param handler Called with the error thrown by the job, or the first error of the file, or null.
+ */
+void SaveWorkerPool::run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler)
+{
+    if (file)
+    {
+        post(file, std::move(handler), [job = std::move(job)](PoolFile&) {
+            job();
+            });
+        return;
+    }
+
+    on_operation_queued();
+    boost::asio::post(m_threads, [this, job = std::move(job), handler = std::move(handler)]() {
+        std::exception_ptr error;
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        handler(error);
+        on_operation_done();
+        });
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "FileNameIndex.h"
+#include "FileWriteEngine.h"
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+class SaveWorkerPool : public FileWriteEngine
+{
+public:
+	SaveWorkerPool(FileNameIndex& file_name_index, unsigned int thread_count, std::size_t max_queue_depth, bool flush_files);
+	~SaveWorkerPool() override;
+
+	const char* name() const override { return "save worker pool"; }
+
+	std::shared_ptr<File> open(const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler) override;
+	void close(const std::shared_ptr<File>& file, double date, Handler handler) override;
+	void discard(const std::shared_ptr<File>& file) override;
+	std::shared_ptr<File> save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler) override;
+	std::shared_ptr<File> open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void detach(const std::shared_ptr<File>& file, Handler handler) override;
+	void run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler) override;
+
+private:
+	struct PoolFile;
+
+	template <class Job>
+	void post(const std::shared_ptr<File>& file, Handler handler, Job&& job);
+	void open_unique_file(PoolFile& pool_file, const std::string& file_name, uint64_t file_size);
+	void close_file(PoolFile& pool_file);
+
+	FileNameIndex& m_file_name_index;
+	boost::asio::thread_pool m_threads;
+};
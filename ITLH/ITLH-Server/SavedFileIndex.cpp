@@ -0,0 +1,461 @@
+#include "SavedFileIndex.h"
+
+#include "FileNameIndex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <ios>
+#include <utility>
+#include <vector>
+
+/**
+ * @class SavedFileIndex
+ * @brief Remembers the files saved in the save directory : their content hash, and the files sent by the clients they hold.
+ *
+ * For each file saved by the server, the index keeps its XXH64 hash, its size and its last write time, by file name,
+ * so a file received again with the same content is found (`find_duplicate()`). It also keeps the name, size and last
+ * modified date sent by the client for each saved file, and for each duplicate, so a client can ask which of its files
+ * the server already holds before sending them (`contains()`).
+ *
+ * The index is kept in memory in hash maps, so a lookup doesn't depend on the number of files indexed, and is saved
+ * in a journal file of the save directory, one line per file received, appended as files are saved. The journal is
+ * read again when the server starts and rewritten without its outdated lines.
+ *
+ * The files can be removed or changed out of the server : before a file is given as present, its size and last
+ * write time on disk are checked, an entry that doesn't match its file anymore is removed from the index. The files
+ * are checked without the lock, so a slow disk doesn't stop the other sessions. A duplicate found by its hash is only
+ * a candidate : the caller compares its content byte for byte (`has_content()`, `has_same_content()`) before dropping
+ * the file received, out of the network threads.
+ * Files saved before the journal existed are not indexed. A file saved in an other storage root is indexed by its
+ * full path instead of its name.
+ *
+ * All the functions can be called from many threads at the same time.
+ */
+
+constexpr char JOURNAL_FILE_NAME[] = ".itlh_index";
+constexpr std::size_t COMPARE_BLOCK_SIZE = 256 * 1024; // bytes read at once when comparing a file
+
+/**
+ * @brief Loads the journal of the directory, and opens it for adding the next saved files.
+ *
+ * @param directory The save directory.
+ *
+ * @exception std::ios_base::failure Thrown if the journal can't be opened for writing.
+ */
+SavedFileIndex::SavedFileIndex(const std::string& directory)
+    : m_directory(directory)
+    , m_journal_path((std::filesystem::path(directory) / JOURNAL_FILE_NAME).string())
+{
+    load();
+
+    m_journal.open(m_journal_path, std::ios::binary | std::ios::app);
+    if (!m_journal)
+    {
+        throw std::ios_base::failure("Failed to open index: " + m_journal_path);
+    }
+}
+
+/**
+ * @brief Reads the size and last write time of a file.
+ *
+ * @return false if the file doesn't exist or can't be read.
+ */
+bool SavedFileIndex::read_file(const std::string& full_path, uint64_t& size, int64_t& write_time)
+{
+    const std::filesystem::path path(full_path);
+
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        return false;
+    }
+
+    const std::filesystem::file_time_type file_time = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+        return false;
+    }
+
+    write_time = static_cast<int64_t>(file_time.time_since_epoch().count());
+    return true;
+}
+
+/**
+ * @brief Returns the key of a file sent by a client, made of its name, size and last modified date.
+ */
+std::string SavedFileIndex::make_client_key(const std::string& client_name, uint64_t size, double last_modified)
+{
+    char numbers[64];
+    const std::to_chars_result size_result = std::to_chars(numbers, numbers + sizeof(numbers), size);
+    *size_result.ptr = '\n';
+    const std::to_chars_result date_result = std::to_chars(size_result.ptr + 1, numbers + sizeof(numbers), last_modified);
+
+    std::string key;
+    key.reserve(client_name.size() + 1 + (date_result.ptr - numbers));
+    key.append(client_name).append(1, '\n').append(numbers, date_result.ptr);
+    return key;
+}
+
+/**
+ * @brief Returns the path of a saved file as kept in the index : its name for a file of the directory, else its full path.
+ *
+ * The path is compared as a string with the directory, like the write engines build it, so no path object is made for each file.
+ */
+std::string_view SavedFileIndex::get_indexed_path(const std::string& full_path) const
+{
+    std::string_view name(full_path);
+    if (name.size() <= m_directory.size() || name.compare(0, m_directory.size(), m_directory) != 0)
+    {
+        return full_path;
+    }
+
+    name.remove_prefix(m_directory.size());
+    if (!m_directory.empty() && !FileNameIndex::is_separator(m_directory.back()))
+    {
+        if (!FileNameIndex::is_separator(name.front()))
+        {
+            return full_path; // other directory whose name starts with the name of the directory
+        }
+        name.remove_prefix(1);
+    }
+    if (name.empty() || std::any_of(name.begin(), name.end(), FileNameIndex::is_separator))
+    {
+        return full_path;
+    }
+    return name;
+}
+
+/**
+ * @brief Writes the journal line of a file received.
+ *
+ * The line is `<hash in hexadecimal> <size> <write time> <last modified date> <saved file name>\t<client file name>`.
+ */
+void SavedFileIndex::write_line(std::ostream& stream, const std::string& file_name, const Entry& entry, double last_modified, const std::string& client_name)
+{
+    char hash[16];
+    const std::to_chars_result hash_result = std::to_chars(hash, hash + sizeof(hash), entry.hash, 16);
+    char date[32];
+    const std::to_chars_result date_result = std::to_chars(date, date + sizeof(date), last_modified);
+
+    stream.write(hash, hash_result.ptr - hash);
+    stream << ' ' << entry.size << ' ' << entry.write_time << ' ';
+    stream.write(date, date_result.ptr - date);
+    stream << ' ' << file_name << '\t' << client_name << '\n';
+}
+
+/**
+ * @brief Reads the journal, a later line of a saved file name replaces the previous ones.
+ *
+ * Unreadable lines are skipped. The journal is rewritten when it holds more lines than client files, so it doesn't
+ * grow when the same names are saved again.
+ */
+void SavedFileIndex::load()
+{
+    std::ifstream journal(m_journal_path, std::ios::binary);
+    if (!journal)
+    {
+        return; // no file saved with the index yet
+    }
+
+    std::unordered_map<std::string, double> last_modified_dates; // by client key, for rewriting the journal
+    std::size_t line_count = 0;
+    std::string line;
+    while (std::getline(journal, line))
+    {
+        line_count++;
+
+        Entry entry;
+        double last_modified = 0.0;
+        const char* position = line.data();
+        const char* end = line.data() + line.size();
+
+        auto read_value = [&position, end](auto& value, auto... format) {
+            const std::from_chars_result result = std::from_chars(position, end, value, format...);
+            if (result.ec != std::errc() || result.ptr == end || *result.ptr != ' ')
+            {
+                return false;
+            }
+            position = result.ptr + 1;
+            return true;
+            };
+
+        if (!read_value(entry.hash, 16) || !read_value(entry.size, 10) || !read_value(entry.write_time, 10) || !read_value(last_modified))
+        {
+            continue;
+        }
+
+        const char* separator = std::find(position, end, '\t');
+        if (separator == position || separator == end)
+        {
+            continue;
+        }
+
+        const std::string file_name(position, separator);
+        const std::string client_key = make_client_key(std::string(separator + 1, end), entry.size, last_modified);
+        insert(file_name, entry);
+        m_client_files[client_key] = { file_name, entry.write_time };
+        last_modified_dates[client_key] = last_modified;
+    }
+    journal.close();
+
+    if (line_count > m_client_files.size())
+    {
+        const std::string temporary_path = m_journal_path + ".tmp";
+        {
+            std::ofstream compacted(temporary_path, std::ios::binary | std::ios::trunc);
+            for (const auto& [client_key, client_file] : m_client_files)
+            {
+                const auto entry = m_entries.find(client_file.file_name);
+                if (entry != m_entries.end() && entry->second.write_time == client_file.write_time)
+                {
+                    write_line(compacted, client_file.file_name, entry->second, last_modified_dates[client_key], client_key.substr(0, client_key.find('\n')));
+                }
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, m_journal_path, error);
+    }
+}
+
+/**
+ * @brief Adds or replaces the entry of a file name, must be called with the mutex locked.
+ */
+void SavedFileIndex::insert(const std::string& file_name, const Entry& entry)
+{
+    remove(file_name);
+    m_entries[file_name] = entry;
+    m_names_by_hash.emplace(entry.hash, file_name);
+}
+
+/**
+ * @brief Removes the entry of a file name, must be called with the mutex locked.
+ *
+ * The client files of this name are left, they are removed once found outdated.
+ */
+void SavedFileIndex::remove(const std::string& file_name)
+{
+    const auto entry = m_entries.find(file_name);
+    if (entry == m_entries.end())
+    {
+        return;
+    }
+
+    auto [name, names_end] = m_names_by_hash.equal_range(entry->second.hash);
+    for (; name != names_end; ++name)
+    {
+        if (name->second == file_name)
+        {
+            m_names_by_hash.erase(name);
+            break;
+        }
+    }
+    m_entries.erase(entry);
+}
+
+/**
+ * @brief Checks that a saved file still has the size and last write time of its entry.
+ */
+bool SavedFileIndex::is_on_disk(const std::string& file_name, const Entry& entry) const
+{
+    uint64_t file_size = 0;
+    int64_t write_time = 0;
+    return read_file((std::filesystem::path(m_directory) / file_name).string(), file_size, write_time)
+        && file_size == entry.size && write_time == entry.write_time;
+}
+
+/**
+ * @brief Removes the entry of a file found changed on disk, unless the file was saved again since it was read.
+ */
+void SavedFileIndex::remove_outdated(const std::string& file_name, const Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto current_entry = m_entries.find(file_name);
+    if (current_entry != m_entries.end() && current_entry->second.write_time == entry.write_time && current_entry->second.size == entry.size)
+    {
+        remove(file_name);
+    }
+}
+
+/**
+ * @brief Finds a saved file that may have the same content.
+ *
+ * The files with the same hash and size are checked on disk, the first one that still matches its entry is given.
+ * The hash can match an other content : the caller compares the file with the content before using it.
+ *
+ * @param hash The XXH64 hash of the content.
+ * @param size The size of the content.
+ *
+ * @return The path of the file with the same hash and size, empty if there is none.
+ */
+std::string SavedFileIndex::find_duplicate(uint64_t hash, uint64_t size)
+{
+    std::vector<std::pair<std::string, Entry>> candidates;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto [name, names_end] = m_names_by_hash.equal_range(hash);
+        for (; name != names_end; ++name)
+        {
+            const Entry& entry = m_entries.at(name->second);
+            if (entry.size == size)
+            {
+                candidates.emplace_back(name->second, entry);
+            }
+        }
+    }
+
+    for (const auto& [file_name, entry] : candidates)
+    {
+        if (is_on_disk(file_name, entry))
+        {
+            return (std::filesystem::path(m_directory) / file_name).string();
+        }
+        remove_outdated(file_name, entry); // removed or changed since it was saved
+    }
+
+    return std::string();
+}
+
+/**
+ * @brief Compares a saved file with a content in memory, the file is read by blocks. Blocking call.
+ *
+ * @return false if the content differs, or if the file can't be read.
+ */
+bool SavedFileIndex::has_content(const std::string& full_path, const uint8_t* data, uint64_t size)
+{
+    std::ifstream file(full_path, std::ios::binary);
+    std::vector<char> buffer(static_cast<std::size_t>(std::min<uint64_t>(size, COMPARE_BLOCK_SIZE)));
+    for (uint64_t offset = 0; offset < size;)
+    {
+        const std::size_t read_size = static_cast<std::size_t>(std::min<uint64_t>(size - offset, buffer.size()));
+        if (!file.read(buffer.data(), static_cast<std::streamsize>(read_size)) || std::memcmp(buffer.data(), data + offset, read_size) != 0)
+        {
+            return false;
+        }
+        offset += read_size;
+    }
+    return file && file.peek() == std::ifstream::traits_type::eof();
+}
+
+/**
+ * @brief Compares two saved files, both are read by blocks. Blocking call.
+ *
+ * @param size The size of the content of `other_path`.
+ *
+ * @return false if the contents differ, or if a file can't be read.
+ */
+bool SavedFileIndex::has_same_content(const std::string& full_path, const std::string& other_path, uint64_t size)
+{
+    std::ifstream file(full_path, std::ios::binary);
+    std::ifstream other_file(other_path, std::ios::binary);
+    std::vector<char> buffer(static_cast<std::size_t>(std::min<uint64_t>(size, COMPARE_BLOCK_SIZE)));
+    std::vector<char> other_buffer(buffer.size());
+    for (uint64_t offset = 0; offset < size;)
+    {
+        const std::size_t read_size = static_cast<std::size_t>(std::min<uint64_t>(size - offset, buffer.size()));
+        if (!file.read(buffer.data(), static_cast<std::streamsize>(read_size)) || !other_file.read(other_buffer.data(), static_cast<std::streamsize>(read_size))
+            || std::memcmp(buffer.data(), other_buffer.data(), read_size) != 0)
+        {
+            return false;
+        }
+        offset += read_size;
+    }
+    return file && file.peek() == std::ifstream::traits_type::eof();
+}
+
+/**
+ * @brief Checks if a file sent by a client is already saved, and still unchanged, in the directory.
+ *
+ * @param client_name The name of the file on the client.
+ * @param size The size of the file.
+ * @param last_modified The last modified date sent by the client.
+ */
+bool SavedFileIndex::contains(const std::string& client_name, uint64_t size, double last_modified)
+{
+    const std::string client_key = make_client_key(client_name, size, last_modified);
+    std::string file_name;
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const auto client_file = m_client_files.find(client_key);
+        if (client_file == m_client_files.end())
+        {
+            return false;
+        }
+
+        const auto saved_entry = m_entries.find(client_file->second.file_name);
+        if (saved_entry == m_entries.end() || saved_entry->second.write_time != client_file->second.write_time)
+        {
+            m_client_files.erase(client_file); // its saved file was removed, or replaced by another file with the same name
+            return false;
+        }
+        file_name = saved_entry->first;
+        entry = saved_entry->second;
+    }
+
+    if (is_on_disk(file_name, entry))
+    {
+        return true;
+    }
+
+    remove_outdated(file_name, entry);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto client_file = m_client_files.find(client_key);
+    if (client_file != m_client_files.end() && client_file->second.file_name == file_name && client_file->second.write_time == entry.write_time)
+    {
+        m_client_files.erase(client_file);
+    }
+    return false;
+}
+
+/**
+ * @brief Adds a file received from a client to the index, and to the journal.
+ *
+ * Called once the file is saved and closed, or once it is found as the duplicate of a saved file.
+ *
+ * @param client_name The name of the file on the client.
+ * @param last_modified The last modified date sent by the client.
+ * @param hash The XXH64 hash of the content.
+ * @param size The size of the content.
+ * @param full_path The path of the saved file holding the content, in the save directory or in an other storage root.
+ */
+void SavedFileIndex::add(const std::string& client_name, double last_modified, uint64_t hash, uint64_t size, const std::string& full_path)
+{
+    // Path appended to the directory : the name for a file of the directory, the full path for an other root
+    const std::string file_name(get_indexed_path(full_path));
+    if (file_name.find_first_of("\t\r\n") != std::string::npos || client_name.find_first_of("\r\n") != std::string::npos)
+    {
+        return; // can't be written on a journal line
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    uint64_t file_size = 0;
+    if (!read_file(full_path, file_size, entry.write_time) || file_size != size)
+    {
+        return;
+    }
+    entry.size = size;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insert(file_name, entry);
+    m_client_files[make_client_key(client_name, size, last_modified)] = { file_name, entry.write_time };
+
+    write_line(m_journal, file_name, entry, last_modified, client_name);
+    m_journal.flush();
+}
+
+/**
+ * @brief Returns the number of saved files indexed.
+ */
+std::size_t SavedFileIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
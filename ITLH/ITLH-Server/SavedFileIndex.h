@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class SavedFileIndex
+{
+public:
+	explicit SavedFileIndex(const std::string& directory);
+
+	std::string find_duplicate(uint64_t hash, uint64_t size);
+	static bool has_content(const std::string& full_path, const uint8_t* data, uint64_t size);
+	static bool has_same_content(const std::string& full_path, const std::string& other_path, uint64_t size);
+	bool contains(const std::string& client_name, uint64_t size, double last_modified);
+	void add(const std::string& client_name, double last_modified, uint64_t hash, uint64_t size, const std::string& full_path);
+
+	std::size_t size() const;
+
+private:
+	struct Entry
+	{
+		uint64_t hash = 0;
+		uint64_t size = 0;
+		int64_t write_time = 0; // last write time of the file when it was indexed
+	};
+
+	struct ClientFile
+	{
+		std::string file_name; // name of the saved file in the directory
+		int64_t write_time = 0; // last write time of the saved file when the client file was added
+	};
+
+	static bool read_file(const std::string& full_path, uint64_t& size, int64_t& write_time);
+	static std::string make_client_key(const std::string& client_name, uint64_t size, double last_modified);
+	std::string_view get_indexed_path(const std::string& full_path) const;
+	static void write_line(std::ostream& stream, const std::string& file_name, const Entry& entry, double last_modified, const std::string& client_name);
+	void load();
+	void insert(const std::string& file_name, const Entry& entry);
+	void remove(const std::string& file_name);
+	bool is_on_disk(const std::string& file_name, const Entry& entry) const;
+	void remove_outdated(const std::string& file_name, const Entry& entry);
+
+	const std::string m_directory;
+	const std::string m_journal_path;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::string, Entry> m_entries; // key : file name in the directory
+	std::unordered_multimap<uint64_t, std::string> m_names_by_hash;
+	std::unordered_map<std::string, ClientFile> m_client_files; // key : name, size and last modified date sent by the client
+	std::ofstream m_journal;
+};
@@ -0,0 +1,107 @@
+#include "ServerMetrics.h"
+
+/**
+ * @class LatencyHistogram
+ * @brief Counts durations in fixed buckets, like a Prometheus histogram.
+ *
+ * `observe()` only increments atomic counters, it can be called from many threads on the hot path.
+ */
+
+// Upper bounds of the buckets, in seconds, the last bucket has no bound
+static constexpr std::array<double, LatencyHistogram::BUCKET_COUNT - 1> BUCKET_BOUNDS = {
+    0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0, 10.0
+};
+
+/**
+ * @brief Adds a duration to the histogram.
+ */
+void LatencyHistogram::observe(std::chrono::steady_clock::duration duration)
+{
+    const double seconds = std::chrono::duration<double>(duration).count();
+
+    std::size_t bucket = 0;
+    while (bucket < BUCKET_BOUNDS.size() && seconds > BUCKET_BOUNDS[bucket])
+    {
+        bucket++;
+    }
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Appends the histogram in the Prometheus text format, with cumulative buckets.
+ *
+ * @param text The text to append to.
+ * @param name The metric name.
+ * @param help The description of the metric.
+ */
+void LatencyHistogram::render(std::string& text, const char* name, const char* help) const
+{
+    text += std::string("# HELP ") + name + " " + help + "\n";
+    text += std::string("# TYPE ") + name + " histogram\n";
+
+    uint64_t cumulative_count = 0;
+    for (std::size_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+    {
+        cumulative_count += m_buckets[bucket].load(std::memory_order_relaxed);
+        const std::string bound = bucket < BUCKET_BOUNDS.size() ? std::to_string(BUCKET_BOUNDS[bucket]) : "+Inf";
+        text += std::string(name) + "_bucket{le=\"" + bound + "\"} " + std::to_string(cumulative_count) + "\n";
+    }
+
+    text += std::string(name) + "_sum " + std::to_string(m_sum_ns.load(std::memory_order_relaxed) / 1e9) + "\n";
+    text += std::string(name) + "_count " + std::to_string(m_count.load(std::memory_order_relaxed)) + "\n";
+}
+
+/**
+ * @class ServerMetrics
+ * @brief Live counters and latency histograms of the server, read by the metrics endpoint.
+ *
+ * Counters and gauges are atomic values updated by the sessions, the histograms measure the steps of
+ * a received file : receive (first to last byte of its message), name resolution (unique name in the
+ * save directory), each disk write, metadata stamping (date and close), ACK (close to ACK written, with the wait for
+ * the group commit) and the whole file (first byte to ACK). The compressed connections count the bytes of their
+ * messages, the bytes read from the network for them and the time spent to decode them.
+ */
+
+/**
+ * @brief Returns all the metrics in the Prometheus text format.
+ */
+std::string ServerMetrics::render() const
+{
+    std::string text;
+
+    auto render_value = [&text](const char* name, const char* type, const char* help, const auto& value) {
+        text += std::string("# HELP ") + name + " " + help + "\n";
+        text += std::string("# TYPE ") + name + " " + type + "\n";
+        text += std::string(name) + " " + std::to_string(value.load(std::memory_order_relaxed)) + "\n";
+    };
+
+    render_value("itlh_active_sessions", "gauge", "Clients connected.", active_sessions);
+    render_value("itlh_sessions_rejected_total", "counter", "Connections closed because the client broke the protocol.", sessions_rejected);
+    render_value("itlh_bytes_buffered", "gauge", "Bytes received and not yet written on disk.", bytes_buffered);
+    render_value("itlh_bytes_received_total", "counter", "File bytes received.", bytes_received);
+    render_value("itlh_files_saved_total", "counter", "Files saved and acknowledged.", files_saved);
+    render_value("itlh_files_warning_total", "counter", "Files saved with corrupt data, acknowledged with a warning.", files_warning);
+    render_value("itlh_files_discarded_total", "counter", "Files removed because the client left before their end.", files_discarded);
+    render_value("itlh_files_duplicate_total", "counter", "Files not kept because a file with the same content is already saved.", files_duplicate);
+    render_value("itlh_files_checksum_failed_total", "counter", "Files rejected because their data don't match the checksum sent by the client.", files_checksum_failed);
+    render_value("itlh_group_commits_total", "counter", "Groups of files flushed on disk together before their ACK.", group_commits);
+    render_value("itlh_deflate_message_bytes_total", "counter", "Message bytes read by the compressed connections, once inflated.", deflate_message_bytes);
+    render_value("itlh_deflate_network_bytes_total", "counter", "Bytes read from the network by the compressed connections.", deflate_network_bytes);
+
+    text += "# HELP itlh_deflate_decode_seconds_total Time spent to decode the messages of the compressed connections, inflate included.\n";
+    text += "# TYPE itlh_deflate_decode_seconds_total counter\n";
+    text += "itlh_deflate_decode_seconds_total " + std::to_string(deflate_decode_ns.load(std::memory_order_relaxed) / 1e9) + "\n";
+
+    receive_time.render(text, "itlh_receive_seconds", "Time from the first to the last byte of a file message.");
+    name_resolution_time.render(text, "itlh_name_resolution_seconds", "Time to choose a unique name in the save directory.");
+    disk_write_time.render(text, "itlh_disk_write_seconds", "Time of a disk write, from its request to its end.");
+    metadata_stamping_time.render(text, "itlh_metadata_stamping_seconds", "Time to apply the date of a file and close it.");
+    ack_time.render(text, "itlh_ack_seconds", "Time from the close of a file to its ACK written on the socket.");
+    file_time.render(text, "itlh_file_seconds", "Time from the first byte of a file to its ACK.");
+    group_commit_time.render(text, "itlh_group_commit_seconds", "Time to flush a group of files and their directories on disk.");
+
+    return text;
+}
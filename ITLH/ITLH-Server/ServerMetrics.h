@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class LatencyHistogram
+{
+public:
+	static constexpr std::size_t BUCKET_COUNT = 12;
+
+	void observe(std::chrono::steady_clock::duration duration);
+	void render(std::string& text, const char* name, const char* help) const;
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets = {}; // last bucket : above the last bound
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<uint64_t> m_sum_ns = 0;
+};
+
+struct FileTimings
+{
+	using time_point = std::chrono::steady_clock::time_point;
+
+	time_point receive_start; // first byte of the message
+	time_point receive_end; // last byte of the message
+	time_point write_start; // first write asked
+	time_point write_end; // last write done
+	time_point stamping_start; // date and close asked
+	time_point stamping_end; // file closed
+	time_point ack_end; // ACK written on the socket
+};
+
+class ServerMetrics
+{
+public:
+	static void add(std::atomic<uint64_t>& counter, uint64_t value) { counter.fetch_add(value, std::memory_order_relaxed); }
+	static void add(std::atomic<int64_t>& gauge, int64_t value) { gauge.fetch_add(value, std::memory_order_relaxed); }
+
+	std::string render() const;
+
+	std::atomic<int64_t> active_sessions = 0;
+	std::atomic<uint64_t> sessions_rejected = 0; // closed after an error of the client
+	std::atomic<int64_t> bytes_buffered = 0; // received, not yet written on disk
+	std::atomic<uint64_t> bytes_received = 0;
+	std::atomic<uint64_t> files_saved = 0;
+	std::atomic<uint64_t> files_warning = 0;
+	std::atomic<uint64_t> files_discarded = 0;
+	std::atomic<uint64_t> files_duplicate = 0;
+	std::atomic<uint64_t> files_checksum_failed = 0;
+	std::atomic<uint64_t> group_commits = 0;
+	std::atomic<uint64_t> deflate_message_bytes = 0; // read by the compressed sessions, once inflated
+	std::atomic<uint64_t> deflate_network_bytes = 0; // read from the network by the compressed sessions
+	std::atomic<uint64_t> deflate_decode_ns = 0;
+
+	LatencyHistogram receive_time;
+	LatencyHistogram name_resolution_time;
+	LatencyHistogram disk_write_time;
+	LatencyHistogram metadata_stamping_time;
+	LatencyHistogram ack_time;
+	LatencyHistogram file_time;
+	LatencyHistogram group_commit_time;
+};
@@ -0,0 +1,372 @@
+#include "ShardedWriteEngine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+/**
+ * @class ShardedWriteEngine
+ * @brief File write engine spreading the received files over several save directories, the storage roots.
+ *
+ * Each root has its own write engine, with its own queue and its own index of file names, so a root on a slow disk
+ * only slows down the files written in it : a session checks the queue of the root of its current file before
+ * reading more data. The root of a file is chosen when it's opened or saved, by the placement policy :
+ * - `Placement::round_robin` : the roots one after the other.
+ * - `Placement::least_queued` : the root with the fewest bytes given to write and not written yet.
+ * - `Placement::extension` : the root whose extensions hold the extension of the file name, the roots without
+ *   extensions take the other files, with the fewest bytes queued.
+ *
+ * The part files of resumable uploads are always opened in the first root, the save directory of the part journal,
+ * and stay there once renamed. The bytes written and the files saved of each root are counted for the metrics.
+ */
+
+/**
+ * @param placement The policy choosing the root of each new file.
+ */
+ShardedWriteEngine::ShardedWriteEngine(Placement placement)
+    : FileWriteEngine(0, false)
+    , m_placement(placement)
+{
+}
+
+/**
+ * @brief Adds a storage root, must be called before the first file.
+ *
+ * @param directory The save directory of the root, shown in the metrics.
+ * @param engine The write engine of the root, writing in this directory with its own file name index.
+ * @param extensions The file extensions of the root with `Placement::extension`, without the dot, empty for any file.
+ */
+void ShardedWriteEngine::add_root(const std::string& directory, std::unique_ptr<FileWriteEngine> engine, const std::vector<std::string>& extensions)
+{
+    std::unique_ptr<Root> root = std::make_unique<Root>();
+    root->directory = directory;
+    for (const std::string& extension : extensions)
+    {
+        root->extensions.push_back(get_extension("." + extension));
+    }
+    root->engine = std::move(engine);
+    m_roots.push_back(std::move(root));
+}
+
+/**
+ * @brief Returns the name of the engine of the roots, all the roots use the same engine.
+ */
+const char* ShardedWriteEngine::name() const
+{
+    return m_roots.front()->engine->name();
+}
+
+/**
+ * @brief Returns the extension of a file name in lower case, without the dot, empty if it has none.
+ */
+std::string ShardedWriteEngine::get_extension(const std::string& file_name)
+{
+    const std::size_t dot = file_name.rfind('.');
+    if (dot == std::string::npos)
+    {
+        return std::string();
+    }
+
+    std::string extension = file_name.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+/**
+ * @brief Chooses the root of a new file with the placement policy.
+ *
+ * @param file_name The file name sent by the client.
+ *
+ * @return The index of the root.
+ */
+std::size_t ShardedWriteEngine::choose_root(const std::string& file_name)
+{
+    const std::size_t start = m_next_root.fetch_add(1, std::memory_order_relaxed) % m_roots.size();
+
+    switch (m_placement)
+    {
+    case Placement::round_robin:
+        return start;
+
+    case Placement::least_queued:
+        return find_least_queued(start, true);
+
+    case Placement::extension:
+    {
+        const std::string extension = get_extension(file_name);
+        if (!extension.empty())
+        {
+            for (std::size_t i = 0; i < m_roots.size(); i++)
+            {
+                const std::vector<std::string>& extensions = m_roots[i]->extensions;
+                if (std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+                {
+                    return i;
+                }
+            }
+        }
+        return find_least_queued(start, false);
+    }
+    }
+
+    return start;
+}
+
+/**
+ * @brief Finds the root with the fewest bytes queued, the roots are checked from `start` so equal roots take turns.
+ *
+ * @param start The first root checked.
+ * @param any_root false to only check the roots without extensions, all the roots are checked if they all have some.
+ */
+std::size_t ShardedWriteEngine::find_least_queued(std::size_t start, bool any_root) const
+{
+    if (!any_root && std::all_of(m_roots.begin(), m_roots.end(), [](const std::unique_ptr<Root>& root) { return !root->extensions.empty(); }))
+    {
+        any_root = true;
+    }
+
+    std::size_t least_queued_root = start;
+    uint64_t least_queued_bytes = std::numeric_limits<uint64_t>::max();
+    for (std::size_t i = 0; i < m_roots.size(); i++)
+    {
+        const std::size_t index = (start + i) % m_roots.size();
+        const Root& root = *m_roots[index];
+        if (!any_root && !root.extensions.empty())
+        {
+            continue;
+        }
+
+        const uint64_t queued_bytes = root.queued_bytes.load(std::memory_order_relaxed);
+        if (queued_bytes < least_queued_bytes)
+        {
+            least_queued_root = index;
+            least_queued_bytes = queued_bytes;
+        }
+    }
+
+    return least_queued_root;
+}
+
+/**
+ * @brief Wraps the handler of a write or a save, to count its bytes in its root once they are written.
+ *
+ * @param root The root of the file.
+ * @param size The bytes given to write, counted as queued by the caller.
+ * @param is_file_saved true if the operation ends the file, counted as saved without error.
+ * @param handler The handler of the caller, can be empty.
+ */
+FileWriteEngine::Handler ShardedWriteEngine::count_done(Root& root, uint64_t size, bool is_file_saved, Handler handler)
+{
+    return [&root, size, is_file_saved, handler = std::move(handler)](std::exception_ptr error) {
+        root.queued_bytes.fetch_sub(size, std::memory_order_relaxed);
+        if (!error)
+        {
+            root.written_bytes.fetch_add(size, std::memory_order_relaxed);
+            if (is_file_saved)
+            {
+                root.saved_files.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (handler)
+        {
+            handler(error);
+        }
+        };
+}
+
+/**
+ * @brief Opens a received file in the root chosen for it.
+ */
+std::shared_ptr<FileWriteEngine::File> ShardedWriteEngine::open(const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    const std::size_t root = choose_root(file_name);
+    std::shared_ptr<File> file = m_roots[root]->engine->open(file_name, file_size, std::move(handler));
+    file->root = root;
+    return file;
+}
+
+/**
+ * @brief Writes data of a file in its root, counted as queued in the root until they are written.
+ */
+void ShardedWriteEngine::write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler)
+{
+    Root& root = *m_roots[file->root];
+    root.queued_bytes.fetch_add(size, std::memory_order_relaxed);
+    root.engine->write(file, offset, data, size, count_done(root, size, false, std::move(handler)));
+}
+
+/**
+ * @brief Dates and closes a file in its root, counted as saved in the root once closed.
+ */
+void ShardedWriteEngine::close(const std::shared_ptr<File>& file, double date, Handler handler)
+{
+    Root& root = *m_roots[file->root];
+    root.engine->close(file, date, count_done(root, 0, true, std::move(handler)));
+}
+
+/**
+ * @brief Closes and removes a file in its root.
+ */
+void ShardedWriteEngine::discard(const std::shared_ptr<File>& file)
+{
+    m_roots[file->root]->engine->discard(file);
+}
+
+/**
+ * @brief Saves a file received at once in the root chosen for it, with the single operation of its engine.
+ */
+std::shared_ptr<FileWriteEngine::File> ShardedWriteEngine::save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler)
+{
+    const std::size_t root_index = choose_root(file_name);
+    Root& root = *m_roots[root_index];
+    root.queued_bytes.fetch_add(size, std::memory_order_relaxed);
+    std::shared_ptr<File> file = root.engine->save(file_name, data, size, date, count_done(root, size, true, std::move(handler)));
+    file->root = root_index;
+    return file;
+}
+
+/**
+ * @brief Opens a part file in the first root, where the part journal keeps its part files.
+ */
+std::shared_ptr<FileWriteEngine::File> ShardedWriteEngine::open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler)
+{
+    return m_roots.front()->engine->open_part(part_path, file_name, file_size, std::move(handler));
+}
+
+/**
+ * @brief Closes a part file in its root, kept to resume the upload later.
+ */
+void ShardedWriteEngine::detach(const std::shared_ptr<File>& file, Handler handler)
+{
+    m_roots[file->root]->engine->detach(file, std::move(handler));
+}
+
+/**
+ * @brief Runs a job reading saved files with the engine of the root of a file, or of the first root.
+ */
+void ShardedWriteEngine::run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler)
+{
+    m_roots[file ? file->root : 0]->engine->run_read_job(file, std::move(job), std::move(handler));
+}
+
+/**
+ * @brief Checks the queue of the root of a file, or all the queues for the next file opened.
+ *
+ * @param file The file the next data are for, null for the next file opened : it's full only if all the roots are,
+ * its root isn't chosen yet.
+ */
+bool ShardedWriteEngine::is_full(const std::shared_ptr<File>& file) const
+{
+    if (file)
+    {
+        return m_roots[file->root]->engine->is_full(file);
+    }
+
+    return std::all_of(m_roots.begin(), m_roots.end(), [](const std::unique_ptr<Root>& root) { return root->engine->is_full(nullptr); });
+}
+
+/**
+ * @brief Registers a callback to call once the queue of the root of a file is no longer full.
+ *
+ * For the next file opened, the callback is registered in all the roots and called once, by the first root with room.
+ *
+ * @param file The file given to `is_full()`.
+ * @param callback The function to call once there is room.
+ */
+void ShardedWriteEngine::notify_when_not_full(const std::shared_ptr<File>& file, std::function<void()> callback)
+{
+    if (file)
+    {
+        m_roots[file->root]->engine->notify_when_not_full(file, std::move(callback));
+        return;
+    }
+
+    std::shared_ptr<std::function<void()>> waiter = std::make_shared<std::function<void()>>(std::move(callback));
+    std::shared_ptr<std::atomic<bool>> is_called = std::make_shared<std::atomic<bool>>(false);
+    for (const std::unique_ptr<Root>& root : m_roots)
+    {
+        root->engine->notify_when_not_full(nullptr, [waiter, is_called]() {
+            if (!is_called->exchange(true))
+            {
+                (*waiter)();
+            }
+            });
+    }
+}
+
+/**
+ * @brief Returns the operations queued in all the roots.
+ */
+std::size_t ShardedWriteEngine::queue_depth() const
+{
+    std::size_t queue_depth = 0;
+    for (const std::unique_ptr<Root>& root : m_roots)
+    {
+        queue_depth += root->engine->queue_depth();
+    }
+    return queue_depth;
+}
+
+/**
+ * @brief Returns the sum of the peak queue depths of the roots, reached at different times.
+ */
+std::size_t ShardedWriteEngine::peak_queue_depth() const
+{
+    std::size_t peak_queue_depth = 0;
+    for (const std::unique_ptr<Root>& root : m_roots)
+    {
+        peak_queue_depth += root->engine->peak_queue_depth();
+    }
+    return peak_queue_depth;
+}
+
+/**
+ * @brief Returns the sum of the maximum queue depths of the roots.
+ */
+std::size_t ShardedWriteEngine::max_queue_depth() const
+{
+    std::size_t max_queue_depth = 0;
+    for (const std::unique_ptr<Root>& root : m_roots)
+    {
+        max_queue_depth += root->engine->max_queue_depth();
+    }
+    return max_queue_depth;
+}
+
+/**
+ * @brief Appends the metrics of each root in the Prometheus text format, labelled with the directory of the root.
+ *
+ * @param text The text to append to.
+ */
+void ShardedWriteEngine::render_metrics(std::string& text) const
+{
+    std::vector<std::string> labels;
+    for (const std::unique_ptr<Root>& root : m_roots)
+    {
+        std::string label = "{root=\"";
+        for (const char c : root->directory)
+        {
+            if (c == '\\' || c == '"')
+            {
+                label += '\\';
+            }
+            label += c;
+        }
+        labels.push_back(label + "\"}");
+    }
+
+    auto render_roots = [&](const char* name, const char* type, const char* help, auto get_value) {
+        text += std::string("# HELP ") + name + " " + help + "\n";
+        text += std::string("# TYPE ") + name + " " + type + "\n";
+        for (std::size_t i = 0; i < m_roots.size(); i++)
+        {
+            text += std::string(name) + labels[i] + " " + std::to_string(get_value(*m_roots[i])) + "\n";
+        }
+    };
+
+    render_roots("itlh_root_written_bytes_total", "counter", "File bytes written in the storage root.", [](const Root& root) { return root.written_bytes.load(std::memory_order_relaxed); });
+    render_roots("itlh_root_files_saved_total", "counter", "Files saved in the storage root.", [](const Root& root) { return root.saved_files.load(std::memory_order_relaxed); });
+    render_roots("itlh_root_queued_bytes", "gauge", "File bytes given to the storage root and not written yet.", [](const Root& root) { return root.queued_bytes.load(std::memory_order_relaxed); });
+    render_roots("itlh_root_save_queue_depth", "gauge", "Disk operations queued in the write engine of the storage root.", [](const Root& root) { return root.engine->queue_depth(); });
+}
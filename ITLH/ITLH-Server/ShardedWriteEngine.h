@@ -0,0 +1,63 @@
+#pragma once
+#include "FileWriteEngine.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class Placement
+{
+	round_robin, // each new file in the next root
+	least_queued, // each new file in the root with the fewest bytes waiting to be written
+	extension, // each new file in the root given for its extension, the roots without extensions take the others
+};
+
+class ShardedWriteEngine : public FileWriteEngine
+{
+public:
+	explicit ShardedWriteEngine(Placement placement);
+
+	void add_root(const std::string& directory, std::unique_ptr<FileWriteEngine> engine, const std::vector<std::string>& extensions);
+
+	const char* name() const override;
+
+	std::shared_ptr<File> open(const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void write(const std::shared_ptr<File>& file, uint64_t offset, const uint8_t* data, size_t size, Handler handler) override;
+	void close(const std::shared_ptr<File>& file, double date, Handler handler) override;
+	void discard(const std::shared_ptr<File>& file) override;
+	std::shared_ptr<File> save(const std::string& file_name, const uint8_t* data, size_t size, double date, Handler handler) override;
+	std::shared_ptr<File> open_part(const std::string& part_path, const std::string& file_name, uint64_t file_size, Handler handler) override;
+	void detach(const std::shared_ptr<File>& file, Handler handler) override;
+	void run_read_job(const std::shared_ptr<File>& file, std::function<void()> job, Handler handler) override;
+
+	bool is_full(const std::shared_ptr<File>& file) const override;
+	void notify_when_not_full(const std::shared_ptr<File>& file, std::function<void()> callback) override;
+
+	std::size_t queue_depth() const override;
+	std::size_t peak_queue_depth() const override;
+	std::size_t max_queue_depth() const override;
+
+	void render_metrics(std::string& text) const override;
+
+private:
+	struct Root
+	{
+		std::string directory;
+		std::vector<std::string> extensions; // lower case, without the dot, empty : any file
+		std::atomic<uint64_t> queued_bytes = 0; // given to write() or save() and not written yet
+		std::atomic<uint64_t> written_bytes = 0;
+		std::atomic<uint64_t> saved_files = 0;
+		std::unique_ptr<FileWriteEngine> engine; // destroyed first, its last handlers still count in the root
+	};
+
+	static std::string get_extension(const std::string& file_name);
+	std::size_t choose_root(const std::string& file_name);
+	std::size_t find_least_queued(std::size_t start, bool any_root) const;
+	static Handler count_done(Root& root, uint64_t size, bool is_file_saved, Handler handler);
+
+	const Placement m_placement;
+	std::vector<std::unique_ptr<Root>> m_roots;
+	std::atomic<std::size_t> m_next_root = 0;
+};
@@ -0,0 +1,234 @@
+#include "StripedFileTable.h"
+
+#include "ProtocolError.h"
+
+#include <algorithm>
+#include <charconv>
+
+/**
+ * @class StripedFile
+ * @brief State of a file sent in ranges over many connections, shared by the sessions receiving its ranges.
+ *
+ * The file is opened once, with its whole size, by the session of the first range, then each session writes its
+ * range at its offset. The file counts the ranges being received, the ranges ended and the bytes written : once every
+ * range is received and written, the session that ends the last range or writes the last bytes is told to finalize
+ * the file. When a session leaves before the end of its range, or a range doesn't match its checksum, the file fails :
+ * its ranges are given back to be acknowledged as rejected, the ranges ended at once and the next ones when they end,
+ * and the session that sees no range of it being received anymore is told to remove it.
+ *
+ * All the functions can be called from many threads at the same time.
+ */
+
+/**
+ * @param key The key of the file in the striped file table.
+ * @param file_name The name of the file sent by the client.
+ * @param size The size of the whole file.
+ * @param output The file opened on disk with its whole size.
+ */
+StripedFile::StripedFile(std::string key, std::string file_name, uint64_t size, std::shared_ptr<FileWriteEngine::File> output)
+    : m_key(std::move(key))
+    , m_file_name(std::move(file_name))
+    , m_size(size)
+    , m_output(std::move(output))
+{
+}
+
+/**
+ * @brief Counts a range being received.
+ */
+void StripedFile::start_range()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active_range_count++;
+}
+
+/**
+ * @brief Records a range fully received, its writes can still be in progress.
+ *
+ * When the data of a range don't match their checksum, or the file failed before, the ranges ended are given back to
+ * be acknowledged as rejected, at once, and the next ones when they end, so the client sends the file again.
+ *
+ * @param start The offset of the first byte of the range.
+ * @param end The offset after the last byte received.
+ * @param is_valid false if the data of the range don't match their checksum.
+ * @param range The session of the range and its file, acknowledged once the file is finalized.
+ *
+ * @throws ProtocolError If the range overlaps another range or goes after the end of the file.
+ */
+StripedFile::RangeEnd StripedFile::end_range(uint64_t start, uint64_t end, bool is_valid, EndedRange range)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The ranges of a failed file are only rejected, those sent again by the client can overlap the ranges received before
+    if (!m_is_failed)
+    {
+        const bool is_overlapping = std::any_of(m_ranges.begin(), m_ranges.end(), [start, end](const std::pair<uint64_t, uint64_t>& other_range) {
+            return start < other_range.second && other_range.first < end;
+            });
+        if (is_overlapping || end > m_size)
+        {
+            throw ProtocolError("Range " + std::to_string(start) + "-" + std::to_string(end) + " of file " + m_file_name + " overlaps another range or the end of the file");
+        }
+        m_ranges.emplace_back(start, end);
+    }
+
+    m_active_range_count--;
+    m_ended_ranges.push_back(std::move(range));
+
+    const bool is_first_corrupt = !is_valid && !m_is_corrupt;
+    if (is_first_corrupt)
+    {
+        m_is_corrupt = true;
+    }
+    if (m_is_failed || m_is_corrupt)
+    {
+        RangeEnd range_end = fail_locked();
+        range_end.is_first_corrupt = is_first_corrupt;
+        return range_end;
+    }
+
+    RangeEnd range_end;
+    range_end.is_complete = try_finish();
+    return range_end;
+}
+
+/**
+ * @brief Counts bytes of the file written on disk.
+ *
+ * @return true if they are the last bytes of the file, the caller finalizes it.
+ */
+bool StripedFile::add_written(uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_written_size += size;
+    return try_finish();
+}
+
+/**
+ * @brief Marks the file as failed, after a lost connection.
+ *
+ * @return The ranges ended to acknowledge as rejected, and if no range of the file is being received anymore, the
+ * caller removes the file once.
+ */
+StripedFile::RangeEnd StripedFile::fail()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return fail_locked();
+}
+
+/**
+ * @brief Ends a range that will never be complete, its session left, and marks the file as failed.
+ *
+ * @return The ranges ended to acknowledge as rejected, and if no range of the file is being received anymore, the
+ * caller removes the file once.
+ */
+StripedFile::RangeEnd StripedFile::abort_range()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active_range_count--;
+    return fail_locked();
+}
+
+/**
+ * @brief Checks if the file is finalized or removed, its sessions don't wait for it anymore.
+ */
+bool StripedFile::is_finished() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_is_finished;
+}
+
+/**
+ * @brief Takes the ranges ended, for their acknowledgment once the file is finalized.
+ */
+std::vector<StripedFile::EndedRange> StripedFile::take_ended_ranges()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::move(m_ended_ranges);
+}
+
+/**
+ * @brief Checks if the file can be finalized, and marks it finished if so. Must be called with the mutex locked.
+ */
+bool StripedFile::try_finish()
+{
+    if (m_is_failed || m_is_finished || m_active_range_count > 0 || m_written_size != m_size)
+    {
+        return false;
+    }
+    m_is_finished = true;
+    return true;
+}
+
+/**
+ * @brief Marks the file as failed, and marks it finished once no range of it is being received. Must be called with the mutex locked.
+ *
+ * @return The ranges ended, to acknowledge as rejected, and is_discarded if the file is marked finished by this call :
+ * the caller removes it, all its writes are queued.
+ */
+StripedFile::RangeEnd StripedFile::fail_locked()
+{
+    m_is_failed = true;
+
+    RangeEnd range_end;
+    range_end.rejected_ranges.swap(m_ended_ranges);
+    if (!m_is_finished && m_active_range_count == 0)
+    {
+        m_is_finished = true;
+        range_end.is_discarded = true;
+    }
+    return range_end;
+}
+
+/**
+ * @class StripedFileTable
+ * @brief The striped files being received, by transfer id, name, size and date.
+ *
+ * The first range of a file creates it in the table, the next ranges with the same key join it. A finished or
+ * failed file is removed from the table, a new range with the same key then starts a new file. Until then, the ranges
+ * sent again by the client join the failed file and are rejected when they end.
+ */
+
+/**
+ * @brief Joins the striped file of a range, creates it with the file opened by `open` if it's the first range.
+ *
+ * @param transfer_id The id shared by the ranges of the file.
+ * @param file_name The name of the file sent by the client.
+ * @param last_modified The last modified date sent by the client.
+ * @param size The size of the whole file.
+ * @param open Opens the file on disk with its whole size, called with the table locked.
+ *
+ * @return The striped file, with the range counted.
+ */
+std::shared_ptr<StripedFile> StripedFileTable::join(uint32_t transfer_id, const std::string& file_name, double last_modified, uint64_t size, const Open& open)
+{
+    char date[32];
+    const std::to_chars_result date_result = std::to_chars(date, date + sizeof(date), last_modified);
+    std::string key = std::to_string(transfer_id) + '\n' + std::to_string(size) + '\n' + std::string(date, date_result.ptr) + '\n' + file_name;
+
+    std::shared_ptr<StripedFile> striped_file;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::shared_ptr<StripedFile>& table_file = m_files[key];
+        if (!table_file)
+        {
+            table_file = std::make_shared<StripedFile>(key, file_name, size, open());
+        }
+        striped_file = table_file;
+        striped_file->start_range();
+    }
+    return striped_file;
+}
+
+/**
+ * @brief Removes a file from the table, a new range with the same key then starts a new file.
+ */
+void StripedFileTable::remove(const StripedFile& striped_file)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto file = m_files.find(striped_file.key());
+    if (file != m_files.end() && file->second.get() == &striped_file)
+    {
+        m_files.erase(file);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "FileWriteEngine.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Session;
+struct ReceivedFile;
+
+class StripedFile
+{
+public:
+	using EndedRange = std::pair<std::shared_ptr<Session>, std::shared_ptr<ReceivedFile>>; // session waiting the ACK of the file, and its range
+
+	struct RangeEnd
+	{
+		bool is_complete = false; // last bytes of the file, the caller finalizes it
+		bool is_first_corrupt = false; // first range that doesn't match its checksum
+		bool is_discarded = false; // the file failed, the caller removes it
+		std::vector<EndedRange> rejected_ranges; // ranges of the failed file to acknowledge as rejected
+	};
+
+	StripedFile(std::string key, std::string file_name, uint64_t size, std::shared_ptr<FileWriteEngine::File> output);
+
+	const std::string& key() const { return m_key; }
+	const std::string& file_name() const { return m_file_name; }
+	uint64_t size() const { return m_size; }
+	const std::shared_ptr<FileWriteEngine::File>& output() const { return m_output; }
+
+	void start_range();
+	RangeEnd end_range(uint64_t start, uint64_t end, bool is_valid, EndedRange range);
+	bool add_written(uint64_t size);
+	RangeEnd fail();
+	RangeEnd abort_range();
+	bool is_finished() const;
+	std::vector<EndedRange> take_ended_ranges();
+
+private:
+	bool try_finish();
+	RangeEnd fail_locked();
+
+	const std::string m_key; // key in the striped file table
+	const std::string m_file_name;
+	const uint64_t m_size;
+	const std::shared_ptr<FileWriteEngine::File> m_output;
+
+	mutable std::mutex m_mutex;
+	std::vector<std::pair<uint64_t, uint64_t>> m_ranges; // start and end of the ranges received
+	uint64_t m_written_size = 0; // bytes of the file written on disk
+	unsigned int m_active_range_count = 0; // ranges being received
+	bool m_is_failed = false; // a session left before the end of the file, or a range is corrupt : the ranges are acknowledged as rejected
+	bool m_is_corrupt = false; // the data of a range don't match their checksum
+	bool m_is_finished = false; // finalized or discarded
+	std::vector<EndedRange> m_ended_ranges;
+};
+
+class StripedFileTable
+{
+public:
+	using Open = std::function<std::shared_ptr<FileWriteEngine::File>()>;
+
+	std::shared_ptr<StripedFile> join(uint32_t transfer_id, const std::string& file_name, double last_modified, uint64_t size, const Open& open);
+	void remove(const StripedFile& striped_file);
+
+private:
+	std::mutex m_mutex;
+	std::unordered_map<std::string, std::shared_ptr<StripedFile>> m_files; // key : transfer id, size, date and name
+};
@@ -0,0 +1,99 @@
+#include "TcpListener.h"
+
+#include <boost/asio/ip/v6_only.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <string>
+
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define ITLH_REUSE_PORT // the kernel spreads the connections over the sockets bound to the same port
+using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+/**
+ * @class TcpListener
+ * @brief Opens the acceptors of the servers on all the network interfaces, the WebSocket server and the metrics server.
+ *
+ * The acceptor listens in IPv6 with IPv4 mapped addresses (dual stack), so clients of both families connect on the
+ * same port. On a system without IPv6, or where `[::]` can't be bound (IPv6 disabled on the interfaces, the bind
+ * fails with EADDRNOTAVAIL), it listens in IPv4 only.
+ */
+
+/**
+ * @brief Opens, binds and listens with a protocol, the acceptor is closed on an error.
+ *
+ * @return The error of the first step that failed.
+ */
+static boost::system::error_code try_listen(tcp::acceptor& acceptor, const tcp::endpoint& endpoint, bool reuse_port)
+{
+    boost::system::error_code ec;
+    acceptor.open(endpoint.protocol(), ec);
+    if (!ec && endpoint.address().is_v6())
+    {
+        acceptor.set_option(net::ip::v6_only(false), ec);
+    }
+    if (!ec)
+    {
+        acceptor.set_option(net::socket_base::reuse_address(true), ec);
+    }
+#ifdef ITLH_REUSE_PORT
+    if (!ec && reuse_port)
+    {
+        acceptor.set_option(reuse_port_option(true), ec);
+    }
+#else
+    (void)reuse_port;
+#endif
+    if (!ec)
+    {
+        acceptor.bind(endpoint, ec);
+    }
+    if (!ec)
+    {
+        acceptor.listen(net::socket_base::max_listen_connections, ec);
+    }
+
+    if (ec)
+    {
+        boost::system::error_code close_ec;
+        acceptor.close(close_ec);
+    }
+    return ec;
+}
+
+/**
+ * @brief Listens on a port of all the network interfaces, in IPv6 dual stack, else in IPv4.
+ *
+ * @param acceptor The acceptor, not open yet.
+ * @param port The port.
+ * @param reuse_port true to allow other acceptors on the same port with `SO_REUSEPORT`, where the system has it.
+ *
+ * @throws boost::system::system_error If the port can't be bound in IPv4 either, like when another program uses it.
+ */
+void TcpListener::listen(tcp::acceptor& acceptor, uint_least16_t port, bool reuse_port)
+{
+    if (!try_listen(acceptor, tcp::endpoint(tcp::v6(), port), reuse_port))
+    {
+        return;
+    }
+
+    const boost::system::error_code ec = try_listen(acceptor, tcp::endpoint(tcp::v4(), port), reuse_port);
+    if (ec)
+    {
+        throw boost::system::system_error(ec, "Listen on port " + std::to_string(port));
+    }
+}
+
+/**
+ * @brief Returns true if many acceptors can listen on the same port, each one with its own thread.
+ */
+bool TcpListener::is_reuse_port_supported()
+{
+#ifdef ITLH_REUSE_PORT
+    return true;
+#else
+    return false;
+#endif
+}
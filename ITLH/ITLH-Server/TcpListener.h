@@ -0,0 +1,10 @@
+#pragma once
+#include <boost/asio/ip/tcp.hpp>
+#include <cstdint>
+
+class TcpListener
+{
+public:
+	static void listen(boost::asio::ip::tcp::acceptor& acceptor, uint_least16_t port, bool reuse_port);
+	static bool is_reuse_port_supported();
+};
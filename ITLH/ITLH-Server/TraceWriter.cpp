@@ -0,0 +1,127 @@
+#include "TraceWriter.h"
+
+#include <ios>
+
+/**
+ * @class TraceWriter
+ * @brief Writes the timings of each received file as a Chrome trace (JSON array format).
+ *
+ * The trace can be opened in `chrome://tracing` or https://ui.perfetto.dev : each file is a row named
+ * after the file, with one span per step (receive, name resolution, disk write, metadata stamping, ACK),
+ * so we see where each upload spends its time. The events are appended as files are saved; the closing
+ * bracket is written when the server stops, and the viewers accept a trace without it when the server
+ * is killed.
+ */
+
+/**
+ * @brief Escapes a string for a JSON string value.
+ */
+static std::string escape_json(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (const char character : text)
+    {
+        if (character == '"' || character == '\\')
+        {
+            escaped += '\\';
+            escaped += character;
+        }
+        else if (static_cast<unsigned char>(character) < 0x20)
+        {
+            static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+            escaped += "\\u00";
+            escaped += HEX_DIGITS[(character >> 4) & 0xF];
+            escaped += HEX_DIGITS[character & 0xF];
+        }
+        else
+        {
+            escaped += character;
+        }
+    }
+
+    return escaped;
+}
+
+/**
+ * @param trace_path The path of the trace file, replaced if it exists.
+ *
+ * @exception std::ios_base::failure Thrown if the trace file can't be created.
+ */
+TraceWriter::TraceWriter(const std::string& trace_path)
+    : m_start_time(std::chrono::steady_clock::now())
+    , m_stream(trace_path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_stream)
+    {
+        throw std::ios_base::failure("Failed to create trace file: " + trace_path);
+    }
+
+    m_stream << "[\n";
+}
+
+TraceWriter::~TraceWriter()
+{
+    m_stream << "\n]\n";
+}
+
+/**
+ * @brief Appends the steps of a saved file to the trace.
+ *
+ * Steps that didn't happen (like the disk write of an empty file) are skipped.
+ *
+ * @param file_name The name sent by the client, used as row name.
+ * @param file_size The number of bytes received.
+ * @param timings The times measured by the session.
+ * @param name_resolution_start Time measured by the write engine before choosing a free name.
+ * @param name_resolution_end Time measured by the write engine after choosing a free name.
+ */
+void TraceWriter::write_file_trace(const std::string& file_name, uint64_t file_size, const FileTimings& timings,
+    std::chrono::steady_clock::time_point name_resolution_start, std::chrono::steady_clock::time_point name_resolution_end)
+{
+    const std::string args = "\"args\":{\"file\":\"" + escape_json(file_name) + "\",\"size\":" + std::to_string(file_size) + "}";
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const std::string thread = "\"pid\":1,\"tid\":" + std::to_string(++m_file_count);
+
+    write_event("{\"name\":\"thread_name\",\"ph\":\"M\"," + thread + ",\"args\":{\"name\":\"" + escape_json(file_name) + "\"}}");
+
+    auto write_span = [&](const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        if (start == std::chrono::steady_clock::time_point() || end < start)
+        {
+            return;
+        }
+        write_event(std::string("{\"name\":\"") + name + "\",\"ph\":\"X\"," + thread
+            + ",\"ts\":" + std::to_string(to_microseconds(start))
+            + ",\"dur\":" + std::to_string(to_microseconds(end) - to_microseconds(start)) + "," + args + "}");
+        };
+
+    write_span("receive", timings.receive_start, timings.receive_end);
+    write_span("name resolution", name_resolution_start, name_resolution_end);
+    write_span("disk write", timings.write_start, timings.write_end);
+    write_span("metadata stamping", timings.stamping_start, timings.stamping_end);
+    write_span("ACK", timings.stamping_end, timings.ack_end);
+    m_stream.flush(); // the server is usually stopped by closing its console
+}
+
+/**
+ * @brief Appends an event to the JSON array, the caller holds the mutex.
+ */
+void TraceWriter::write_event(const std::string& event)
+{
+    if (!m_is_first_event)
+    {
+        m_stream << ",\n";
+    }
+    m_is_first_event = false;
+    m_stream << event;
+}
+
+/**
+ * @brief Converts a time to the trace time, in microseconds since the start of the server.
+ */
+int64_t TraceWriter::to_microseconds(std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - m_start_time).count();
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "ServerMetrics.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+class TraceWriter
+{
+public:
+	explicit TraceWriter(const std::string& trace_path);
+	~TraceWriter();
+
+	void write_file_trace(const std::string& file_name, uint64_t file_size, const FileTimings& timings,
+		std::chrono::steady_clock::time_point name_resolution_start, std::chrono::steady_clock::time_point name_resolution_end);
+
+private:
+	void write_event(const std::string& event);
+	int64_t to_microseconds(std::chrono::steady_clock::time_point time) const;
+
+	const std::chrono::steady_clock::time_point m_start_time;
+
+	std::mutex m_mutex;
+	std::ofstream m_stream;
+	uint64_t m_file_count = 0;
+	bool m_is_first_event = true;
+};
@@ -2,12 +2,10 @@
 
 #include <windows.h>
 #include <shobjidl.h>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <combaseapi.h>
-#include <propvarutil.h>
-#include <propsys.h>
-#include <propkey.h>
 
 //#define NTDDI_VERSION NTDDI_WIN10 // do we need this ?
 //#define _WIN32_WINNT _WIN32_WINNT_WIN10 // in visual project property already -> it's for win10 code setup lib
@@ -100,153 +98,178 @@ std::string WindowsFileDiag::open_select_folder_diag_window()
 }
 
 /**
- * @brief Sets the last modified time of a file using a `FILETIME` structure.
+ * @brief Creates a file and opens it for writing the data received.
  *
- * This function opens a file specified by its path and updates its last modified time.
- * It uses the Windows API `SetFileTime` to apply the provided `FILETIME` value to the file.
+ * The file is created or truncated, or kept as it is to write the rest of a part file, and opened for a sequential write. The same handle is used to write
+ * the data and to apply the file date, so the file is opened only once. When the size of the file is
+ * known, the disk space is reserved at once so the file isn't fragmented by the following writes.
  *
- * @param file_path The path to the file whose attributes are to be modified.
- * @param ft The `FILETIME` structure containing the desired last modified time.
+ * @param file_path The path of the file to create.
+ * @param file_size The size the file will have, 0 if unknown.
+ * @param keep_data true to keep the data of an existing file, false to truncate it.
  *
- * @note Ensure the caller has the necessary write permissions for the file.
- * The file handle is closed after the operation to prevent resource leaks.
+ * @return The handle of the opened file.
  *
- * @warning If the file cannot be opened or its attributes cannot be modified,
- * an error message is logged to `std::cerr`, and no changes are made.
+ * @exception std::ios_base::failure Thrown if the file can't be created.
  */
-static void set_file_creation_time(const std::string& file_path, const FILETIME& ft)
+WindowsFileDiag::FileHandle WindowsFileDiag::open_file_for_write(const std::string& file_path, uint64_t file_size, bool keep_data)
 {
     HANDLE file_handle = CreateFileA(
         file_path.c_str(),
-        FILE_WRITE_ATTRIBUTES,
-        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        GENERIC_WRITE | FILE_WRITE_ATTRIBUTES,
+        FILE_SHARE_READ,
         nullptr,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
+        keep_data ? OPEN_ALWAYS : CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
         nullptr);
 
     if (file_handle == INVALID_HANDLE_VALUE)
     {
-        std::cerr << "Error : Can't open file for change file attributes." << std::endl;
-        return;
+        throw std::ios_base::failure("Failed to open file: " + file_path + " for writing");
     }
 
-    if (!SetFileTime(file_handle, &ft, nullptr, nullptr))
+    if (file_size > 0)
     {
-        std::cerr << "Error : Can't change file time attribut." << std::endl;
+        FILE_ALLOCATION_INFO allocation_info;
+        allocation_info.AllocationSize.QuadPart = static_cast<LONGLONG>(file_size);
+        if (!SetFileInformationByHandle(file_handle, FileAllocationInfo, &allocation_info, sizeof(allocation_info)))
+        {
+            const DWORD error = GetLastError();
+            CloseHandle(file_handle);
+            throw std::ios_base::failure("Failed to reserve " + std::to_string(file_size) + " octets for file: " + file_path + ", error " + std::to_string(error));
+        }
     }
 
-    CloseHandle(file_handle);
+    return file_handle;
+}
+
+/**
+ * @brief Writes data at a given position of an opened file.
+ *
+ * @param file_handle The handle given by `open_file_for_write()`.
+ * @param offset The position in the file of the first byte to write.
+ * @param data The data to write.
+ * @param size The number of bytes to write.
+ *
+ * @exception std::ios_base::failure Thrown if the data can't be written, like when the disk is full.
+ */
+void WindowsFileDiag::write_file(FileHandle file_handle, uint64_t offset, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const DWORD part_size = static_cast<DWORD>(std::min<size_t>(size, MAXDWORD));
+        DWORD written_size = 0;
+        OVERLAPPED position = {};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        if (!WriteFile(file_handle, data, part_size, &written_size, &position) || written_size == 0)
+        {
+            throw std::ios_base::failure("Failed to write file, error " + std::to_string(GetLastError()));
+        }
+
+        data += written_size;
+        size -= written_size;
+        offset += written_size;
+    }
 }
 
 /**
- * @brief Updates the last modified time of a file based on a Unix timestamp.
+ * @brief Sets the creation time of an opened file based on a Unix timestamp.
  *
  * Converts the given Unix timestamp (in milliseconds since epoch) to a `FILETIME` format
- * and applies it as the file's last modified time. This is done by calling
- * the `set_file_time` function internally.
+ * and applies it as the file's creation time with the Windows API `SetFileTime`.
  *
- * @param file_path The path to the file to be updated.
- * @param last_modified_time The last modified timestamp in milliseconds since Unix epoch.
+ * @param file_handle The handle given by `open_file_for_write()`.
+ * @param date The timestamp in milliseconds since Unix epoch.
  *
  * @note The function assumes the provided timestamp is in UTC and converts it to `FILETIME`
  * using the Windows epoch offset.
  *
- * @see set_file_time()
+ * @warning If the file attributes cannot be modified, an error message is logged to `std::cerr`,
+ * and no changes are made.
  */
-void WindowsFileDiag::apply_last_modified_date_on_file(const std::string& file_path, double last_modified_time)
+void WindowsFileDiag::apply_date_on_file(FileHandle file_handle, double date)
 {
     FILETIME ft;
-    uint64_t file_time_intervals = static_cast<uint64_t>(last_modified_time * 10000.0) + 116444736000000000ULL;
+    uint64_t file_time_intervals = static_cast<uint64_t>(date * 10000.0) + 116444736000000000ULL;
     ft.dwLowDateTime = static_cast<DWORD>(file_time_intervals);
     ft.dwHighDateTime = static_cast<DWORD>(file_time_intervals >> 32);
 
-    set_file_creation_time(file_path, ft);
+    if (!SetFileTime(file_handle, &ft, nullptr, nullptr))
+    {
+        std::cerr << "Error : Can't change file time attribut." << std::endl;
+    }
 }
 
 /**
- * @brief Applies the "Date Taken" metadata as the file's last modified time.
- *
- * This function retrieves the "Date Taken" metadata from the specified file's properties
- * using the Windows Property Store API. It converts the metadata from `FILETIME` to `SYSTEMTIME`,
- * and then applies it as the file's last modified time.
+ * @brief Closes a file opened by `open_file_for_write()`.
  *
- * The steps performed are as follows:
- * - Initializes COM for the current thread.
- * - Converts the file path from a `std::string` to a `std::wstring`.
- * - Opens the file's property store to access its metadata.
- * - Retrieves the `PKEY_Photo_DateTaken` property, which contains the "Date Taken" information, in `FILETIME` format.
- * - Converts the `FILETIME` to `SYSTEMTIME` (UTC).
- * - Converts the `SYSTEMTIME` to `FILETIME` for application to the file.
- * - Releases all resources and uninitializes COM.
- * - Updates the file's creation time to match the "Date Taken" value.
- *
- * @param file_path The path to the file whose metadata will be used to set the last modified time.
+ * @param file_handle The handle of the file.
+ */
+void WindowsFileDiag::close_file(FileHandle file_handle)
+{
+    CloseHandle(file_handle);
+}
+
+/**
+ * @brief Opens a closed file again to flush its data on disk, `FlushFileBuffers` needs a handle with write access.
  *
- * @note This function assumes that the "Date Taken" metadata is available as a `FILETIME`.
- * It applies the metadata as the file's last modified time, regardless of the current local time zone.
+ * @param file_path The path of the file.
  *
- * @warning Ensure that the calling thread is initialized with COM. The function handles all necessary COM initialization and cleanup.
+ * @return The handle of the file, to close with `close_file()`.
  *
- * @exception std::runtime_error Thrown if COM initialization or metadata retrieval fails.
+ * @exception std::ios_base::failure Thrown if the file can't be opened.
  */
-bool WindowsFileDiag::apply_metadata_date_on_file(const std::string& file_path)
+WindowsFileDiag::FileHandle WindowsFileDiag::open_file_for_flush(const std::string& file_path)
 {
-    HRESULT hr = CoInitialize(nullptr);
-    if (FAILED(hr))
-    {
-        std::cerr << "Error Init Com : " << std::hex << hr << std::endl;
-        return false;
-    }
-
-    // convert string to wstring, warning !
-    std::wstring file_path_wstring(file_path.begin(), file_path.end());
-
-    // Ouvrir le fichier avec le Property Store
-    IPropertyStore* property_store = nullptr;
-    hr = SHGetPropertyStoreFromParsingName(file_path_wstring.c_str(), nullptr, GPS_DEFAULT, IID_PPV_ARGS(&property_store));
-    //SHGetPropertyStoreFromParsingName call can generate warning print like : "Corrupt JPEG data: 2809223 extraneous bytes before marker 0xd9", it's not a pb, file open correctly on windows after
-    if (FAILED(hr))
-    {
-        // we can save file that fail at this position : "JPEG datastream contains no image" print and hr is ERROR. This path indicate file can't be open by windows after.
-        std::cerr << "Error Accessing File Metadata : " << std::hex << hr << std::endl;
-        CoUninitialize();
-        return false;
-    }
-
-    // Rcuprer la date de prise de vue (PKEY_Photo_DateTaken)
-    PROPVARIANT prop_var_date_taken;
-    PropVariantInit(&prop_var_date_taken);
-    hr = property_store->GetValue(PKEY_Photo_DateTaken, &prop_var_date_taken);
-    if (!(SUCCEEDED(hr) && prop_var_date_taken.vt == VT_FILETIME))
-    {
-        //std::cerr << "Error Get PKEY_Photo_DateTaken Property." << std::endl;
-        return true;
-    }
-
-    SYSTEMTIME system_time;
+    HANDLE file_handle = CreateFileA(
+        file_path.c_str(),
+        GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
 
-    // Convertir FILETIME en SYSTEMTIME (UTC)
-    if (!FileTimeToSystemTime(&prop_var_date_taken.filetime, &system_time))
+    if (file_handle == INVALID_HANDLE_VALUE)
     {
-        //std::cerr << "Error convert FILETIME en SYSTEMTIME." << std::endl;
-        return true;
+        throw std::ios_base::failure("Failed to open file: " + file_path + " for flush, error " + std::to_string(GetLastError()));
     }
+    return file_handle;
+}
 
-    FILETIME local_file_time;
+/**
+ * @brief Starts the write on disk of the data of a file without waiting for it, Windows has no such call.
+ *
+ * @param file_handle The handle of the file.
+ */
+void WindowsFileDiag::start_flush_file(FileHandle file_handle)
+{
+    (void)file_handle;
+}
 
-    // TODO : really need FileTime -> SystemTime -> FileTime ???
-    if (!SystemTimeToFileTime(&system_time, &local_file_time))
+/**
+ * @brief Waits until the data and the attributes of a file are written on disk, with `FlushFileBuffers`.
+ *
+ * @param file_handle The handle of the file, opened with write access.
+ *
+ * @exception std::ios_base::failure Thrown if the disk reports an error, the data of the file may be lost.
+ */
+void WindowsFileDiag::flush_file(FileHandle file_handle)
+{
+    if (!FlushFileBuffers(file_handle))
     {
-        //std::cerr << "Error convert SYSTEMTIME in FILETIME." << std::endl;
-        return true;
+        throw std::ios_base::failure("Failed to flush file on disk, error " + std::to_string(GetLastError()));
     }
+}
 
-    PropVariantClear(&prop_var_date_taken);
-    property_store->Release();
-    CoUninitialize();
-
-    set_file_creation_time(file_path, local_file_time);
-
-    return true;
+/**
+ * @brief Does nothing on Windows : NTFS writes the directory entries with its journal of metadata, and the
+ * flush of a file commits the journal.
+ *
+ * @param directory_path The path of the directory.
+ */
+void WindowsFileDiag::flush_directory(const std::string& directory_path)
+{
+    (void)directory_path;
 }
@@ -1,11 +1,26 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 class WindowsFileDiag
 {
 public:
+#ifdef _WIN32
+	using FileHandle = void*; // HANDLE
+#else
+	using FileHandle = int; // file descriptor
+#endif
+
 	static std::string open_select_folder_diag_window();
-	static void apply_last_modified_date_on_file(const std::string& file_path, double last_modified_time);
-	static bool apply_metadata_date_on_file(const std::string& filePath);
-};
 
+	static FileHandle open_file_for_write(const std::string& file_path, uint64_t file_size, bool keep_data = false);
+	static void write_file(FileHandle file_handle, uint64_t offset, const uint8_t* data, size_t size);
+	static void apply_date_on_file(FileHandle file_handle, double date);
+	static void close_file(FileHandle file_handle);
+
+	static FileHandle open_file_for_flush(const std::string& file_path);
+	static void start_flush_file(FileHandle file_handle);
+	static void flush_file(FileHandle file_handle);
+	static void flush_directory(const std::string& directory_path);
+};
@@ -0,0 +1,444 @@
+#include "ContentHasher.h"
+#include "Crc32c.h"
+#include "MetadataDateReader.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+constexpr int TEST_SKIPPED = 77; // SKIP_RETURN_CODE of the tests in CMakeLists.txt
+constexpr std::size_t SPLIT_CHUNK_SIZES[] = { 1, 3, 7, 2, 64, 5, 1000, 13 }; // sizes given to feed() in turn, to cut every field
+
+/**
+ * @brief Unit tests of the parts of the server reading the file data : CRC32C, XXH64 and metadata dates.
+ *
+ * One test is run per call, its name given on the command line, so ctest shows each one.
+ */
+
+static int g_failure_count = 0;
+
+static void check(bool condition, const std::string& what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED : " << what << std::endl;
+        g_failure_count++;
+    }
+}
+
+static std::string to_hex(uint64_t value)
+{
+    std::ostringstream stream;
+    stream << "0x" << std::hex << std::uppercase << value;
+    return stream.str();
+}
+
+static void check_equal(uint64_t value, uint64_t expected, const std::string& what)
+{
+    check(value == expected, what + " : " + to_hex(value) + " instead of " + to_hex(expected));
+}
+
+static std::vector<uint8_t> to_bytes(const std::string& text)
+{
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+/**
+ * @brief Gives the data to a reader or a hasher in chunks of changing sizes.
+ */
+static void feed_split(const std::vector<uint8_t>& data, const std::function<void(const uint8_t*, std::size_t)>& feed)
+{
+    std::size_t position = 0;
+    for (std::size_t i = 0; position < data.size(); i++)
+    {
+        const std::size_t size = std::min(SPLIT_CHUNK_SIZES[i % std::size(SPLIT_CHUNK_SIZES)], data.size() - position);
+        feed(data.data() + position, size);
+        position += size;
+    }
+}
+
+// CRC32C
+
+/**
+ * @brief Checks an implementation with the CRC32C examples of RFC 3720 (iSCSI), appendix B.4.
+ */
+static void test_crc32c(Crc32c::Implementation implementation)
+{
+    std::vector<uint8_t> ascending(32);
+    std::vector<uint8_t> descending(32);
+    for (std::size_t i = 0; i < 32; i++)
+    {
+        ascending[i] = static_cast<uint8_t>(i);
+        descending[i] = static_cast<uint8_t>(31 - i);
+    }
+    const std::vector<uint8_t> read_command = {
+        0x01, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18,
+        0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    const struct
+    {
+        const char* name;
+        std::vector<uint8_t> data;
+        uint32_t crc;
+    } vectors[] = {
+        { "32 bytes of zeros", std::vector<uint8_t>(32, 0x00), 0x8A9136AA },
+        { "32 bytes of ones", std::vector<uint8_t>(32, 0xFF), 0x62A8AB43 },
+        { "32 incrementing bytes", ascending, 0x46DD794E },
+        { "32 decrementing bytes", descending, 0x113FDB5C },
+        { "iSCSI read command", read_command, 0xD9963A56 },
+        { "123456789", to_bytes("123456789"), 0xE3069283 }, // not a multiple of 8 bytes
+        { "empty", {}, 0x00000000 }
+    };
+
+    for (const auto& vector : vectors)
+    {
+        check_equal(Crc32c::compute(implementation, vector.data.data(), vector.data.size()), vector.crc, std::string("CRC32C of ") + vector.name);
+    }
+
+    // Crc32c::feed() uses the fastest implementation, it must give the same checksums
+    for (const auto& vector : vectors)
+    {
+        Crc32c crc;
+        feed_split(vector.data, [&crc](const uint8_t* data, std::size_t size) { crc.feed(data, size); });
+        check_equal(crc.digest(), vector.crc, std::string("CRC32C fed in parts of ") + vector.name);
+    }
+}
+
+// XXH64
+
+/**
+ * @brief Checks the content hasher with XXH64 reference hashes (seed 0), whole and fed in parts.
+ */
+static void test_xxh64()
+{
+    std::vector<uint8_t> stripes(1000); // 31 stripes of 32 bytes and a tail of 8 + 8 + 8 bytes
+    for (std::size_t i = 0; i < stripes.size(); i++)
+    {
+        stripes[i] = static_cast<uint8_t>(i);
+    }
+
+    const struct
+    {
+        const char* name;
+        std::vector<uint8_t> data;
+        uint64_t hash;
+    } vectors[] = {
+        { "empty", {}, 0xEF46DB3751D8E999ULL },
+        { "a", to_bytes("a"), 0xD24EC4F1A98C6E5BULL },
+        { "abc", to_bytes("abc"), 0x44BC2CF5AD770999ULL },
+        { "a sentence of 39 bytes", to_bytes("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ULL },
+        { "1000 bytes", stripes, 0x6EF436B00EBA4078ULL }
+    };
+
+    for (const auto& vector : vectors)
+    {
+        ContentHasher whole;
+        whole.feed(vector.data.data(), vector.data.size());
+        check_equal(whole.digest(), vector.hash, std::string("XXH64 of ") + vector.name);
+
+        ContentHasher split;
+        feed_split(vector.data, [&split](const uint8_t* data, std::size_t size) { split.feed(data, size); });
+        check_equal(split.digest(), vector.hash, std::string("XXH64 fed in parts of ") + vector.name);
+    }
+}
+
+// Metadata dates
+
+/**
+ * @class FileWriter
+ * @brief Builds the test files, big or little endian.
+ */
+class FileWriter
+{
+public:
+    explicit FileWriter(bool is_little_endian = false) : m_is_little_endian(is_little_endian) {}
+
+    void u8(uint8_t value) { m_data.push_back(value); }
+    void u16(uint16_t value) { write(value, 2); }
+    void u32(uint32_t value) { write(value, 4); }
+    void u64(uint64_t value) { write(value, 8); }
+    void text(const std::string& value) { m_data.insert(m_data.end(), value.begin(), value.end()); }
+    void bytes(const std::vector<uint8_t>& value) { m_data.insert(m_data.end(), value.begin(), value.end()); }
+    void fill(std::size_t size, uint8_t value) { m_data.insert(m_data.end(), size, value); }
+
+    // ISO base media box around the content of another writer
+    void box(const char* type, const FileWriter& content)
+    {
+        u32(static_cast<uint32_t>(8 + content.size()));
+        text(type);
+        bytes(content.data());
+    }
+
+    std::size_t size() const { return m_data.size(); }
+    const std::vector<uint8_t>& data() const { return m_data; }
+
+private:
+    void write(uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            const std::size_t shift = 8 * (m_is_little_endian ? i : size - 1 - i);
+            m_data.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    bool m_is_little_endian;
+    std::vector<uint8_t> m_data;
+};
+
+/**
+ * @brief Builds a TIFF header with an EXIF IFD holding DateTimeOriginal and OffsetTimeOriginal.
+ */
+static std::vector<uint8_t> make_tiff(bool is_little_endian, const std::string& date_time, const std::string& offset_time)
+{
+    constexpr uint32_t IFD0_OFFSET = 8;
+    constexpr uint32_t EXIF_IFD_OFFSET = IFD0_OFFSET + 2 + 12 + 4;
+    constexpr uint32_t VALUES_OFFSET = EXIF_IFD_OFFSET + 2 + 2 * 12 + 4;
+
+    FileWriter tiff(is_little_endian);
+    tiff.text(is_little_endian ? "II" : "MM");
+    tiff.u16(42);
+    tiff.u32(IFD0_OFFSET);
+
+    tiff.u16(1);
+    tiff.u16(0x8769); // Exif IFD pointer
+    tiff.u16(4); // LONG
+    tiff.u32(1);
+    tiff.u32(EXIF_IFD_OFFSET);
+    tiff.u32(0);
+
+    tiff.u16(2);
+    tiff.u16(0x9003); // DateTimeOriginal
+    tiff.u16(2); // ASCII
+    tiff.u32(static_cast<uint32_t>(date_time.size() + 1));
+    tiff.u32(VALUES_OFFSET);
+    tiff.u16(0x9011); // OffsetTimeOriginal
+    tiff.u16(2);
+    tiff.u32(static_cast<uint32_t>(offset_time.size() + 1));
+    tiff.u32(static_cast<uint32_t>(VALUES_OFFSET + date_time.size() + 1));
+    tiff.u32(0);
+
+    tiff.text(date_time);
+    tiff.u8(0);
+    tiff.text(offset_time);
+    tiff.u8(0);
+    return tiff.data();
+}
+
+static std::vector<uint8_t> make_jpeg(const std::vector<uint8_t>& tiff)
+{
+    FileWriter jpeg;
+    jpeg.u16(0xFFD8);
+    jpeg.u16(0xFFE1); // APP1
+    jpeg.u16(static_cast<uint16_t>(2 + 6 + tiff.size()));
+    jpeg.text("Exif");
+    jpeg.u16(0);
+    jpeg.bytes(tiff);
+    jpeg.u16(0xFFDA); // start of scan
+    jpeg.u16(8);
+    jpeg.fill(6, 0x00);
+    jpeg.fill(5000, 0x12);
+    jpeg.u16(0xFFD9);
+    return jpeg.data();
+}
+
+/**
+ * @brief Builds a HEIC file whose Exif item, in the mdat box, is found through the iinf and iloc boxes of meta.
+ */
+static std::vector<uint8_t> make_heic(const std::vector<uint8_t>& tiff)
+{
+    FileWriter exif_item;
+    exif_item.u32(6); // offset of the TIFF header
+    exif_item.text("Exif");
+    exif_item.u16(0);
+    exif_item.bytes(tiff);
+
+    FileWriter ftyp_content;
+    ftyp_content.text("heic");
+    ftyp_content.u32(0);
+    ftyp_content.text("mif1heic");
+
+    FileWriter infe_content;
+    infe_content.u32(0x02000000); // version 2
+    infe_content.u16(1); // item id
+    infe_content.u16(0); // protection index
+    infe_content.text("Exif");
+    infe_content.u8(0); // name
+    FileWriter iinf_content;
+    iinf_content.u32(0);
+    iinf_content.u16(1);
+    iinf_content.box("infe", infe_content);
+
+    FileWriter hdlr_content;
+    hdlr_content.fill(24, 0x00);
+
+    // The offset of the item is known once the size of the boxes before mdat is
+    const auto make_head = [&](uint32_t item_offset)
+    {
+        FileWriter iloc_content;
+        iloc_content.u32(0); // version 0
+        iloc_content.u8(0x44); // offset size 4, length size 4
+        iloc_content.u8(0x00); // base offset size 0
+        iloc_content.u16(1); // item count
+        iloc_content.u16(1); // item id
+        iloc_content.u16(0); // data reference index
+        iloc_content.u16(1); // extent count
+        iloc_content.u32(item_offset);
+        iloc_content.u32(static_cast<uint32_t>(exif_item.size()));
+
+        FileWriter meta_content;
+        meta_content.u32(0);
+        meta_content.box("hdlr", hdlr_content);
+        meta_content.box("iinf", iinf_content);
+        meta_content.box("iloc", iloc_content);
+
+        FileWriter head;
+        head.box("ftyp", ftyp_content);
+        head.box("meta", meta_content);
+        return head;
+    };
+
+    FileWriter heic = make_head(static_cast<uint32_t>(make_head(0).size() + 8));
+    FileWriter mdat_content;
+    mdat_content.bytes(exif_item.data());
+    mdat_content.fill(5000, 0x77);
+    heic.box("mdat", mdat_content);
+    return heic.data();
+}
+
+/**
+ * @brief Builds a MP4 file with the moov box after the mdat box, the mvhd box in version 0 or 1 (64 bits times).
+ */
+static std::vector<uint8_t> make_mp4(uint8_t mvhd_version, uint64_t creation_time)
+{
+    FileWriter ftyp_content;
+    ftyp_content.text("isom");
+    ftyp_content.u32(0);
+    ftyp_content.text("isom");
+
+    FileWriter mdat_content;
+    mdat_content.fill(300'000, 0x55);
+
+    FileWriter mvhd_content;
+    mvhd_content.u8(mvhd_version);
+    mvhd_content.fill(3, 0x00); // flags
+    if (mvhd_version == 1)
+    {
+        mvhd_content.u64(creation_time);
+        mvhd_content.u64(creation_time); // modification time
+        mvhd_content.u32(1000); // time scale
+        mvhd_content.u64(0); // duration
+    }
+    else
+    {
+        mvhd_content.u32(static_cast<uint32_t>(creation_time));
+        mvhd_content.u32(static_cast<uint32_t>(creation_time));
+        mvhd_content.u32(1000);
+        mvhd_content.u32(0);
+    }
+    mvhd_content.fill(80, 0x00);
+
+    FileWriter trak_content;
+    trak_content.fill(100, 0x00);
+
+    FileWriter moov_content;
+    moov_content.box("mvhd", mvhd_content);
+    moov_content.box("trak", trak_content);
+
+    FileWriter mp4;
+    mp4.box("ftyp", ftyp_content);
+    mp4.box("mdat", mdat_content);
+    mp4.box("moov", moov_content);
+    return mp4.data();
+}
+
+/**
+ * @brief Checks the date read from a file, given whole and in parts of changing sizes.
+ */
+static void check_date(const std::vector<uint8_t>& file, double expected_date, const std::string& what)
+{
+    MetadataDateReader whole;
+    whole.feed(file.data(), file.size());
+    const MetadataDate whole_date = whole.read_date();
+    check(whole_date.status == MetadataDateStatus::found, "date found in " + what);
+    check_equal(static_cast<uint64_t>(whole_date.date), static_cast<uint64_t>(expected_date), "date of " + what);
+
+    MetadataDateReader split;
+    feed_split(file, [&split](const uint8_t* data, std::size_t size) { split.feed(data, size); });
+    const MetadataDate split_date = split.read_date();
+    check(split_date.status == MetadataDateStatus::found, "date found in " + what + " fed in parts");
+    check_equal(static_cast<uint64_t>(split_date.date), static_cast<uint64_t>(expected_date), "date of " + what + " fed in parts");
+}
+
+static void test_metadata_date()
+{
+    check_date(make_jpeg(make_tiff(false, "2019:01:02 03:04:05", "-05:30")), 1'546'418'045'000.0, "JPEG with big-endian EXIF");
+    check_date(make_jpeg(make_tiff(true, "2021:06:15 10:20:30", "+02:00")), 1'623'745'230'000.0, "JPEG with little-endian EXIF");
+    check_date(make_tiff(true, "2021:06:15 10:20:30", "+02:00"), 1'623'745'230'000.0, "TIFF");
+    check_date(make_heic(make_tiff(false, "2023:12:31 12:00:00", "+00:00")), 1'704'024'000'000.0, "HEIC");
+    check_date(make_mp4(0, 3'700'000'000), 1'617'155'200'000.0, "MP4 with 32 bits mvhd");
+    check_date(make_mp4(1, 5'000'000'000), 2'917'155'200'000.0, "MP4 with 64 bits mvhd");
+
+    // A reset reader reads the next file like a new one
+    MetadataDateReader reader;
+    const std::vector<uint8_t> movie = make_mp4(1, 5'000'000'000);
+    const std::vector<uint8_t> text = to_bytes("not a photo");
+    reader.feed(movie.data(), movie.size());
+    reader.reset();
+    reader.feed(text.data(), text.size());
+    check(reader.read_date().status == MetadataDateStatus::not_found, "no date in a text file after a movie");
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string test = argc > 1 ? argv[1] : "";
+    const struct
+    {
+        const char* name;
+        Crc32c::Implementation implementation;
+    } crc32c_tests[] = {
+        { "crc32c_table", Crc32c::Implementation::table },
+        { "crc32c_sse42", Crc32c::Implementation::sse42 },
+        { "crc32c_armv8", Crc32c::Implementation::armv8 }
+    };
+
+    bool is_known = false;
+    for (const auto& crc32c_test : crc32c_tests)
+    {
+        if (test == crc32c_test.name)
+        {
+            if (!Crc32c::is_supported(crc32c_test.implementation))
+            {
+                std::cout << test << " : not supported by this processor or build, skipped" << std::endl;
+                return TEST_SKIPPED;
+            }
+            test_crc32c(crc32c_test.implementation);
+            is_known = true;
+        }
+    }
+    if (test == "xxh64")
+    {
+        test_xxh64();
+        is_known = true;
+    }
+    else if (test == "metadata_date")
+    {
+        test_metadata_date();
+        is_known = true;
+    }
+
+    if (!is_known)
+    {
+        std::cerr << "Usage : ITLH-Tests crc32c_table|crc32c_sse42|crc32c_armv8|xxh64|metadata_date" << std::endl;
+        return 2;
+    }
+
+    std::cout << test << " : " << (g_failure_count == 0 ? "passed" : std::to_string(g_failure_count) + " failed") << std::endl;
+    return g_failure_count == 0 ? 0 : 1;
+}